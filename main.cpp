@@ -1,5 +1,13 @@
 // main.cpp
 #include "railway.h"
+#include "railway_import.h"
+#include "railway_snapshot.h"
+#include "railway_report.h"
+#include "railway_script.h"
+#include "railway_journal.h"
+#include "railway_workload.h"
+#include <fcntl.h>
+#include <chrono>
 #include <sstream>
 #include <limits>
 using namespace std;
@@ -46,13 +54,184 @@ void displayMenu() {
               << "3. Add lines to platform\n"
               << "4. Add train schedule\n"
               << "5. View entire system\n"
-              << "6. Exit\n"
+              << "6. View changes since last view\n"
+              << "7. Show metrics\n"
+              << "8. Exit\n"
               << "Enter your choice: ";
 }
 
-int main() {
-    RailwaySystem<string> railway;
-    
+void printUsage(const char* program) {
+    cerr << "Usage: " << program << " [--snapshot <file>] [--journal <file>] [--import <file>] [--generate <SxPxLxT>] [--report <format>] [--script] [--interactive]\n"
+         << "  --snapshot <file>  load state from a binary snapshot at startup (if present)\n"
+         << "                     and save it back on exit (not while conflicts remain)\n"
+         << "  --journal <file>   journal every change and replay it at startup\n"
+         << "  --import <file>    load a station/platform/line/train file (CSV or TSV)\n"
+         << "    --defer-checks   load train rows unchecked, then audit for conflicts (also with --generate)\n"
+         << "  --report <format>  write a report: table, csv or jsonl\n"
+         << "    --output <file>  report destination (default stdout)\n"
+         << "    --station <id>   only this station\n"
+         << "    --platform <n>   only this platform number\n"
+         << "    --from <HH:MM>   only trains at or after this time\n"
+         << "    --to <HH:MM>     only trains at or before this time\n"
+         << "  --script           read protocol commands from stdin, one response line each\n"
+         << "  --interactive      open the menu after importing\n"
+         << "  --metrics <format> print operation metrics to stderr on exit: text or json\n"
+         << "  --generate <SxPxLxT>  load a synthetic network: stations x platforms x lines x trains per line\n"
+         << "    --conflicts <percent>  share of train rows aimed at a conflict (default 0)\n"
+         << "    --seed <n>             generator seed (default 1)\n"
+         << "    --write-workload <file> write the network as an import file instead of loading it\n"
+         << "  --differential <n> check n random inserts against the reference conflict rule and exit\n";
+}
+
+// Puts a stream's format flags and precision back when it goes out of
+// scope, so timing lines leave clog as they found it
+class SavedFormat {
+private:
+    ostream& stream;
+    ios::fmtflags flags;
+    streamsize precision;
+
+public:
+    explicit SavedFormat(ostream& out) : stream(out), flags(out.flags()), precision(out.precision()) {}
+    ~SavedFormat() {
+        stream.flags(flags);
+        stream.precision(precision);
+    }
+    SavedFormat(const SavedFormat&) = delete;
+    SavedFormat& operator=(const SavedFormat&) = delete;
+};
+
+void runImport(RailwaySystem<string>& railway, const string& path, RailwayJournal<string>* journal,
+               bool deferChecks) {
+    TimetableImporter<string> importer(railway, cerr, journal);
+    if (deferChecks) importer.deferChecks();
+    ImportStats stats = importer.importFile(path);
+    SavedFormat format(clog);
+    clog << "Imported " << stats.rows << " rows from " << path << " ("
+         << stats.accepted << " accepted, " << stats.rejected << " rejected";
+    if (deferChecks) clog << ", " << stats.conflicts << " conflicting pairs";
+    clog << ") in " << fixed << setprecision(3) << stats.seconds << " s, "
+         << setprecision(0) << stats.rowsPerSecond() << " rows/s\n";
+}
+
+void runGenerate(RailwaySystem<string>& railway, const WorkloadShape& shape, const string& writePath,
+                 RailwayJournal<string>* journal, bool deferChecks) {
+    WorkloadGenerator generator(shape);
+    if (!writePath.empty()) {
+        generator.writeImportFile(writePath);
+        clog << "Wrote " << shape.trainRows() << " train rows (" << generator.getConflictRows()
+             << " aimed at conflicts) to " << writePath << "\n";
+        return;
+    }
+    ImportStats stats;
+    if (journal || deferChecks) {
+        // Through the importer, so every accepted row is journaled (or
+        // left for the audit)
+        string text;
+        {
+            OutputBuffer out(text);
+            generator.writeImport(out);
+        }
+        TimetableImporter<string> importer(railway, cerr, journal);
+        if (deferChecks) importer.deferChecks();
+        stats = importer.importBuffer(text);
+    } else {
+        stats = generator.load(railway);
+    }
+    SavedFormat format(clog);
+    clog << "Generated " << stats.rows << " rows (" << stats.accepted << " accepted, "
+         << stats.rejected << " rejected";
+    if (deferChecks) clog << ", " << stats.conflicts << " conflicting pairs";
+    clog << ") in " << fixed << setprecision(3) << stats.seconds << " s, "
+         << setprecision(0) << stats.rowsPerSecond() << " rows/s\n";
+}
+
+int runDifferentialCheck(size_t inserts, uint32_t seed) {
+    DifferentialResult result = runDifferential(inserts, seed);
+    SavedFormat format(clog);
+    clog << "Checked " << result.inserts << " inserts (" << result.accepted << " accepted), "
+         << result.removals << " removals and " << result.reschedules << " reschedules in "
+         << fixed << setprecision(3) << result.seconds << " s: " << result.mismatches << " mismatches\n";
+    if (result.mismatches > 0) {
+        cerr << "First mismatch: " << result.firstMismatch << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+ReportFormat parseReportFormat(const string& name) {
+    if (name == "table") return ReportFormat::Table;
+    if (name == "csv") return ReportFormat::Csv;
+    if (name == "jsonl") return ReportFormat::JsonLines;
+    throw RailwayException("Unknown report format '" + name + "'");
+}
+
+void runReport(const RailwaySystem<string>& railway, ReportFormat format,
+               const ReportFilter<string>& filter, const string& outputPath) {
+    int fd = STDOUT_FILENO;
+    if (!outputPath.empty()) {
+        fd = open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw RailwayException("Cannot open report output '" + outputPath + "'");
+        }
+    }
+    cout.flush();
+    {
+        OutputBuffer out(fd);
+        ReportWriter<string>(out, format, filter).write(railway);
+        out.flush();
+    }
+    if (fd != STDOUT_FILENO) {
+        close(fd);
+    }
+}
+
+MetricsFormat parseMetricsFormat(const string& name) {
+    if (name == "text") return MetricsFormat::Text;
+    if (name == "json") return MetricsFormat::Json;
+    throw RailwayException("Unknown metrics format '" + name + "'");
+}
+
+bool fileExists(const string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+}
+
+uint32_t runLoadSnapshot(RailwaySystem<string>& railway, const string& path) {
+    auto begin = chrono::steady_clock::now();
+    uint32_t generation = loadSnapshot(railway, path);
+    double millis = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+    SavedFormat format(clog);
+    clog << "Loaded snapshot " << path << " (" << railway.getStations().size()
+         << " stations) in " << fixed << setprecision(1) << millis << " ms\n";
+    return generation;
+}
+
+void reportReplay(const JournalReplay& replay, const string& path) {
+    if (replay.stale) {
+        clog << "Discarded journal " << path << " already folded into the snapshot\n";
+    } else if (replay.records > 0 || replay.tornBytes > 0) {
+        SavedFormat format(clog);
+        clog << "Replayed " << replay.records << " journal records from " << path << " in "
+             << fixed << setprecision(1) << replay.seconds * 1000.0 << " ms";
+            if (replay.tornBytes > 0) {
+            clog << " (dropped " << replay.tornBytes << " bytes of an incomplete commit)";
+        }
+        clog << "\n";
+    }
+}
+
+void runScript(RailwaySystem<string>& railway, RailwayJournal<string>* journal) {
+    cout.flush();
+    auto begin = chrono::steady_clock::now();
+    size_t commands = CommandProcessor<string>(railway, journal).serve(STDIN_FILENO, STDOUT_FILENO);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    SavedFormat format(clog);
+    clog << "Ran " << commands << " commands in " << fixed << setprecision(3) << seconds << " s\n";
+}
+
+int runInteractive(RailwaySystem<string>& railway, RailwayJournal<string>* journal) {
+    IncrementalTableView<string> view;
     while (true) {
         try {
             displayMenu();
@@ -64,7 +243,12 @@ int main() {
                     string name;
                     cout << "Enter station name: ";
                     getline(cin, name);
-                    railway.addStation(id, name);
+                    if (journal) {
+                        journal->addStation(move(id), move(name));
+                        journal->commit();
+                    } else {
+                        railway.addStation(move(id), move(name));
+                    }
                     cout << "Station added successfully!\n";
                     break;
                 }
@@ -75,7 +259,12 @@ int main() {
                         throw RailwayException("Station not found");
                     }
                     auto platformNumbers = getNumberList("Enter platform numbers (space-separated): ");
-                    station->addPlatforms(platformNumbers);
+                    if (journal) {
+                        journal->addPlatforms(*station, platformNumbers);
+                        journal->commit();
+                    } else {
+                        station->addPlatforms(platformNumbers);
+                    }
                     cout << "Platforms added successfully!\n";
                     break;
                 }
@@ -91,7 +280,12 @@ int main() {
                         throw RailwayException("Platform not found");
                     }
                     auto lineNumbers = getNumberList("Enter line numbers (space-separated): ");
-                    platform->addLines(lineNumbers);
+                    if (journal) {
+                        journal->addLines(*station, *platform, lineNumbers);
+                        journal->commit();
+                    } else {
+                        platform->addLines(lineNumbers);
+                    }
                     cout << "Lines added successfully!\n";
                     break;
                 }
@@ -113,15 +307,28 @@ int main() {
                     
                     bool isStoppingTrain = (trainType == "S" || trainType == "s");
                     
-                    station->addTrainSchedule(platformNumber, lineNumber, Time(hours, minutes), isStoppingTrain);
+                    if (journal) {
+                        journal->addTrainSchedule(*station, platformNumber, lineNumber, Time(hours, minutes), isStoppingTrain);
+                        journal->commit();
+                    } else {
+                        station->addTrainSchedule(platformNumber, lineNumber, Time(hours, minutes), isStoppingTrain);
+                    }
                     cout << "Train schedule added successfully!\n";
                     break;
                 }
                 case 5: {
-                    railway.displayAllStations();
+                    view.display(railway);
                     break;
                 }
                 case 6: {
+                    view.displayChanges(railway);
+                    break;
+                }
+                case 7: {
+                    writeMetrics(cout, MetricsFormat::Text);
+                    break;
+                }
+                case 8: {
                     cout << "Thank you for using Railway Management System!\n";
                     return 0;
                 }
@@ -139,6 +346,136 @@ int main() {
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
         }
     }
-    
-    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    RailwaySystem<string> railway;
+    vector<string> imports;
+    string snapshotPath;
+    string journalPath;
+    string reportFormat;
+    string metricsFormat;
+    string reportOutput;
+    ReportFilter<string> reportFilter;
+    bool interactive = false;
+    bool script = false;
+    bool deferChecks = false;
+    string generateShape;
+    string workloadOutput;
+    int conflictPercent = 0;
+    uint32_t seed = 1;
+    size_t differentialInserts = 0;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--import" && hasValue) {
+                imports.push_back(argv[++i]);
+            } else if (arg == "--snapshot" && hasValue) {
+                snapshotPath = argv[++i];
+            } else if (arg == "--journal" && hasValue) {
+                journalPath = argv[++i];
+            } else if (arg == "--report" && hasValue) {
+                reportFormat = argv[++i];
+            } else if (arg == "--output" && hasValue) {
+                reportOutput = argv[++i];
+            } else if (arg == "--station" && hasValue) {
+                reportFilter.station = argv[++i];
+            } else if (arg == "--platform" && hasValue) {
+                reportFilter.platform = parseNumber(argv[++i], "platform number");
+            } else if (arg == "--from" && hasValue) {
+                reportFilter.from = parseTime(argv[++i]);
+            } else if (arg == "--to" && hasValue) {
+                reportFilter.to = parseTime(argv[++i]);
+            } else if (arg == "--defer-checks") {
+                deferChecks = true;
+            } else if (arg == "--script") {
+                script = true;
+            } else if (arg == "--metrics" && hasValue) {
+                metricsFormat = argv[++i];
+            } else if (arg == "--interactive") {
+                interactive = true;
+            } else if (arg == "--generate" && hasValue) {
+                generateShape = argv[++i];
+            } else if (arg == "--write-workload" && hasValue) {
+                workloadOutput = argv[++i];
+            } else if (arg == "--conflicts" && hasValue) {
+                conflictPercent = parseNumber(argv[++i], "conflict percent");
+            } else if (arg == "--seed" && hasValue) {
+                seed = static_cast<uint32_t>(parseNumber(argv[++i], "seed"));
+            } else if (arg == "--differential" && hasValue) {
+                differentialInserts = static_cast<size_t>(parseNumber(argv[++i], "insert count"));
+            } else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+
+        optional<MetricsFormat> metrics;
+        if (!metricsFormat.empty()) {
+            metrics = parseMetricsFormat(metricsFormat);
+        }
+        if (differentialInserts > 0) {
+            return runDifferentialCheck(differentialInserts, seed);
+        }
+
+        uint32_t generation = 0;
+        if (!snapshotPath.empty() && fileExists(snapshotPath)) {
+            generation = runLoadSnapshot(railway, snapshotPath);
+        }
+        unique_ptr<RailwayJournal<string>> journal;
+        if (!journalPath.empty()) {
+            journal = make_unique<RailwayJournal<string>>(railway, journalPath, generation);
+            reportReplay(journal->getReplay(), journalPath);
+        }
+        for (const auto& path : imports) {
+            runImport(railway, path, journal.get(), deferChecks);
+        }
+        if (!generateShape.empty()) {
+            WorkloadShape shape = parseWorkloadShape(generateShape);
+            shape.conflictPercent = conflictPercent;
+            shape.seed = seed;
+            runGenerate(railway, shape, workloadOutput, journal.get(), deferChecks);
+        }
+
+        if (!reportFormat.empty()) {
+            runReport(railway, parseReportFormat(reportFormat), reportFilter, reportOutput);
+        }
+
+        if (script) {
+            runScript(railway, journal.get());
+        }
+
+        int status = 0;
+        if ((imports.empty() && generateShape.empty() && reportFormat.empty() && !script) || interactive) {
+            status = runInteractive(railway, journal.get());
+        }
+        // Checkpoint: the new snapshot carries the next generation, which
+        // makes the old journal stale even if the reset below never happens.
+        if (!snapshotPath.empty()) {
+            // Snapshot loads trust every train, so a network that still
+            // holds conflicts from a deferred import is not saved
+            if (deferChecks) {
+                size_t conflicts = auditConflicts(railway).conflicts.size();
+                if (conflicts > 0) {
+                    throw RailwayException("Not saving snapshot '" + snapshotPath + "': " +
+                                           to_string(conflicts) + " conflicting pairs remain");
+                }
+            }
+            uint32_t next = journal ? generation + 1 : generation;
+            saveSnapshot(railway, snapshotPath, next);
+            if (journal) {
+                journal->reset(next);
+            }
+        }
+        if (metrics) {
+            writeMetrics(clog, *metrics);
+        }
+        return status;
+    }
+    catch (const RailwayException& e) {
+        cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
 }
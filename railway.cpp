@@ -1,21 +1,359 @@
-void Line::addTrain(const Time& time, bool isStoppingTrain) {
-    if (!canAddTrain(time, isStoppingTrain)) {
-        throw TimeConflictException("Time slot conflicts with existing schedule");
+template<typename Policy>
+void BasicLine<Policy>::blockAround(MinuteMask& mask, const TrainSchedule& schedule, TrainClass newClass,
+                                    DayMask newDays) const {
+    requireClass(newClass);
+    requireClass(schedule.trainClass);
+    blockWindow(mask, schedule, newClass, newDays);
+}
+
+template<typename Policy>
+void BasicLine<Policy>::blockWindow(MinuteMask& mask, const TrainSchedule& schedule, TrainClass newClass,
+                                    DayMask newDays) const {
+    int minute = schedule.time.toMinutes();
+    int reach = policy.headway(newClass, schedule.trainClass) - 1;
+    if (newDays.overlaps(schedule.days)) {
+        mask.setRange(minute - reach, minute + reach);
+    }
+    // The part of the window past midnight lands on the next day ...
+    if (minute + reach >= Time::MINUTES_PER_DAY && newDays.overlaps(schedule.days.following())) {
+        mask.setRange(0, minute + reach - Time::MINUTES_PER_DAY);
     }
-    schedules.emplace_back(time, isStoppingTrain);
+    // ... and the part before midnight on the previous day
+    if (minute - reach < 0 && newDays.following().overlaps(schedule.days)) {
+        mask.setRange(minute - reach + Time::MINUTES_PER_DAY, Time::MINUTES_PER_DAY - 1);
+    }
+}
+
+template<typename Policy>
+void BasicLine<Policy>::blockAround(const TrainSchedule& schedule) {
+    for (size_t newClass = 0; newClass < policy.classCount(); ++newClass) {
+        blockWindow(blocked[newClass], schedule, static_cast<TrainClass>(newClass), DayMask::daily());
+    }
+}
+
+template<typename Policy>
+void BasicLine<Policy>::unblockAround(const TrainSchedule& schedule) {
+    int minute = schedule.time.toMinutes();
+    int reach = policy.widest() - 1;
+    for (size_t newClass = 0; newClass < policy.classCount(); ++newClass) {
+        MinuteMask& mask = blocked[newClass];
+        mask.clearRange(minute - reach, minute + reach);
+        if (minute - reach < 0) mask.clearRange(minute - reach + Time::MINUTES_PER_DAY, Time::MINUTES_PER_DAY - 1);
+        if (minute + reach >= Time::MINUTES_PER_DAY) mask.clearRange(0, minute + reach - Time::MINUTES_PER_DAY);
+    }
+    // Any train within two reaches (around the clock) may have blocked
+    // part of the cleared window
+    auto reblock = [&](int first, int last) {
+        auto it = lower_bound(timeline.begin(), timeline.end(), first,
+            [](const TrainSchedule& entry, int value) { return entry.time.toMinutes() < value; });
+        for (; it != timeline.end() && it->time.toMinutes() <= last; ++it) {
+            blockAround(*it);
+        }
+    };
+    reblock(minute - 2 * reach, minute + 2 * reach);
+    if (minute - 2 * reach < 0) reblock(minute - 2 * reach + Time::MINUTES_PER_DAY, Time::MINUTES_PER_DAY - 1);
+    if (minute + 2 * reach >= Time::MINUTES_PER_DAY) reblock(0, minute + 2 * reach - Time::MINUTES_PER_DAY);
+}
+
+template<typename Policy>
+const TrainSchedule* BasicLine<Policy>::findConflict(const Time& newTime, TrainClass trainClass, DayMask days,
+                                                     const TrainSchedule* ignore) const {
+    RAILWAY_COUNT(ConflictChecks, 1);
+    int minute = newTime.toMinutes();
+    // Timeline entries with a minute in [first, last] that fail the test
+    auto scan = [&](int first, int last, auto conflicts) -> const TrainSchedule* {
+        auto it = lower_bound(timeline.begin(), timeline.end(), first,
+            [](const TrainSchedule& schedule, int value) {
+                return schedule.time.toMinutes() < value;
+            });
+        for (; it != timeline.end() && it->time.toMinutes() <= last; ++it) {
+            if (&*it != ignore && conflicts(*it)) {
+                RAILWAY_COUNT(ConflictRejections, 1);
+                return &*it;
+            }
+        }
+        return nullptr;
+    };
+    auto tooClose = [&](const TrainSchedule& schedule, int distance) {
+        return distance < policy.headway(trainClass, schedule.trainClass);
+    };
+
+    const int reach = policy.widest() - 1;
+    const TrainSchedule* hit = scan(minute - reach, minute + reach, [&](const TrainSchedule& schedule) {
+        return days.overlaps(schedule.days) && tooClose(schedule, schedule.time.getDifference(newTime));
+    });
+    if (!hit && minute - reach < 0) {
+        // Late trains of the previous day
+        hit = scan(minute - reach + Time::MINUTES_PER_DAY, Time::MINUTES_PER_DAY - 1,
+            [&](const TrainSchedule& schedule) {
+                return days.overlaps(schedule.days.following()) &&
+                       tooClose(schedule, minute + Time::MINUTES_PER_DAY - schedule.time.toMinutes());
+            });
+    }
+    if (!hit && minute + reach >= Time::MINUTES_PER_DAY) {
+        // Early trains of the next day
+        hit = scan(0, minute + reach - Time::MINUTES_PER_DAY, [&](const TrainSchedule& schedule) {
+            return days.following().overlaps(schedule.days) &&
+                   tooClose(schedule, schedule.time.toMinutes() + Time::MINUTES_PER_DAY - minute);
+        });
+    }
+    return hit;
+}
+
+template<typename Policy>
+AddResult BasicLine<Policy>::tryAddTrain(const Time& time, TrainClass trainClass, DayMask days) {
+    if (!knownClass(trainClass)) {
+        return AddResult(AddStatus::InvalidTrainClass);
+    }
+    if (const TrainSchedule* conflict = findConflict(time, trainClass, days, nullptr)) {
+        return AddResult(AddStatus::Conflict, *conflict);
+    }
+    AddResult result(AddStatus::Added);
+    result.handle.lineNumber = lineNumber;
+    result.handle.train = nextTrainId;
+    appendTrusted(TrainSchedule(time, trainClass, days));
+    return result;
+}
+
+template<typename Policy>
+void BasicLine<Policy>::insert(const TrainSchedule& schedule, TrainId train) {
+    auto order = lower_bound(scheduleIds.begin(), scheduleIds.end(), train);
+    schedules.insert(schedules.begin() + (order - scheduleIds.begin()), schedule);
+    scheduleIds.insert(order, train);
+    auto pos = upper_bound(timeline.begin(), timeline.end(), schedule.time,
+        [](const Time& value, const TrainSchedule& entry) { return value < entry.time; });
+    timelineIds.insert(timelineIds.begin() + (pos - timeline.begin()), train);
+    timeline.insert(pos, schedule);
+    blockAround(schedule);
 }
 
-void Platform::addLine(int lineNumber) {
+template<typename Policy>
+void BasicLine<Policy>::erase(size_t inOrder, size_t inTimeline) {
+    TrainSchedule removed = timeline[inTimeline];
+    schedules.erase(schedules.begin() + inOrder);
+    scheduleIds.erase(scheduleIds.begin() + inOrder);
+    timeline.erase(timeline.begin() + inTimeline);
+    timelineIds.erase(timelineIds.begin() + inTimeline);
+    unblockAround(removed);
+}
+
+template<typename Policy>
+void BasicLine<Policy>::appendTrusted(const TrainSchedule& schedule) {
+    insert(schedule, nextTrainId++);
+    markChanged();
+}
+
+template<typename Policy>
+void BasicLine<Policy>::addTrain(const Time& time, TrainClass trainClass, DayMask days) {
+    AddResult result = tryAddTrain(time, trainClass, days);
+    if (!result) {
+        throwAddFailure(result);
+    }
+}
+
+template<typename Policy>
+void BasicLine<Policy>::restoreSchedules(vector<TrainSchedule> trusted) {
+    schedules = move(trusted);
+    scheduleIds.resize(schedules.size());
+    for (auto& train : scheduleIds) {
+        train = nextTrainId++;
+    }
+    vector<size_t> order(schedules.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) { return schedules[a].time < schedules[b].time; });
+    timeline.clear();
+    timelineIds.clear();
+    for (size_t i : order) {
+        timeline.push_back(schedules[i]);
+        timelineIds.push_back(scheduleIds[i]);
+    }
+    for (auto& mask : blocked) {
+        mask = MinuteMask();
+    }
+    for (const auto& schedule : schedules) {
+        blockAround(schedule);
+    }
+    markChanged();
+}
+
+template<typename Policy>
+void BasicLine<Policy>::appendUnchecked(const vector<TrainSchedule>& batch) {
+    for (const auto& schedule : batch) {
+        requireClass(schedule.trainClass);
+    }
+    vector<size_t> order(batch.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) { return batch[a].time < batch[b].time; });
+    // New trains go after existing ones at the same minute, as insert() does
+    vector<TrainSchedule> merged;
+    vector<TrainId> mergedIds;
+    merged.reserve(timeline.size() + batch.size());
+    mergedIds.reserve(timeline.size() + batch.size());
+    size_t existing = 0;
+    for (size_t i : order) {
+        while (existing < timeline.size() && !(batch[i].time < timeline[existing].time)) {
+            merged.push_back(timeline[existing]);
+            mergedIds.push_back(timelineIds[existing++]);
+        }
+        merged.push_back(batch[i]);
+        mergedIds.push_back(nextTrainId + static_cast<TrainId>(i));
+    }
+    merged.insert(merged.end(), timeline.begin() + existing, timeline.end());
+    mergedIds.insert(mergedIds.end(), timelineIds.begin() + existing, timelineIds.end());
+    timeline.swap(merged);
+    timelineIds.swap(mergedIds);
+    for (const auto& schedule : batch) {
+        schedules.push_back(schedule);
+        scheduleIds.push_back(nextTrainId++);
+        blockAround(schedule);
+    }
+    markChanged();
+}
+
+template<typename Policy>
+void BasicLine<Policy>::findConflictPairs(vector<TrainConflict>& out) const {
+    const size_t count = timeline.size();
+    const int window = policy.widest();
+    auto check = [&](size_t first, size_t second, int distance, DayMask firstDays) {
+        const TrainSchedule& a = timeline[first];
+        const TrainSchedule& b = timeline[second];
+        if (firstDays.overlaps(b.days) && distance < policy.headway(a.trainClass, b.trainClass)) {
+            out.push_back({{0, lineNumber, timelineIds[first]}, {0, lineNumber, timelineIds[second]}, a, b});
+        }
+    };
+    for (size_t first = 0; first < count; ++first) {
+        int minute = timeline[first].time.toMinutes();
+        size_t second = first + 1;
+        for (; second < count; ++second) {
+            int distance = timeline[second].time.toMinutes() - minute;
+            if (distance >= window) break;
+            check(first, second, distance, timeline[first].days);
+        }
+        // Headways are under half a day, so no pair is both close on the
+        // same day and across midnight
+        if (second < count || minute + window <= Time::MINUTES_PER_DAY) continue;
+        DayMask nextDay = timeline[first].days.following();
+        for (second = 0; second < first; ++second) {
+            int distance = timeline[second].time.toMinutes() + Time::MINUTES_PER_DAY - minute;
+            if (distance >= window) break;
+            check(first, second, distance, nextDay);
+        }
+    }
+}
+
+template<typename Policy>
+bool BasicLine<Policy>::locate(TrainId train, size_t& inOrder, size_t& inTimeline) const {
+    auto order = lower_bound(scheduleIds.begin(), scheduleIds.end(), train);
+    if (order == scheduleIds.end() || *order != train) return false;
+    inOrder = static_cast<size_t>(order - scheduleIds.begin());
+    // Trains sharing a minute (on different days) sit side by side
+    const Time& time = schedules[inOrder].time;
+    auto pos = lower_bound(timeline.begin(), timeline.end(), time,
+        [](const TrainSchedule& entry, const Time& value) { return entry.time < value; });
+    inTimeline = static_cast<size_t>(pos - timeline.begin());
+    while (timelineIds[inTimeline] != train) ++inTimeline;
+    return true;
+}
+
+template<typename Policy>
+const TrainSchedule* BasicLine<Policy>::findTrain(TrainId train) const {
+    size_t inOrder, inTimeline;
+    return locate(train, inOrder, inTimeline) ? &schedules[inOrder] : nullptr;
+}
+
+template<typename Policy>
+TrainId BasicLine<Policy>::findTrain(const TrainSchedule& schedule) const {
+    auto pos = lower_bound(timeline.begin(), timeline.end(), schedule.time,
+        [](const TrainSchedule& entry, const Time& value) { return entry.time < value; });
+    for (; pos != timeline.end() && pos->time == schedule.time; ++pos) {
+        if (*pos == schedule) return timelineIds[pos - timeline.begin()];
+    }
+    return NO_TRAIN;
+}
+
+template<typename Policy>
+bool BasicLine<Policy>::removeTrain(TrainId train) {
+    size_t inOrder, inTimeline;
+    if (!locate(train, inOrder, inTimeline)) return false;
+    erase(inOrder, inTimeline);
+    markChanged();
+    return true;
+}
+
+template<typename Policy>
+AddResult BasicLine<Policy>::rescheduleTrain(TrainId train, const Time& time, TrainClass trainClass, DayMask days) {
+    size_t inOrder, inTimeline;
+    if (!locate(train, inOrder, inTimeline)) {
+        return AddResult(AddStatus::TrainNotFound);
+    }
+    if (!knownClass(trainClass)) {
+        return AddResult(AddStatus::InvalidTrainClass);
+    }
+    if (const TrainSchedule* conflict = findConflict(time, trainClass, days, &timeline[inTimeline])) {
+        return AddResult(AddStatus::Conflict, *conflict);
+    }
+    // Copied first: time may refer to the train's own stored schedule,
+    // which erase shifts away
+    TrainSchedule moved(time, trainClass, days);
+    erase(inOrder, inTimeline);
+    insert(moved, train);
+    markChanged();
+    AddResult result(AddStatus::Added);
+    result.handle.lineNumber = lineNumber;
+    result.handle.train = train;
+    return result;
+}
+
+template<typename Policy>
+MinuteMask BasicLine<Policy>::getBlockedMask(TrainClass trainClass, DayMask days) const {
+    requireClass(trainClass);
+    if (days.isDaily()) {
+        return blocked[trainClass];
+    }
+    MinuteMask mask;
+    for (const auto& schedule : timeline) {
+        blockWindow(mask, schedule, trainClass, days);
+    }
+    return mask;
+}
+
+template<typename Policy>
+optional<Time> BasicLine<Policy>::nextFreeSlot(const Time& from, TrainClass trainClass, DayMask days) const {
+    requireClass(trainClass);
+    if (days.isDaily()) {
+        return firstClearMinute(blocked[trainClass], from);
+    }
+    return firstClearMinute(getBlockedMask(trainClass, days), from);
+}
+
+template<typename Policy>
+vector<TimeWindow> BasicLine<Policy>::freeWindows(TrainClass trainClass, DayMask days) const {
+    requireClass(trainClass);
+    if (days.isDaily()) {
+        return blocked[trainClass].clearRuns();
+    }
+    return getBlockedMask(trainClass, days).clearRuns();
+}
+
+template<typename Policy>
+BasicLine<Policy>* BasicPlatform<Policy>::addLine(int lineNumber, Policy headways) {
     if (lineNumber <= 0) {
         throw RailwayException("Line number must be positive");
     }
     if (findLine(lineNumber)) {
         throw RailwayException("Line already exists on this platform");
     }
-    lines.push_back(std::make_unique<Line>(lineNumber));
+    lines.push_back(std::make_unique<Line>(lineNumber, move(headways)));
+    lineIndex.insert(lineNumber, lines.back().get());
+    adopt(*lines.back());
+    markChanged();
+    return lines.back().get();
 }
 
-void Platform::addLines(const std::vector<int>& lineNumbers) {
+template<typename Policy>
+void BasicPlatform<Policy>::addLines(const std::vector<int>& lineNumbers) {
     if (lineNumbers.empty()) {
         throw RailwayException("No line numbers provided");
     }
@@ -24,8 +362,122 @@ void Platform::addLines(const std::vector<int>& lineNumbers) {
     }
 }
 
-Line* Platform::findLine(int lineNumber) {
-    auto it = std::find_if(lines.begin(), lines.end(),
-        [lineNumber](const auto& line) { return line->getLineNumber() == lineNumber; });
-    return it != lines.end() ? it->get() : nullptr;
+template<typename Policy>
+BasicLine<Policy>* BasicPlatform<Policy>::findLine(int lineNumber) {
+    RAILWAY_COUNT(LineLookups, 1);
+    RAILWAY_COUNT(LineProbes, lineIndex.probeLength(lineNumber));
+    return lineIndex.find(lineNumber);
+}
+
+template<typename Policy>
+const BasicLine<Policy>* BasicPlatform<Policy>::findLine(int lineNumber) const {
+    RAILWAY_COUNT(LineLookups, 1);
+    RAILWAY_COUNT(LineProbes, lineIndex.probeLength(lineNumber));
+    return lineIndex.find(lineNumber);
+}
+
+template<typename T, typename Policy>
+TrainPlan RailwayStation<T, Policy>::planTrains(const vector<TrainRequest>& requests) const {
+    struct Candidate {
+        const Platform* platform;
+        const BasicLine<Policy>* line;
+        array<MinuteMask, Policy::CLASSES> blocked;
+    };
+    vector<Candidate> candidates;
+    for (const auto& platform : platforms) {
+        for (const auto& line : platform->getLines()) {
+            Candidate candidate{platform.get(), line.get(), {}};
+            for (size_t c = 0; c < line->getPolicy().classCount(); ++c) {
+                candidate.blocked[c] = line->getBlockedMask(static_cast<TrainClass>(c));
+            }
+            candidates.push_back(candidate);
+        }
+    }
+
+    // The day is a circle, so the sweep starts at the minute crossed by the
+    // fewest request windows: when one is crossed by none, no pair of
+    // requests can clash across it and the circular problem is a linear one
+    const int day = Time::MINUTES_PER_DAY;
+    int widest = 0;
+    for (const auto& candidate : candidates) {
+        widest = max(widest, candidate.line->getPolicy().widest());
+    }
+    vector<int> crossing(day + 1, 0);
+    for (const auto& request : requests) {
+        if (widest < 2) break;
+        int first = (request.time.toMinutes() + 1) % day;
+        int last = first + widest - 2;
+        ++crossing[first];
+        if (last < day) {
+            --crossing[last + 1];
+        } else {
+            --crossing[day];
+            ++crossing[0];
+            --crossing[last - day + 1];
+        }
+    }
+    int cut = 0;
+    for (int minute = 0, running = 0, fewest = 0; minute < day; ++minute) {
+        running += crossing[minute];
+        if (minute == 0 || running < fewest) {
+            fewest = running;
+            cut = minute;
+        }
+    }
+
+    auto sweepMinute = [&](const TrainRequest& request) {
+        return (request.time.toMinutes() - cut + day) % day;
+    };
+    vector<size_t> order(requests.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) { return sweepMinute(requests[a]) < sweepMinute(requests[b]); });
+
+    TrainPlan plan;
+    plan.assigned.reserve(requests.size());
+    for (size_t index : order) {
+        const TrainRequest& request = requests[index];
+        int minute = request.time.toMinutes();
+        Candidate* best = nullptr;
+        int bestIdle = 0;
+        for (auto& candidate : candidates) {
+            if (request.trainClass >= candidate.line->getPolicy().classCount()) continue;
+            const MinuteMask& mask = candidate.blocked[request.trainClass];
+            if (mask.test(minute)) continue;
+            // Idle time back to the line's last blocked minute, wrapping
+            // past midnight; a line with nothing blocked comes last
+            int previous = mask.previousSet(minute);
+            int idle = minute - previous;
+            if (previous < 0) {
+                previous = mask.previousSet(day - 1);
+                idle = previous < 0 ? 2 * day : minute + day - previous;
+            }
+            if (!best || idle < bestIdle) {
+                best = &candidate;
+                bestIdle = idle;
+            }
+        }
+        if (!best) {
+            plan.unplaced.push_back(index);
+            continue;
+        }
+        TrainSchedule schedule(request.time, request.trainClass);
+        for (size_t c = 0; c < best->line->getPolicy().classCount(); ++c) {
+            best->line->blockAround(best->blocked[c], schedule, static_cast<TrainClass>(c), DayMask::daily());
+        }
+        plan.assigned.push_back({index, best->platform->getPlatformNumber(), best->line->getLineNumber()});
+    }
+    return plan;
+}
+
+template<typename T, typename Policy>
+TrainPlan RailwayStation<T, Policy>::assignTrains(const vector<TrainRequest>& requests) {
+    TrainPlan plan = planTrains(requests);
+    // The plan was checked against the live masks, so no second check
+    for (const auto& assignment : plan.assigned) {
+        const TrainRequest& request = requests[assignment.request];
+        findPlatform(assignment.platformNumber)->findLine(assignment.lineNumber)
+            ->appendTrusted(TrainSchedule(request.time, request.trainClass));
+    }
+    return plan;
 }
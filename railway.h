@@ -8,6 +8,15 @@
 #include <stdexcept>
 #include <iomanip>
 #include <sstream>
+#include <unordered_map>
+#include <map>
+#include <type_traits>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <atomic>
+#include "railway_metrics.h"
 using namespace std;
 
 
@@ -22,122 +31,896 @@ public:
     explicit TimeConflictException(const string& message) : RailwayException(message) {}
 };
 
-// Time utility class
+// Time utility class, stored as a 2-byte minute of day
 class Time {
 private:
-    int hours;
-    int minutes;
+    uint16_t minuteOfDay;
 
-public:
-    Time(int h = 0, int m = 0) : hours(h), minutes(m) {
+    static constexpr uint16_t validate(int h, int m) {
         if (h < 0 || h > 23 || m < 0 || m > 59) {
             throw RailwayException("Invalid time format");
         }
+        return static_cast<uint16_t>(h * 60 + m);
+    }
+
+public:
+    static constexpr int MINUTES_PER_DAY = 24 * 60;
+    static constexpr size_t FORMATTED_SIZE = 5;  // "HH:MM"
+
+    constexpr Time(int h = 0, int m = 0) : minuteOfDay(validate(h, m)) {}
+
+    static constexpr Time fromMinutes(int minutes) {
+        if (minutes < 0 || minutes >= MINUTES_PER_DAY) {
+            throw RailwayException("Invalid time format");
+        }
+        return Time(minutes / 60, minutes % 60);
     }
 
-    bool operator<(const Time& other) const {
-        return (hours * 60 + minutes) < (other.hours * 60 + other.minutes);
+    constexpr bool operator<(const Time& other) const { return minuteOfDay < other.minuteOfDay; }
+    constexpr bool operator==(const Time& other) const { return minuteOfDay == other.minuteOfDay; }
+    constexpr bool operator!=(const Time& other) const { return minuteOfDay != other.minuteOfDay; }
+
+    // Minutes between two times of the same day
+    constexpr int getDifference(const Time& other) const {
+        return minuteOfDay > other.minuteOfDay ? minuteOfDay - other.minuteOfDay
+                                               : other.minuteOfDay - minuteOfDay;
     }
 
-    bool operator==(const Time& other) const {
-        return hours == other.hours && minutes == other.minutes;
+    // Minutes between the nearest occurrences of two daily times, going
+    // round midnight when that is shorter (23:50 and 00:05 are 15 apart)
+    constexpr int getCircularDifference(const Time& other) const {
+        int difference = getDifference(other);
+        return difference <= MINUTES_PER_DAY / 2 ? difference : MINUTES_PER_DAY - difference;
     }
 
-    int getDifference(const Time& other) const {
-        return abs((hours * 60 + minutes) - (other.hours * 60 + other.minutes));
+    constexpr int toMinutes() const { return minuteOfDay; }
+    constexpr int getHours() const { return minuteOfDay / 60; }
+    constexpr int getMinutes() const { return minuteOfDay % 60; }
+
+    // Writes "HH:MM" (no terminator) into out and returns the end pointer
+    char* format(char* out) const {
+        int h = getHours(), m = getMinutes();
+        out[0] = static_cast<char>('0' + h / 10);
+        out[1] = static_cast<char>('0' + h % 10);
+        out[2] = ':';
+        out[3] = static_cast<char>('0' + m / 10);
+        out[4] = static_cast<char>('0' + m % 10);
+        return out + FORMATTED_SIZE;
     }
 
     string toString() const {
-        stringstream ss;
-        ss << setfill('0') << setw(2) << hours << ":" 
-           << setfill('0') << setw(2) << minutes;
-        return ss.str();
+        char buffer[FORMATTED_SIZE];
+        return string(buffer, format(buffer));
     }
 };
 
+// Days of the week a train runs on, one bit per day from Monday (bit 0)
+// to Sunday (bit 6). A recurring train is stored once with its mask
+// rather than once per day.
+class DayMask {
+private:
+    uint8_t bits;
+
+public:
+    static constexpr int DAYS = 7;
+    static constexpr uint8_t ALL = 0x7F;
+    static constexpr size_t FORMATTED_SIZE = DAYS;  // "MTWTF--"
+
+    constexpr explicit DayMask(uint8_t dayBits = ALL) : bits(dayBits) {
+        if (dayBits == 0 || dayBits > ALL) {
+            throw RailwayException("Invalid day mask");
+        }
+    }
+
+    static constexpr DayMask daily() { return DayMask(ALL); }
+    static constexpr DayMask weekdays() { return DayMask(0x1F); }
+    static constexpr DayMask weekends() { return DayMask(0x60); }
+
+    // A single day, 0 = Monday ... 6 = Sunday
+    static constexpr DayMask only(int day) {
+        if (day < 0 || day >= DAYS) {
+            throw RailwayException("Invalid day of week");
+        }
+        return DayMask(static_cast<uint8_t>(1 << day));
+    }
+
+    // The days that follow each service day (Sunday wraps to Monday)
+    constexpr DayMask following() const {
+        return DayMask(static_cast<uint8_t>(((bits << 1) | (bits >> (DAYS - 1))) & ALL));
+    }
+
+    constexpr bool overlaps(DayMask other) const { return (bits & other.bits) != 0; }
+    constexpr bool runsOn(int day) const { return (bits >> day) & 1; }
+    constexpr bool isDaily() const { return bits == ALL; }
+    constexpr uint8_t getBits() const { return bits; }
+
+    constexpr bool operator==(DayMask other) const { return bits == other.bits; }
+    constexpr bool operator!=(DayMask other) const { return bits != other.bits; }
+
+    // Writes the "MTWTFSS" pattern with '-' for days off (no terminator)
+    char* format(char* out) const {
+        static const char letters[] = "MTWTFSS";
+        for (int day = 0; day < DAYS; ++day) {
+            *out++ = runsOn(day) ? letters[day] : '-';
+        }
+        return out;
+    }
+
+    string toString() const {
+        char buffer[FORMATTED_SIZE];
+        return string(buffer, format(buffer));
+    }
+};
+
+// Train classes index the headway tables. The standard policy knows two,
+// through (0) and stopping (1), so a stopping flag converts directly.
+using TrainClass = uint8_t;
+constexpr TrainClass THROUGH_TRAIN = 0;
+constexpr TrainClass STOPPING_TRAIN = 1;
+
 // Train schedule class
 class TrainSchedule {
 public:
     Time time;
-    bool isStoppingTrain;
+    TrainClass trainClass;
+    DayMask days;
 
-    TrainSchedule(const Time& t, bool stopping) : time(t), isStoppingTrain(stopping) {}
+    TrainSchedule(const Time& t, TrainClass type, DayMask runsOn = DayMask())
+        : time(t), trainClass(type), days(runsOn) {}
+
+    bool isStoppingTrain() const { return trainClass == STOPPING_TRAIN; }
 
     bool operator==(const TrainSchedule& other) const {
-        return time == other.time && isStoppingTrain == other.isStoppingTrain;
+        return time == other.time && trainClass == other.trainClass && days == other.days;
+    }
+};
+
+// Outcome of a non-throwing insert
+enum class AddStatus : uint8_t {
+    Added,
+    Conflict,
+    StationNotFound,
+    PlatformNotFound,
+    LineNotFound,
+    InvalidTrainClass,
+    TrainNotFound
+};
+
+inline const char* describe(AddStatus status) {
+    switch (status) {
+        case AddStatus::Added: return "Train schedule added";
+        case AddStatus::Conflict: return "Time slot conflicts with existing schedule";
+        case AddStatus::StationNotFound: return "Station not found";
+        case AddStatus::PlatformNotFound: return "Platform not found";
+        case AddStatus::LineNotFound: return "Line not found on this platform";
+        case AddStatus::InvalidTrainClass: return "Train class not covered by the line's headway policy";
+        case AddStatus::TrainNotFound: return "Train not found";
+    }
+    return "Unknown status";
+}
+
+// Handle to one train, returned when it is added. Train numbers are
+// unique within a line for the life of the process and survive other
+// trains being removed or moved; they are not kept in snapshots.
+using TrainId = uint32_t;
+constexpr TrainId NO_TRAIN = UINT32_MAX;
+
+struct TrainHandle {
+    int platformNumber = 0;  // filled in by station-level inserts
+    int lineNumber = 0;
+    TrainId train = NO_TRAIN;
+
+    bool operator==(const TrainHandle& other) const {
+        return platformNumber == other.platformNumber && lineNumber == other.lineNumber && train == other.train;
+    }
+};
+
+struct AddResult {
+    AddStatus status;
+    TrainSchedule conflict;  // the existing schedule that was hit, for Conflict
+    TrainHandle handle;      // the added or moved train, for Added
+
+    AddResult(AddStatus s, const TrainSchedule& hit = TrainSchedule(Time(), THROUGH_TRAIN))
+        : status(s), conflict(hit) {}
+
+    explicit operator bool() const { return status == AddStatus::Added; }
+};
+
+// Two trains on one line closer together than the headway rule allows.
+// The first runs earlier: the same day, or the day before the second.
+struct TrainConflict {
+    TrainHandle first;   // platformNumber filled in by network audits
+    TrainHandle second;
+    TrainSchedule firstSchedule;
+    TrainSchedule secondSchedule;
+};
+
+// Throws the exception the throwing API has always used for a failed insert
+[[noreturn]] inline void throwAddFailure(const AddResult& result) {
+    if (result.status == AddStatus::Conflict) {
+        throw TimeConflictException(describe(result.status));
+    }
+    throw RailwayException(describe(result.status));
+}
+
+// Key detection for IdIndex
+template<typename K, typename = void>
+struct IsHashable : false_type {};
+
+template<typename K>
+struct IsHashable<K, void_t<decltype(hash<K>{}(declval<const K&>()))>> : true_type {};
+
+template<typename K, typename = void>
+struct IsOrdered : false_type {};
+
+template<typename K>
+struct IsOrdered<K, void_t<decltype(declval<const K&>() < declval<const K&>())>> : true_type {};
+
+// Lookup index kept alongside the ordered entity vectors. Hashable keys use
+// an unordered_map, ordered keys a map, and keys that only support ==
+// fall back to a linear scan so any station ID type still works.
+template<typename K, typename V, typename = void>
+class IdIndex {
+private:
+    vector<pair<K, V*>> entries;
+
+public:
+    V* find(const K& key) const {
+        for (const auto& entry : entries) {
+            if (entry.first == key) return entry.second;
+        }
+        return nullptr;
+    }
+
+    void insert(const K& key, V* value) { entries.emplace_back(key, value); }
+    size_t size() const { return entries.size(); }
+
+    // Entries compared by find(key)
+    size_t probeLength(const K& key) const {
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].first == key) return i + 1;
+        }
+        return entries.size();
+    }
+};
+
+// String keys are indexed by views of the ID each entity already owns, so
+// the index holds no second copy and lookups take a string_view without
+// building a string. The viewed ID must live as long as its entry.
+template<typename K>
+struct IndexKey {
+    using Stored = K;
+    using Lookup = const K&;
+};
+
+template<>
+struct IndexKey<string> {
+    using Stored = string_view;
+    using Lookup = string_view;
+};
+
+template<typename K>
+using LookupKey = typename conditional<IsHashable<K>::value, typename IndexKey<K>::Lookup, const K&>::type;
+
+template<typename K, typename V>
+class IdIndex<K, V, enable_if_t<IsHashable<K>::value>> {
+private:
+    using Stored = typename IndexKey<K>::Stored;
+
+    unordered_map<Stored, V*> entries;
+
+public:
+    V* find(LookupKey<K> key) const {
+        auto it = entries.find(Stored(key));
+        return it != entries.end() ? it->second : nullptr;
+    }
+
+    void insert(const K& key, V* value) { entries.emplace(Stored(key), value); }
+    size_t size() const { return entries.size(); }
+
+    // Entries in the bucket find(key) walks
+    size_t probeLength(LookupKey<K> key) const {
+        return entries.empty() ? 0 : entries.bucket_size(entries.bucket(Stored(key)));
     }
 };
 
+template<typename K, typename V>
+class IdIndex<K, V, enable_if_t<!IsHashable<K>::value && IsOrdered<K>::value>> {
+private:
+    map<K, V*> entries;
+
+public:
+    V* find(const K& key) const {
+        auto it = entries.find(key);
+        return it != entries.end() ? it->second : nullptr;
+    }
+
+    void insert(const K& key, V* value) { entries.emplace(key, value); }
+    size_t size() const { return entries.size(); }
+
+    // Depth of a balanced tree of this size, the comparisons find(key) makes
+    size_t probeLength(const K&) const {
+        size_t depth = 0;
+        for (size_t n = entries.size(); n > 0; n >>= 1) ++depth;
+        return depth;
+    }
+};
+
+// Inclusive range of free minutes
+struct TimeWindow {
+    Time first;
+    Time last;
+
+    bool operator==(const TimeWindow& other) const { return first == other.first && last == other.last; }
+};
+
+// One bit per minute of the day. The padding bits past 23:59 stay set so
+// scans for a clear bit never run off the end of the day.
+class MinuteMask {
+public:
+    static constexpr int WORDS = (Time::MINUTES_PER_DAY + 63) / 64;
+
+private:
+    static constexpr uint64_t PADDING = ~uint64_t(0) << (Time::MINUTES_PER_DAY % 64);
+
+    array<uint64_t, WORDS> words{};
+
+    void updateRange(int first, int last, bool set) {
+        first = max(first, 0);
+        last = min(last, Time::MINUTES_PER_DAY - 1);
+        for (int minute = first; minute <= last;) {
+            int word = minute / 64;
+            int bit = minute % 64;
+            int count = min(64 - bit, last - minute + 1);
+            uint64_t bits = count == 64 ? ~uint64_t(0) : ((uint64_t(1) << count) - 1) << bit;
+            words[word] = set ? words[word] | bits : words[word] & ~bits;
+            minute += count;
+        }
+    }
+
+public:
+    MinuteMask() { words[WORDS - 1] = PADDING; }
+
+    static MinuteMask full() {
+        MinuteMask mask;
+        mask.words.fill(~uint64_t(0));
+        return mask;
+    }
+
+    // Sets every minute in [first, last], clamped to the day
+    void setRange(int first, int last) { updateRange(first, last, true); }
+    void clearRange(int first, int last) { updateRange(first, last, false); }
+
+    bool test(int minute) const { return (words[minute / 64] >> (minute % 64)) & 1; }
+
+    MinuteMask& operator&=(const MinuteMask& other) {
+        for (int i = 0; i < WORDS; ++i) words[i] &= other.words[i];
+        return *this;
+    }
+
+    const array<uint64_t, WORDS>& getWords() const { return words; }
+
+    // First clear minute at or after from, or -1
+    int nextClear(int from) const {
+        if (from < 0 || from >= Time::MINUTES_PER_DAY) return -1;
+        int word = from / 64;
+        uint64_t free = ~words[word] & (~uint64_t(0) << (from % 64));
+        while (true) {
+            if (free) return word * 64 + __builtin_ctzll(free);
+            if (++word == WORDS) return -1;
+            free = ~words[word];
+        }
+    }
+
+    // First set minute at or after from (padding counts as set)
+    int nextSet(int from) const {
+        int word = from / 64;
+        uint64_t used = words[word] & (~uint64_t(0) << (from % 64));
+        while (!used) used = words[++word];
+        return word * 64 + __builtin_ctzll(used);
+    }
+
+    // Last set minute at or before from, or -1
+    int previousSet(int from) const {
+        int word = from / 64;
+        uint64_t used = words[word] & (~uint64_t(0) >> (63 - from % 64));
+        while (!used) {
+            if (--word < 0) return -1;
+            used = words[word];
+        }
+        return word * 64 + 63 - __builtin_clzll(used);
+    }
+
+    vector<TimeWindow> clearRuns() const {
+        vector<TimeWindow> runs;
+        for (int start = nextClear(0); start >= 0; start = nextClear(start)) {
+            int end = nextSet(start);
+            runs.push_back({Time::fromMinutes(start), Time::fromMinutes(end - 1)});
+            if (end >= Time::MINUTES_PER_DAY) break;
+            start = end;
+        }
+        return runs;
+    }
+};
+
+// Change tracking for lines, platforms and stations. Every change bumps
+// the revision of the node and of each ancestor, so a cache of rendered
+// output can tell in O(1) whether a whole subtree is unchanged. Revisions
+// start at a per-node base (creation order << 32), so a node created at a
+// reused address never matches a revision cached for an old one.
+class ChangeTracked {
+private:
+    static inline atomic<uint64_t> nodesCreated{0};
+
+    atomic<uint64_t> revision;
+    ChangeTracked* parent = nullptr;
+
+    static uint64_t freshRevision() { return (nodesCreated.fetch_add(1, memory_order_relaxed) + 1) << 32; }
+
+protected:
+    ChangeTracked() : revision(freshRevision()) {}
+    ChangeTracked(const ChangeTracked&) : revision(freshRevision()) {}
+    ChangeTracked& operator=(const ChangeTracked&) {
+        markChanged();
+        return *this;
+    }
+    ~ChangeTracked() = default;
+
+    void adopt(ChangeTracked& child) { child.parent = this; }
+
+    void markChanged() {
+        for (ChangeTracked* node = this; node; node = node->parent) {
+            node->revision.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+public:
+    uint64_t getRevision() const { return revision.load(memory_order_relaxed); }
+};
+
+// Headway policies
+//
+// A policy gives the minimum minutes between two trains of given classes
+// on one line, as headway(first, second), plus the widest such gap and
+// the number of classes. FixedHeadways bakes a constexpr table into the
+// type, so each check is a lookup in a static table and the scan window
+// is a compile-time constant. RuntimeHeadways carries its table in each
+// line instead, for rules read from data files. Tables are symmetric: the
+// gap between two trains does not depend on which one runs first.
+
+template<size_t N>
+using HeadwayTable = array<array<uint8_t, N>, N>;
+
+template<size_t N>
+constexpr int widestHeadway(const HeadwayTable<N>& table) {
+    int widest = 0;
+    for (size_t a = 0; a < N; ++a) {
+        for (size_t b = 0; b < N; ++b) {
+            widest = table[a][b] > widest ? table[a][b] : widest;
+        }
+    }
+    return widest;
+}
+
+template<size_t N>
+constexpr bool validHeadways(const HeadwayTable<N>& table, size_t classes = N) {
+    for (size_t a = 0; a < classes; ++a) {
+        for (size_t b = 0; b < classes; ++b) {
+            if (table[a][b] == 0 || table[a][b] != table[b][a]) return false;
+        }
+    }
+    return true;
+}
+
+template<size_t N, const HeadwayTable<N>& Table>
+struct FixedHeadways {
+    static_assert(N > 0 && N <= 256, "A headway table needs between 1 and 256 train classes");
+    static_assert(validHeadways(Table), "Headway tables must be symmetric with gaps of at least one minute");
+
+    static constexpr size_t CLASSES = N;
+
+    static constexpr int headway(TrainClass first, TrainClass second) { return Table[first][second]; }
+    static constexpr int widest() { return widestHeadway(Table); }
+    static constexpr size_t classCount() { return N; }
+};
+
+constexpr int THROUGH_HEADWAY = 10;
+constexpr int STOPPING_HEADWAY = 30;
+
+inline constexpr HeadwayTable<2> STANDARD_HEADWAY_TABLE = {{
+    {THROUGH_HEADWAY, STOPPING_HEADWAY},
+    {STOPPING_HEADWAY, STOPPING_HEADWAY},
+}};
+
+using StandardHeadways = FixedHeadways<2, STANDARD_HEADWAY_TABLE>;
+
+class RuntimeHeadways {
+public:
+    static constexpr size_t CLASSES = 4;
+
+private:
+    HeadwayTable<CLASSES> table{};
+    uint8_t classes;
+    int widestGap;
+
+public:
+    // The standard through/stopping rules
+    RuntimeHeadways() : classes(2), widestGap(STOPPING_HEADWAY) {
+        for (size_t a = 0; a < 2; ++a) {
+            for (size_t b = 0; b < 2; ++b) table[a][b] = STANDARD_HEADWAY_TABLE[a][b];
+        }
+    }
+
+    // One row of minutes per train class
+    explicit RuntimeHeadways(const vector<vector<int>>& rows) : classes(static_cast<uint8_t>(rows.size())) {
+        if (rows.empty() || rows.size() > CLASSES) {
+            throw RailwayException("Headway tables need between 1 and " + to_string(CLASSES) + " train classes");
+        }
+        for (size_t a = 0; a < rows.size(); ++a) {
+            if (rows[a].size() != rows.size()) {
+                throw RailwayException("Headway table must be square");
+            }
+            for (size_t b = 0; b < rows.size(); ++b) {
+                if (rows[a][b] <= 0 || rows[a][b] > UINT8_MAX) {
+                    throw RailwayException("Headways must be between 1 and 255 minutes");
+                }
+                table[a][b] = static_cast<uint8_t>(rows[a][b]);
+            }
+        }
+        if (!validHeadways(table, classes)) {
+            throw RailwayException("Headway table must be symmetric");
+        }
+        widestGap = widestHeadway(table);
+    }
+
+    int headway(TrainClass first, TrainClass second) const { return table[first][second]; }
+    int widest() const { return widestGap; }
+    size_t classCount() const { return classes; }
+};
+
 // Forward declaration
-class Platform;
+template<typename Policy>
+class BasicPlatform;
 
 // Line class
-class Line {
+template<typename Policy>
+class BasicLine : public ChangeTracked {
 private:
     int lineNumber;
-    vector<TrainSchedule> schedules;
+    Policy policy;
+    vector<TrainSchedule> schedules;  // insertion order
+    vector<TrainId> scheduleIds;      // handle of each schedule, ascending
+    vector<TrainSchedule> timeline;   // same schedules, ordered by time
+    vector<TrainId> timelineIds;
+    TrainId nextTrainId = 0;
+    MinuteMask blocked[Policy::CLASSES];  // minutes where a new daily train of each class conflicts
 
-public:
-    explicit Line(int num) : lineNumber(num) {}
+    void blockAround(const TrainSchedule& schedule);
 
-    bool canAddTrain(const Time& newTime, bool isStoppingTrain) const {
-        for (const auto& schedule : schedules) {
-            int timeDiff = schedule.time.getDifference(newTime);
-            if (isStoppingTrain || schedule.isStoppingTrain) {
-                if (timeDiff < 30) return false;
-            } else {
-                if (timeDiff < 10) return false;
-            }
+    // blockAround for classes already known to be valid
+    void blockWindow(MinuteMask& mask, const TrainSchedule& schedule, TrainClass newClass, DayMask newDays) const;
+
+    // Clears what schedule blocked in the daily masks and re-blocks the
+    // minutes still covered by its neighbours
+    void unblockAround(const TrainSchedule& schedule);
+
+    const TrainSchedule* findConflict(const Time& newTime, TrainClass trainClass, DayMask days,
+                                      const TrainSchedule* ignore) const;
+
+    // Positions of a train in schedules and timeline, or false
+    bool locate(TrainId train, size_t& inOrder, size_t& inTimeline) const;
+
+    void insert(const TrainSchedule& schedule, TrainId train);
+    void erase(size_t inOrder, size_t inTimeline);
+
+    bool knownClass(TrainClass trainClass) const { return trainClass < policy.classCount(); }
+
+    void requireClass(TrainClass trainClass) const {
+        if (!knownClass(trainClass)) {
+            throw RailwayException(describe(AddStatus::InvalidTrainClass));
         }
-        return true;
     }
 
-    void addTrain(const Time& time, bool isStoppingTrain);
+public:
+    explicit BasicLine(int num, Policy headways = Policy()) : lineNumber(num), policy(move(headways)) {}
+
+    // Marks in mask the minutes where a new train of newClass running on
+    // newDays would conflict with schedule, including across midnight.
+    // Throws for a class the policy does not cover.
+    void blockAround(MinuteMask& mask, const TrainSchedule& schedule, TrainClass newClass, DayMask newDays) const;
+
+    // Only schedules inside the widest headway window around newTime can
+    // conflict, so a binary search plus a short forward scan is enough.
+    // Near midnight the window continues at the other end of the day,
+    // where only trains running on the previous or next day count.
+    // Throws for a class the policy does not cover.
+    const TrainSchedule* findConflict(const Time& newTime, TrainClass trainClass,
+                                      DayMask days = DayMask()) const {
+        requireClass(trainClass);
+        return findConflict(newTime, trainClass, days, nullptr);
+    }
+
+    bool canAddTrain(const Time& newTime, TrainClass trainClass, DayMask days = DayMask()) const {
+        return knownClass(trainClass) && findConflict(newTime, trainClass, days, nullptr) == nullptr;
+    }
+
+    // Non-throwing insert; reports the schedule it conflicted with, or the
+    // new train's handle
+    AddResult tryAddTrain(const Time& time, TrainClass trainClass, DayMask days = DayMask());
+
+    void addTrain(const Time& time, TrainClass trainClass, DayMask days = DayMask());
+
+    // Appends a schedule already known to be conflict-free, e.g. one
+    // replayed from the journal. No conflict check is run.
+    void appendTrusted(const TrainSchedule& schedule);
+
+    // Replaces the schedules with a set already known to be conflict-free,
+    // e.g. one read back from a snapshot. No conflict checks are run.
+    void restoreSchedules(vector<TrainSchedule> trusted);
+
+    // Appends a batch with no conflict checks at all, merged into the
+    // timeline in one pass; handles follow batch order. Conflicting pairs
+    // stay until found by findConflictPairs and removed.
+    void appendUnchecked(const vector<TrainSchedule>& batch);
+
+    // Every pair of trains the per-insert check would have kept apart, in
+    // one sweep over the timeline: each train is compared only with the
+    // trains inside the widest headway after it, continuing into the next
+    // day's early trains near midnight. Pairs are appended to out in
+    // timeline order of their first train.
+    void findConflictPairs(vector<TrainConflict>& out) const;
+
+    // Handles are found by binary search; removal shifts the flat arrays,
+    // which is linear in the line's size but bounded by it (a day's worth
+    // of trains per weekday, about 1000 at the 10-minute headway), and
+    // repairs the masks only within the headway window around the train.
+    const TrainSchedule* findTrain(TrainId train) const;
+    TrainId findTrain(const TrainSchedule& schedule) const;
+    bool removeTrain(TrainId train);
+
+    // Moves a train to a new slot, checked against every other train. On
+    // failure the train stays where it was; on success it keeps its handle.
+    AddResult rescheduleTrain(TrainId train, const Time& time, TrainClass trainClass, DayMask days = DayMask());
+
+    // Slot queries answered from the blocked-minute masks. The masks are
+    // kept for daily trains; other day sets get theirs built on demand.
+    const MinuteMask& getBlockedMask(TrainClass trainClass) const {
+        requireClass(trainClass);
+        return blocked[trainClass];
+    }
+    MinuteMask getBlockedMask(TrainClass trainClass, DayMask days) const;
+    optional<Time> nextFreeSlot(const Time& from, TrainClass trainClass, DayMask days = DayMask()) const;
+    vector<TimeWindow> freeWindows(TrainClass trainClass, DayMask days = DayMask()) const;
 
     int getLineNumber() const { return lineNumber; }
+    const Policy& getPolicy() const { return policy; }
     const vector<TrainSchedule>& getSchedules() const { return schedules; }
+    const vector<TrainSchedule>& getTimeline() const { return timeline; }
+    const vector<TrainId>& getTrainIds() const { return scheduleIds; }  // parallel to getSchedules()
 };
 
+using Line = BasicLine<StandardHeadways>;
+
+// Free-slot search over a set of lines: a minute is free when any one of
+// the lines could take the train, so the line masks are ANDed together.
+template<typename Lines, typename GetLine>
+MinuteMask combinedBlockedMask(const Lines& lines, GetLine getLine, TrainClass trainClass,
+                               DayMask days = DayMask()) {
+    MinuteMask mask = MinuteMask::full();
+    for (const auto& entry : lines) {
+        if (days.isDaily()) {
+            mask &= getLine(entry).getBlockedMask(trainClass);
+        } else {
+            mask &= getLine(entry).getBlockedMask(trainClass, days);
+        }
+    }
+    return mask;
+}
+
+inline optional<Time> firstClearMinute(const MinuteMask& mask, const Time& from) {
+    int minute = mask.nextClear(from.toMinutes());
+    return minute >= 0 ? optional<Time>(Time::fromMinutes(minute)) : nullopt;
+}
+
 // Platform class
-class Platform {
+template<typename Policy>
+class BasicPlatform : public ChangeTracked {
+public:
+    using Line = BasicLine<Policy>;
+
 private:
     int platformNumber;
     vector<unique_ptr<Line>> lines;
+    IdIndex<int, Line> lineIndex;
 
 public:
-    explicit Platform(int num) : platformNumber(num) {
+    explicit BasicPlatform(int num) : platformNumber(num) {
         if (num <= 0) {
             throw RailwayException("Platform number must be positive");
         }
     }
 
-    void addLine(int lineNumber);
+    // Lines under a RuntimeHeadways policy take their own table here
+    Line* addLine(int lineNumber, Policy headways = Policy());
 
     void addLines(const vector<int>& lineNumbers);
 
     Line* findLine(int lineNumber);
+    const Line* findLine(int lineNumber) const;
+
+    MinuteMask getBlockedMask(TrainClass trainClass, DayMask days = DayMask()) const {
+        return combinedBlockedMask(lines, [](const unique_ptr<Line>& line) -> const Line& { return *line; },
+                                   trainClass, days);
+    }
+
+    optional<Time> nextFreeSlot(const Time& from, TrainClass trainClass, DayMask days = DayMask()) const {
+        return firstClearMinute(getBlockedMask(trainClass, days), from);
+    }
+
+    vector<TimeWindow> freeWindows(TrainClass trainClass, DayMask days = DayMask()) const {
+        return getBlockedMask(trainClass, days).clearRuns();
+    }
+
+    // First line (in display order) that can take the train at time
+    Line* findFreeLine(const Time& time, TrainClass trainClass, DayMask days = DayMask()) {
+        for (const auto& line : lines) {
+            bool free = days.isDaily() ? !line->getBlockedMask(trainClass).test(time.toMinutes())
+                                       : line->canAddTrain(time, trainClass, days);
+            if (free) return line.get();
+        }
+        return nullptr;
+    }
 
     int getPlatformNumber() const { return platformNumber; }
     const vector<unique_ptr<Line>>& getLines() const { return lines; }
 };
 
+using Platform = BasicPlatform<StandardHeadways>;
+
+// A train met by a TimetableCursor, with where it runs
+struct ScheduledTrain {
+    const TrainSchedule* schedule;
+    int platformNumber;
+    int lineNumber;
+    bool nextDay;  // reached after the range wrapped past midnight
+};
+
+// Lazy k-way merge of the time-ordered timelines of a set of platforms.
+// Starting a range costs one binary search per line; each train after
+// that costs O(log lines) on a small heap of line heads, so reading the
+// first k trains never touches the rest. A range whose end is before its
+// start continues past midnight, where the day filter moves on a day.
+// The cursor points into the timelines: restart it after any change.
+template<typename Policy>
+class TimetableCursor {
+private:
+    using Platforms = vector<unique_ptr<BasicPlatform<Policy>>>;
+
+    struct Head {
+        const TrainSchedule* next;
+        const TrainSchedule* end;
+        uint32_t line;  // position in platform and line order, breaks ties
+        int platformNumber;
+        int lineNumber;
+    };
+
+    const Platforms* platforms;
+    vector<Head> heap;
+    int last = 0;
+    int wrapLast = -1;  // last minute after midnight, or -1 when not wrapping
+    DayMask days;
+    bool nextDay = false;
+
+    static bool later(const Head& a, const Head& b) {
+        return a.next->time != b.next->time ? b.next->time < a.next->time : a.line > b.line;
+    }
+
+    void seed(int first) {
+        heap.clear();
+        uint32_t position = 0;
+        for (const auto& platform : *platforms) {
+            for (const auto& line : platform->getLines()) {
+                const auto& timeline = line->getTimeline();
+                auto it = lower_bound(timeline.begin(), timeline.end(), first,
+                    [](const TrainSchedule& schedule, int minute) { return schedule.time.toMinutes() < minute; });
+                if (it != timeline.end() && it->time.toMinutes() <= last) {
+                    heap.push_back({&*it, timeline.data() + timeline.size(), position,
+                                    platform->getPlatformNumber(), line->getLineNumber()});
+                }
+                ++position;
+            }
+        }
+        make_heap(heap.begin(), heap.end(), later);
+    }
+
+public:
+    TimetableCursor(const Platforms& source, const Time& from, const Time& to, DayMask runsOn = DayMask())
+        : platforms(&source) {
+        restart(from, to, runsOn);
+    }
+
+    // Starts a new range, reusing the heap's storage
+    void restart(const Time& from, const Time& to, DayMask runsOn = DayMask()) {
+        days = runsOn;
+        nextDay = false;
+        if (to < from) {
+            last = Time::MINUTES_PER_DAY - 1;
+            wrapLast = to.toMinutes();
+        } else {
+            last = to.toMinutes();
+            wrapLast = -1;
+        }
+        seed(from.toMinutes());
+    }
+
+    // Next train in time order running on the requested days
+    bool next(ScheduledTrain& train) {
+        while (true) {
+            if (heap.empty()) {
+                if (wrapLast < 0) return false;
+                last = wrapLast;
+                wrapLast = -1;
+                days = days.following();
+                nextDay = true;
+                seed(0);
+                continue;
+            }
+            pop_heap(heap.begin(), heap.end(), later);
+            Head& head = heap.back();
+            const TrainSchedule* schedule = head.next++;
+            train = {schedule, head.platformNumber, head.lineNumber, nextDay};
+            if (head.next != head.end && head.next->time.toMinutes() <= last) {
+                push_heap(heap.begin(), heap.end(), later);
+            } else {
+                heap.pop_back();
+            }
+            if (schedule->days.overlaps(days)) return true;
+        }
+    }
+};
+
+// One train of a batch handed to RailwayStation::assignTrains
+struct TrainRequest {
+    Time time;
+    TrainClass trainClass;
+};
+
+struct TrainAssignment {
+    size_t request;  // index into the request list
+    int platformNumber;
+    int lineNumber;
+};
+
+struct TrainPlan {
+    vector<TrainAssignment> assigned;  // in time order
+    vector<size_t> unplaced;           // request indexes, in time order
+};
+
 // Station class template
-template<typename T>
-class RailwayStation {
+template<typename T, typename Policy = StandardHeadways>
+class RailwayStation : public ChangeTracked {
+public:
+    using Platform = BasicPlatform<Policy>;
+
 private:
     T id;
     string name;
     vector<unique_ptr<Platform>> platforms;
+    IdIndex<int, Platform> platformIndex;
 
 public:
     RailwayStation(T stationId, string stationName) 
         : id(move(stationId)), name(move(stationName)) {}
 
-    void addPlatform(int platformNumber) {
+    Platform* addPlatform(int platformNumber) {
         if (findPlatform(platformNumber)) {
             throw RailwayException("Platform already exists");
         }
         platforms.push_back(make_unique<Platform>(platformNumber));
+        platformIndex.insert(platformNumber, platforms.back().get());
+        adopt(*platforms.back());
+        markChanged();
+        return platforms.back().get();
     }
 
     void addPlatforms(const vector<int>& platformNumbers) {
@@ -150,91 +933,174 @@ public:
     }
 
     Platform* findPlatform(int platformNumber) {
-        auto it = find_if(platforms.begin(), platforms.end(),
-            [platformNumber](const auto& platform) { 
-                return platform->getPlatformNumber() == platformNumber; 
-            });
-        return it != platforms.end() ? it->get() : nullptr;
+        RAILWAY_COUNT(PlatformLookups, 1);
+        RAILWAY_COUNT(PlatformProbes, platformIndex.probeLength(platformNumber));
+        return platformIndex.find(platformNumber);
     }
 
-    void addTrainSchedule(int platformNumber, int lineNumber, const Time& time, bool isStoppingTrain) {
+    const Platform* findPlatform(int platformNumber) const {
+        RAILWAY_COUNT(PlatformLookups, 1);
+        RAILWAY_COUNT(PlatformProbes, platformIndex.probeLength(platformNumber));
+        return platformIndex.find(platformNumber);
+    }
+
+    AddResult tryAddTrainSchedule(int platformNumber, int lineNumber, const Time& time, TrainClass trainClass,
+                                  DayMask days = DayMask()) {
+        RAILWAY_TIMED(AddTrainSchedule);
         auto* platform = findPlatform(platformNumber);
         if (!platform) {
-            throw RailwayException("Platform not found");
+            return AddResult(AddStatus::PlatformNotFound);
         }
         auto* line = platform->findLine(lineNumber);
         if (!line) {
-            throw RailwayException("Line not found on this platform");
+            return AddResult(AddStatus::LineNotFound);
+        }
+        AddResult result = line->tryAddTrain(time, trainClass, days);
+        if (result) result.handle.platformNumber = platformNumber;
+        return result;
+    }
+
+    const TrainSchedule* findTrain(const TrainHandle& handle) const {
+        const auto* platform = findPlatform(handle.platformNumber);
+        const auto* line = platform ? platform->findLine(handle.lineNumber) : nullptr;
+        return line ? line->findTrain(handle.train) : nullptr;
+    }
+
+    // Cancels a train; false when the handle matches none
+    bool removeTrain(const TrainHandle& handle) {
+        auto* platform = findPlatform(handle.platformNumber);
+        auto* line = platform ? platform->findLine(handle.lineNumber) : nullptr;
+        return line && line->removeTrain(handle.train);
+    }
+
+    // Moves a train within its line; the handle stays valid either way
+    AddResult rescheduleTrain(const TrainHandle& handle, const Time& time, TrainClass trainClass,
+                              DayMask days = DayMask()) {
+        auto* platform = findPlatform(handle.platformNumber);
+        if (!platform) {
+            return AddResult(AddStatus::PlatformNotFound);
+        }
+        auto* line = platform->findLine(handle.lineNumber);
+        if (!line) {
+            return AddResult(AddStatus::LineNotFound);
+        }
+        AddResult result = line->rescheduleTrain(handle.train, time, trainClass, days);
+        if (result) result.handle.platformNumber = handle.platformNumber;
+        return result;
+    }
+
+    void addTrainSchedule(int platformNumber, int lineNumber, const Time& time, TrainClass trainClass,
+                          DayMask days = DayMask()) {
+        AddResult result = tryAddTrainSchedule(platformNumber, lineNumber, time, trainClass, days);
+        if (!result) {
+            throwAddFailure(result);
+        }
+    }
+
+    // Packs a day's worth of daily trains onto the existing lines in one
+    // sweep: requests are taken in time order from the minute crossed by
+    // the fewest headway windows, and each goes to the free line with the
+    // least idle time before it (best fit), tracked on copies of the
+    // lines' blocked-minute masks. When all requests share one headway
+    // and some minute lies outside every request's window, this accepts
+    // the most trains possible on empty lines; with mixed classes, or a
+    // day with no such gap, it is a greedy approximation. planTrains
+    // leaves the station untouched, assignTrains also adds the planned
+    // trains.
+    TrainPlan planTrains(const vector<TrainRequest>& requests) const;
+    TrainPlan assignTrains(const vector<TrainRequest>& requests);
+
+    // Trains at every platform from `from` to `to` inclusive, in time order
+    // (platform and line order on ties). With `to` before `from` the range
+    // runs past midnight into the next day.
+    TimetableCursor<Policy> trainsBetween(const Time& from, const Time& to, DayMask days = DayMask()) const {
+        return TimetableCursor<Policy>(platforms, from, to, days);
+    }
+
+    // Departure board: the next `count` trains at or after `from`, going
+    // on into the next day when the rest of today runs short
+    vector<ScheduledTrain> nextTrains(const Time& from, size_t count, DayMask days = DayMask()) const {
+        Time to = from.toMinutes() == 0 ? Time(23, 59) : Time::fromMinutes(from.toMinutes() - 1);
+        auto cursor = trainsBetween(from, to, days);
+        vector<ScheduledTrain> board;
+        board.reserve(count);
+        ScheduledTrain train;
+        while (board.size() < count && cursor.next(train)) {
+            board.push_back(train);
+        }
+        return board;
+    }
+
+    MinuteMask getBlockedMask(TrainClass trainClass, DayMask days = DayMask()) const {
+        MinuteMask mask = MinuteMask::full();
+        for (const auto& platform : platforms) {
+            mask &= platform->getBlockedMask(trainClass, days);
         }
-        line->addTrain(time, isStoppingTrain);
+        return mask;
+    }
+
+    optional<Time> nextFreeSlot(const Time& from, TrainClass trainClass, DayMask days = DayMask()) const {
+        return firstClearMinute(getBlockedMask(trainClass, days), from);
+    }
+
+    vector<TimeWindow> freeWindows(TrainClass trainClass, DayMask days = DayMask()) const {
+        return getBlockedMask(trainClass, days).clearRuns();
     }
 
-    T getId() const { return id; }
-    string getName() const { return name; }
+    const T& getId() const { return id; }
+    const string& getName() const { return name; }
     const vector<unique_ptr<Platform>>& getPlatforms() const { return platforms; }
 };
 
 // Railway System class
-template<typename T>
+template<typename T, typename Policy = StandardHeadways>
 class RailwaySystem {
+public:
+    using Station = RailwayStation<T, Policy>;
+
 private:
-    vector<unique_ptr<RailwayStation<T>>> stations;
+    vector<unique_ptr<Station>> stations;
+    IdIndex<T, Station> stationIndex;
 
 public:
-    void addStation(T id, const string& name) {
+    // The ID and name move into the station; the index keys off the
+    // station's own copy of the ID
+    Station* addStation(T id, string name) {
         if (findStation(id)) {
             throw RailwayException("Station ID already exists");
         }
-        stations.push_back(make_unique<RailwayStation<T>>(id, name));
+        stations.push_back(make_unique<Station>(move(id), move(name)));
+        stationIndex.insert(stations.back()->getId(), stations.back().get());
+        return stations.back().get();
     }
 
-    RailwayStation<T>* findStation(T id) {
-        auto it = find_if(stations.begin(), stations.end(),
-            [&id](const auto& station) { return station->getId() == id; });
-        return it != stations.end() ? it->get() : nullptr;
+    // String IDs can be looked up by string_view
+    Station* findStation(LookupKey<T> id) {
+        RAILWAY_COUNT(StationLookups, 1);
+        RAILWAY_COUNT(StationProbes, stationIndex.probeLength(id));
+        return stationIndex.find(id);
     }
 
-    void displayAllStations() const {
-        cout << "\n=== Railway System Status ===\n";
-        if (stations.empty()) {
-            cout << "No stations in the system.\n";
-            return;
-        }
-
-        for (const auto& station : stations) {
-            cout << "\nStation ID: " << station->getId() 
-                     << "\nName: " << station->getName() << "\n";
-            
-            if (station->getPlatforms().empty()) {
-                cout << "No platforms in this station.\n";
-                continue;
-            }
-
-            for (const auto& platform : station->getPlatforms()) {
-                cout << "\nPlatform " << platform->getPlatformNumber() << ":\n";
-                
-                if (platform->getLines().empty()) {
-                    cout << "No lines on this platform.\n";
-                    continue;
-                }
+    const Station* findStation(LookupKey<T> id) const {
+        RAILWAY_COUNT(StationLookups, 1);
+        RAILWAY_COUNT(StationProbes, stationIndex.probeLength(id));
+        return stationIndex.find(id);
+    }
 
-                for (const auto& line : platform->getLines()) {
-                    cout << "\nLine " << line->getLineNumber() << " Schedule:\n";
-                    cout << setw(10) << "Time" 
-                             << setw(15) << "Train Type" << "\n";
-                    cout << string(25, '-') << "\n";
-
-                    const auto& schedules = line->getSchedules();
-                    for (const auto& schedule : schedules) {
-                        cout << setw(10) << schedule.time.toString()
-                                 << setw(15) << (schedule.isStoppingTrain ? "Stopping" : "Through")
-                                 << "\n";
-                    }
-                    cout << string(25, '-') << "\n";
-                }
-            }
+    AddResult tryAddTrainSchedule(LookupKey<T> id, int platformNumber, int lineNumber,
+                                  const Time& time, TrainClass trainClass, DayMask days = DayMask()) {
+        auto* station = findStation(id);
+        if (!station) {
+            return AddResult(AddStatus::StationNotFound);
         }
+        return station->tryAddTrainSchedule(platformNumber, lineNumber, time, trainClass, days);
     }
+
+    const vector<unique_ptr<Station>>& getStations() const { return stations; }
+
+    // Defined in railway_report.h
+    void displayAllStations() const;
 };
 
-#include "railway.cpp"
\ No newline at end of file
+#include "railway.cpp"
+#include "railway_report.h"
\ No newline at end of file
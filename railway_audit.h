@@ -0,0 +1,91 @@
+// railway_audit.h
+#pragma once
+#include "railway.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Whole-network conflict audit
+//
+// For trains loaded without the per-insert check (appendUnchecked, or a
+// deferred import): one pass afterwards finds every pair on every line
+// that breaks the headway rule. Lines are independent, so worker threads
+// take AUDIT_BLOCK lines at a time from a shared counter and sweep each
+// with BasicLine::findConflictPairs. Pairs are kept per line, so the
+// result comes back in station, platform and line order whatever the
+// thread count.
+
+constexpr size_t AUDIT_BLOCK = 64;
+
+template<typename T, typename Policy = StandardHeadways>
+struct NetworkConflict {
+    const RailwayStation<T, Policy>* station;
+    TrainConflict pair;
+};
+
+template<typename T, typename Policy = StandardHeadways>
+struct ConflictAudit {
+    vector<NetworkConflict<T, Policy>> conflicts;
+    size_t lines = 0;
+    size_t trains = 0;
+    unsigned threads = 0;
+    double seconds = 0.0;
+};
+
+// threads = 0 uses every core
+template<typename T, typename Policy>
+ConflictAudit<T, Policy> auditConflicts(const RailwaySystem<T, Policy>& railway, unsigned threads = 0) {
+    struct AuditedLine {
+        const RailwayStation<T, Policy>* station;
+        int platformNumber;
+        const BasicLine<Policy>* line;
+    };
+
+    auto begin = chrono::steady_clock::now();
+    ConflictAudit<T, Policy> audit;
+    vector<AuditedLine> lines;
+    for (const auto& station : railway.getStations()) {
+        for (const auto& platform : station->getPlatforms()) {
+            for (const auto& line : platform->getLines()) {
+                lines.push_back({station.get(), platform->getPlatformNumber(), line.get()});
+                audit.trains += line->getTimeline().size();
+            }
+        }
+    }
+    audit.lines = lines.size();
+
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(min<size_t>(threads, (lines.size() + AUDIT_BLOCK - 1) / AUDIT_BLOCK));
+    audit.threads = max(1u, threads);
+
+    vector<vector<TrainConflict>> found(lines.size());
+    atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t start = next.fetch_add(AUDIT_BLOCK); start < lines.size(); start = next.fetch_add(AUDIT_BLOCK)) {
+            size_t end = min(start + AUDIT_BLOCK, lines.size());
+            for (size_t i = start; i < end; ++i) {
+                lines[i].line->findConflictPairs(found[i]);
+            }
+        }
+    };
+    vector<thread> workers;
+    for (unsigned i = 1; i < audit.threads; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (size_t i = 0; i < lines.size(); ++i) {
+        for (auto& pair : found[i]) {
+            pair.first.platformNumber = lines[i].platformNumber;
+            pair.second.platformNumber = lines[i].platformNumber;
+            audit.conflicts.push_back({lines[i].station, pair});
+        }
+    }
+    audit.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    return audit;
+}
@@ -0,0 +1,839 @@
+// railway_bench.cpp
+#include "railway.h"
+#include "railway_flat.h"
+#include "railway_journey.h"
+#include "railway_versioned.h"
+#include "railway_workload.h"
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <random>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware cache-miss counter for the calling thread. Reports -1 when the
+// kernel does not allow perf events (containers, perf_event_paranoid).
+class CacheMissCounter {
+private:
+    int fd;
+
+public:
+    CacheMissCounter() {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~CacheMissCounter() {
+        if (fd >= 0) close(fd);
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start() {
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    long long stop() {
+        if (fd < 0) return -1;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long count = 0;
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+        return count;
+    }
+};
+
+struct Measurement {
+    double nsPerOp;
+    long long cacheMisses;
+};
+
+template<typename Body>
+Measurement measure(size_t operations, Body body) {
+    CacheMissCounter counter;
+    auto begin = chrono::steady_clock::now();
+    counter.start();
+    body();
+    long long misses = counter.stop();
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count();
+    return {ns / operations, misses};
+}
+
+// Station/platform/line/train counts of one benchmark network
+struct NetworkShape {
+    int stations;
+    int platforms;
+    int lines;
+    int trains;
+
+    size_t scheduleCount() const { return size_t(stations) * platforms * lines * trains; }
+};
+
+// Builds a conflict-free network. Platforms, lines and trains are added in
+// round-robin order across stations, so the pointer tree's nodes end up
+// interleaved on the heap as they would after an organic build-up.
+unique_ptr<RailwaySystem<int>> buildNetwork(const NetworkShape& shape) {
+    auto railway = make_unique<RailwaySystem<int>>();
+    for (int s = 0; s < shape.stations; ++s) {
+        railway->addStation(s, "Station " + to_string(s));
+    }
+    for (int p = 1; p <= shape.platforms; ++p) {
+        for (int s = 0; s < shape.stations; ++s) {
+            railway->findStation(s)->addPlatform(p);
+        }
+    }
+    for (int l = 1; l <= shape.lines; ++l) {
+        for (int s = 0; s < shape.stations; ++s) {
+            for (int p = 1; p <= shape.platforms; ++p) {
+                railway->findStation(s)->findPlatform(p)->addLine(l);
+            }
+        }
+    }
+    int spacing = 1440 / shape.trains;
+    for (int t = 0; t < shape.trains; ++t) {
+        int minute = t * spacing;
+        for (int s = 0; s < shape.stations; ++s) {
+            for (int p = 1; p <= shape.platforms; ++p) {
+                for (int l = 1; l <= shape.lines; ++l) {
+                    railway->findStation(s)->addTrainSchedule(p, l, Time::fromMinutes(minute), spacing >= 30);
+                }
+            }
+        }
+    }
+    return railway;
+}
+
+long long sumTree(const RailwaySystem<int>& railway) {
+    long long sum = 0;
+    for (const auto& station : railway.getStations()) {
+        for (const auto& platform : station->getPlatforms()) {
+            for (const auto& line : platform->getLines()) {
+                for (const auto& schedule : line->getSchedules()) {
+                    sum += schedule.time.toMinutes() + schedule.trainClass;
+                }
+            }
+        }
+    }
+    return sum;
+}
+
+long long sumFlat(const FlatRailwayNetwork<int>& network) {
+    long long sum = 0;
+    for (size_t s = 0; s < network.getStationNodes().size(); ++s) {
+        auto station = network.station(s);
+        for (size_t p = 0; p < station.platformCount(); ++p) {
+            auto platform = station.platform(p);
+            for (size_t l = 0; l < platform.lineCount(); ++l) {
+                for (const auto& schedule : platform.line(l).getSchedules()) {
+                    sum += schedule.time.toMinutes() + schedule.trainClass;
+                }
+            }
+        }
+    }
+    return sum;
+}
+
+volatile long long sink;
+
+// Collects results, prints them as they arrive and writes them out as JSON
+// so runs from different commits can be diffed.
+class BenchSuite {
+private:
+    struct Result {
+        string name;
+        size_t size;
+        double nsPerOp;
+        long long cacheMisses;
+    };
+
+    vector<Result> results;
+    string filter;
+
+public:
+    explicit BenchSuite(string nameFilter) : filter(move(nameFilter)) {
+        cout << left << setw(32) << "benchmark" << right << setw(10) << "size"
+             << setw(12) << "ns/op" << setw(16) << "cache misses" << "\n";
+    }
+
+    bool enabled(const string& name) const {
+        return filter.empty() || name.find(filter) != string::npos;
+    }
+
+    template<typename Body>
+    void run(const string& name, size_t size, size_t operations, Body body) {
+        if (!enabled(name)) return;
+        Measurement m = measure(operations, body);
+        results.push_back({name, size, m.nsPerOp, m.cacheMisses});
+        cout << left << setw(32) << name << right << setw(10) << size
+             << setw(12) << fixed << setprecision(2) << m.nsPerOp;
+        if (m.cacheMisses >= 0) {
+            cout << setw(16) << m.cacheMisses << "\n";
+        } else {
+            cout << setw(16) << "n/a" << "\n";
+        }
+    }
+
+    // Growth of ns/op between the smallest and largest size of each
+    // benchmark, as an exponent: 0 is constant time, 1 is linear.
+    void printScaling() const {
+        map<string, pair<const Result*, const Result*>> ranges;
+        for (const auto& result : results) {
+            auto& range = ranges[result.name];
+            if (!range.first || result.size < range.first->size) range.first = &result;
+            if (!range.second || result.size > range.second->size) range.second = &result;
+        }
+        cout << "\n" << left << setw(32) << "scaling" << right << setw(21) << "sizes"
+             << setw(12) << "exponent" << "\n";
+        for (const auto& entry : ranges) {
+            const Result* low = entry.second.first;
+            const Result* high = entry.second.second;
+            if (low->size == high->size) continue;
+            double exponent = log(high->nsPerOp / low->nsPerOp) / log(double(high->size) / low->size);
+            cout << left << setw(32) << entry.first << right << setw(10) << low->size
+                 << " -> " << left << setw(7) << high->size << right
+                 << setw(12) << fixed << setprecision(2) << exponent << "\n";
+        }
+    }
+
+    void writeJson(const string& path, const string& label) const {
+        ofstream out(path);
+        if (!out) {
+            throw RailwayException("Cannot write benchmark results to '" + path + "'");
+        }
+        out << "{\"label\":\"" << label << "\",\"results\":[";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto& r = results[i];
+            out << (i ? "," : "") << "\n  {\"name\":\"" << r.name << "\",\"size\":" << r.size
+                << ",\"ns_per_op\":" << fixed << setprecision(3) << r.nsPerOp
+                << ",\"cache_misses\":";
+            if (r.cacheMisses >= 0) {
+                out << r.cacheMisses << "}";
+            } else {
+                out << "null}";
+            }
+        }
+        out << "\n]}\n";
+    }
+};
+
+Time randomTime(mt19937& rng) {
+    return Time::fromMinutes(static_cast<int>(rng() % Time::MINUTES_PER_DAY));
+}
+
+// Conflict checks and inserts against a single line holding `trains`
+// through trains; the per-line timetable caps out at 144 per day.
+void benchLine(BenchSuite& suite, int trains) {
+    Line line(1);
+    int spacing = Time::MINUTES_PER_DAY / trains;
+    for (int t = 0; t < trains; ++t) {
+        line.addTrain(Time::fromMinutes(t * spacing), false);
+    }
+    const size_t checks = 1000000;
+    mt19937 rng(7);
+    vector<Time> probes(4096);
+    for (auto& probe : probes) probe = randomTime(rng);
+    suite.run("line/canAddTrain", trains, checks, [&] {
+        long long accepted = 0;
+        for (size_t i = 0; i < checks; ++i) {
+            accepted += line.canAddTrain(probes[i & 4095], (i & 1) != 0);
+        }
+        sink = accepted;
+    });
+
+    // Same rules read from a runtime table instead of the constexpr one
+    BasicLine<RuntimeHeadways> configured(1);
+    configured.restoreSchedules(line.getSchedules());
+    suite.run("line/canAddTrain-runtime-policy", trains, checks, [&] {
+        long long accepted = 0;
+        for (size_t i = 0; i < checks; ++i) {
+            accepted += configured.canAddTrain(probes[i & 4095], (i & 1) != 0);
+        }
+        sink = accepted;
+    });
+
+    // Fill fresh lines to `trains` schedules, inserting in shuffled order
+    vector<int> order(trains);
+    for (int t = 0; t < trains; ++t) order[t] = t * spacing;
+    shuffle(order.begin(), order.end(), rng);
+    const size_t rounds = max<size_t>(1, 200000 / trains);
+    vector<Line> lines;
+    lines.reserve(rounds);
+    for (size_t r = 0; r < rounds; ++r) lines.emplace_back(static_cast<int>(r + 1));
+    suite.run("line/addTrain", trains, rounds * trains, [&] {
+        for (auto& fresh : lines) {
+            for (int minute : order) fresh.addTrain(Time::fromMinutes(minute), false);
+        }
+    });
+
+    // Moves every train to its own slot (checked against all the others),
+    // then cancels the filled lines' trains in shuffled order
+    vector<TrainId> trainIds = line.getTrainIds();
+    shuffle(trainIds.begin(), trainIds.end(), rng);
+    suite.run("line/rescheduleTrain", trains, checks / 10, [&] {
+        long long moved = 0;
+        for (size_t i = 0; i < checks / 10; ++i) {
+            TrainId train = trainIds[i % trains];
+            const TrainSchedule& current = *line.findTrain(train);
+            moved += static_cast<bool>(line.rescheduleTrain(train, current.time, current.trainClass));
+        }
+        sink = moved;
+    });
+    suite.run("line/removeTrain", trains, rounds * trains, [&] {
+        for (auto& filled : lines) {
+            for (TrainId train : trainIds) filled.removeTrain(train);
+        }
+    });
+}
+
+// Handle operations on the densest weekly line: a through train every 10
+// minutes on each weekday separately, 1008 trains. Removal and reschedule
+// shift the line's flat arrays, so this is where that cost peaks.
+void benchWeeklyLine(BenchSuite& suite) {
+    Line line(1);
+    for (int day = 0; day < 7; ++day) {
+        for (int minute = 0; minute < Time::MINUTES_PER_DAY; minute += THROUGH_HEADWAY) {
+            line.addTrain(Time::fromMinutes(minute), THROUGH_TRAIN, DayMask(static_cast<uint8_t>(1 << day)));
+        }
+    }
+    const size_t trains = line.getTrainIds().size();
+    const size_t operations = 100000;
+    mt19937 rng(11);
+    vector<TrainId> trainIds = line.getTrainIds();
+    shuffle(trainIds.begin(), trainIds.end(), rng);
+
+    // Each train back into its own slot, checked against all the others
+    suite.run("line/rescheduleTrain-weekly", trains, operations, [&] {
+        long long moved = 0;
+        for (size_t i = 0; i < operations; ++i) {
+            TrainId train = trainIds[i % trains];
+            const TrainSchedule& current = *line.findTrain(train);
+            moved += static_cast<bool>(line.rescheduleTrain(train, current.time, current.trainClass, current.days));
+        }
+        sink = moved;
+    });
+
+    // Cancel a train and add it again, so the line stays at full size
+    suite.run("line/removeTrain+re-add-weekly", trains, operations, [&] {
+        long long added = 0;
+        for (size_t i = 0; i < operations; ++i) {
+            TrainId& train = trainIds[i % trains];
+            TrainSchedule current = *line.findTrain(train);
+            line.removeTrain(train);
+            AddResult result = line.tryAddTrain(current.time, current.trainClass, current.days);
+            train = result.handle.train;
+            added += static_cast<bool>(result);
+        }
+        sink = added;
+    });
+}
+
+// Free-slot queries on one station with `platforms` x 4 lines, each line
+// filled with stopping trains every 40 minutes
+void benchSlotQueries(BenchSuite& suite, int platforms) {
+    RailwayStation<int> station(1, "Central");
+    for (int p = 1; p <= platforms; ++p) {
+        station.addPlatform(p)->addLines({1, 2, 3, 4});
+        for (int l = 1; l <= 4; ++l) {
+            for (int minute = (p * 7 + l * 3) % 40; minute < Time::MINUTES_PER_DAY; minute += 40) {
+                station.addTrainSchedule(p, l, Time::fromMinutes(minute), true);
+            }
+        }
+    }
+    size_t lines = size_t(platforms) * 4;
+    const size_t queries = 20000;
+    mt19937 rng(5);
+    vector<Time> starts(1024);
+    for (auto& start : starts) start = randomTime(rng);
+    suite.run("slots/line.nextFreeSlot", lines, queries * 10, [&] {
+        const Line& line = *station.findPlatform(1)->findLine(1);
+        long long sum = 0;
+        for (size_t i = 0; i < queries * 10; ++i) {
+            auto slot = line.nextFreeSlot(starts[i & 1023], true);
+            sum += slot ? slot->toMinutes() : -1;
+        }
+        sink = sum;
+    });
+    suite.run("slots/station.nextFreeSlot", lines, queries, [&] {
+        long long sum = 0;
+        for (size_t i = 0; i < queries; ++i) {
+            auto slot = station.nextFreeSlot(starts[i & 1023], false);
+            sum += slot ? slot->toMinutes() : -1;
+        }
+        sink = sum;
+    });
+    suite.run("slots/station.freeWindows", lines, queries, [&] {
+        long long sum = 0;
+        for (size_t i = 0; i < queries; ++i) sum += station.freeWindows(i & 1).size();
+        sink = sum;
+    });
+}
+
+// Bulk insert where conflictPercent of the rows hit an occupied slot on a
+// full platform and the rest land on free lines: status codes versus
+// exceptions for the same rows
+void benchConflictHeavyInserts(BenchSuite& suite, int conflictPercent) {
+    const size_t inserts = 200000;
+    const int slotsPerLine = Time::MINUTES_PER_DAY / THROUGH_HEADWAY;
+    mt19937 rng(conflictPercent);
+
+    struct Probe {
+        int platform;
+        int line;
+        Time time;
+    };
+    vector<Probe> probes(inserts);
+    int accepted = 0;
+    for (auto& probe : probes) {
+        if (static_cast<int>(rng() % 100) < conflictPercent) {
+            probe = {1, 1 + int(rng() % 4), Time::fromMinutes(int(rng() % 72) * 20)};
+        } else {
+            probe = {2, 1 + accepted / slotsPerLine, Time::fromMinutes(accepted % slotsPerLine * 10)};
+            ++accepted;
+        }
+    }
+    int freeLines = accepted / slotsPerLine + 1;
+    auto makeStation = [&] {
+        auto station = make_unique<RailwayStation<int>>(1, "Central");
+        station->addPlatform(1)->addLines({1, 2, 3, 4});
+        for (int l = 1; l <= 4; ++l) {
+            for (int minute = 0; minute < Time::MINUTES_PER_DAY; minute += 20) {
+                station->addTrainSchedule(1, l, Time::fromMinutes(minute), false);
+            }
+        }
+        auto* platform = station->addPlatform(2);
+        for (int l = 1; l <= freeLines; ++l) platform->addLine(l);
+        return station;
+    };
+
+    auto tryStation = makeStation();
+    auto throwingStation = makeStation();
+    string name = "insert/" + to_string(conflictPercent) + "%-conflict/";
+    suite.run(name + "tryAdd", inserts, inserts, [&] {
+        long long added = 0;
+        for (const auto& probe : probes) {
+            added += static_cast<bool>(tryStation->tryAddTrainSchedule(probe.platform, probe.line, probe.time, false));
+        }
+        sink = added;
+    });
+    suite.run(name + "throwing", inserts, inserts, [&] {
+        long long added = 0;
+        for (const auto& probe : probes) {
+            try {
+                throwingStation->addTrainSchedule(probe.platform, probe.line, probe.time, false);
+                ++added;
+            } catch (const TimeConflictException&) {}
+        }
+        sink = added;
+    });
+}
+
+void benchLookups(BenchSuite& suite, const RailwaySystem<int>& railway, const NetworkShape& shape) {
+    const size_t lookups = 500000;
+    mt19937 rng(11);
+    vector<int> stationKeys(lookups);
+    for (auto& key : stationKeys) key = static_cast<int>(rng() % shape.stations);
+    size_t size = shape.stations;
+
+    suite.run("lookup/findStation", size, lookups, [&] {
+        long long found = 0;
+        for (int key : stationKeys) found += railway.findStation(key) != nullptr;
+        sink = found;
+    });
+
+    vector<const RailwayStation<int>*> targets(lookups);
+    for (size_t i = 0; i < lookups; ++i) targets[i] = railway.findStation(stationKeys[i]);
+    suite.run("lookup/findPlatform", size, lookups, [&] {
+        long long found = 0;
+        for (size_t i = 0; i < lookups; ++i) {
+            found += targets[i]->findPlatform(1 + static_cast<int>(i % shape.platforms)) != nullptr;
+        }
+        sink = found;
+    });
+
+    vector<const Platform*> platforms(lookups);
+    for (size_t i = 0; i < lookups; ++i) platforms[i] = targets[i]->findPlatform(1 + static_cast<int>(i % shape.platforms));
+    suite.run("lookup/findLine", size, lookups, [&] {
+        long long found = 0;
+        for (size_t i = 0; i < lookups; ++i) {
+            found += platforms[i]->findLine(1 + static_cast<int>(i % shape.lines)) != nullptr;
+        }
+        sink = found;
+    });
+}
+
+void benchBulkAdds(BenchSuite& suite, int stations) {
+    const int perStation = 16;
+    RailwaySystem<int> railway;
+    for (int s = 0; s < stations; ++s) railway.addStation(s, "Station");
+    vector<int> numbers(perStation);
+    for (int i = 0; i < perStation; ++i) numbers[i] = i + 1;
+
+    suite.run("bulk/addPlatforms", stations, size_t(stations) * perStation, [&] {
+        for (int s = 0; s < stations; ++s) railway.findStation(s)->addPlatforms(numbers);
+    });
+    suite.run("bulk/addLines", stations, size_t(stations) * perStation * perStation, [&] {
+        for (int s = 0; s < stations; ++s) {
+            auto* station = railway.findStation(s);
+            for (int p = 1; p <= perStation; ++p) station->findPlatform(p)->addLines(numbers);
+        }
+    });
+}
+
+// displayAllStations writes to stdout; point stdout at /dev/null meanwhile
+void benchDisplay(BenchSuite& suite, RailwaySystem<int>& railway, const NetworkShape& shape) {
+    if (suite.enabled("display/displayAllStations")) {
+        cout.flush();
+        int saved = dup(STDOUT_FILENO);
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        close(devNull);
+        suite.run("display/displayAllStations", shape.scheduleCount(), shape.scheduleCount(),
+                  [&] { railway.displayAllStations(); });
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+
+    // Full view after one line changed: the cached view re-renders a
+    // single line and copies everything else.
+    if (suite.enabled("display/incremental-one-change")) {
+        int devNull = open("/dev/null", O_WRONLY);
+        IncrementalTableView<int> view;
+        {
+            OutputBuffer out(devNull);
+            view.writeAll(railway, out);
+        }
+        size_t next = 0;
+        suite.run("display/incremental-one-change", shape.scheduleCount(), shape.scheduleCount(), [&] {
+            auto* line = railway.findStation(int(next++ % shape.stations))->findPlatform(1)->findLine(1);
+            line->restoreSchedules(line->getSchedules());
+            OutputBuffer out(devNull);
+            view.writeAll(railway, out);
+        });
+        close(devNull);
+    }
+}
+
+void benchFlatStorage(BenchSuite& suite, const RailwaySystem<int>& railway, const NetworkShape& shape) {
+    FlatRailwayNetwork<int> network(railway);
+    size_t schedules = shape.scheduleCount();
+
+    suite.run("traverse/pointer-tree", schedules, schedules, [&] { sink = sumTree(railway); });
+    suite.run("traverse/flat", schedules, schedules, [&] { sink = sumFlat(network); });
+
+    const size_t lookups = 200000;
+    mt19937 rng(42);
+    vector<array<int, 3>> keys(lookups);
+    for (auto& key : keys) {
+        key = {int(rng() % shape.stations), int(rng() % shape.platforms) + 1, int(rng() % shape.lines) + 1};
+    }
+    suite.run("lookup/pointer-tree", schedules, lookups, [&] {
+        long long sum = 0;
+        for (const auto& key : keys) {
+            auto* line = railway.findStation(key[0])->findPlatform(key[1])->findLine(key[2]);
+            sum += line->getSchedules()[0].time.toMinutes();
+        }
+        sink = sum;
+    });
+    suite.run("lookup/flat", schedules, lookups, [&] {
+        long long sum = 0;
+        for (const auto& key : keys) {
+            auto line = network.findStation(key[0]).findPlatform(key[1]).findLine(key[2]);
+            sum += line.getSchedules()[0].time.toMinutes();
+        }
+        sink = sum;
+    });
+}
+
+// Journey queries over `stations` stations joined by trains that run along
+// random 10-stop routes every half hour, with a 3-minute transfer time
+void benchJourneys(BenchSuite& suite, int stations) {
+    RailwaySystem<int> railway;
+    for (int s = 0; s < stations; ++s) railway.addStation(s, "Station");
+    JourneyPlanner<int> planner(railway, 3);
+    mt19937 rng(23);
+    uint32_t trip = 0;
+    for (int route = 0; route < stations / 2; ++route) {
+        int stops[10];
+        for (int& stop : stops) stop = static_cast<int>(rng() % stations);
+        for (int start = static_cast<int>(rng() % 30); start < 20 * 60; start += 30, ++trip) {
+            int minute = start;
+            for (int hop = 0; hop + 1 < 10; ++hop) {
+                if (stops[hop] == stops[hop + 1]) continue;
+                int ride = 2 + static_cast<int>(rng() % 8);
+                planner.addConnection(stops[hop], Time::fromMinutes(minute), stops[hop + 1],
+                                      Time::fromMinutes(minute + ride), trip);
+                minute += ride + 1;
+            }
+        }
+    }
+    const size_t queries = 2000;
+    vector<JourneyQuery<int>> batch(queries);
+    for (auto& query : batch) {
+        query = {int(rng() % stations), int(rng() % stations), Time::fromMinutes(360 + int(rng() % 360))};
+    }
+    planner.earliestArrival(0, 1, Time(6, 0));  // sorts the connections
+
+    suite.run("journey/earliestArrival", planner.getConnectionCount(), queries, [&] {
+        long long minutes = 0;
+        for (const auto& query : batch) {
+            auto journey = planner.earliestArrival(query.from, query.to, query.departAfter);
+            minutes += journey ? journey->minutes : -1;
+        }
+        sink = minutes;
+    });
+    suite.run("journey/earliestArrivals", planner.getConnectionCount(), queries, [&] {
+        long long minutes = 0;
+        for (const auto& journey : planner.earliestArrivals(batch)) minutes += journey ? journey->minutes : -1;
+        sink = minutes;
+    });
+}
+
+// Departure boards: the next 10 trains through the lazy merge, against
+// copying and sorting every train of the station per refresh
+void benchBoards(BenchSuite& suite, int platforms) {
+    RailwayStation<int> station(1, "Central");
+    for (int p = 1; p <= platforms; ++p) {
+        station.addPlatform(p)->addLines({1, 2, 3, 4});
+        for (int l = 1; l <= 4; ++l) {
+            for (int minute = (p * 7 + l * 3) % 20; minute < Time::MINUTES_PER_DAY; minute += 20) {
+                station.addTrainSchedule(p, l, Time::fromMinutes(minute), false);
+            }
+        }
+    }
+    size_t lines = size_t(platforms) * 4;
+    const size_t refreshes = 20000;
+    mt19937 rng(37);
+    vector<Time> starts(1024);
+    for (auto& start : starts) start = randomTime(rng);
+    suite.run("board/nextTrains", lines, refreshes, [&] {
+        long long sum = 0;
+        auto cursor = station.trainsBetween(Time(0, 0), Time(23, 59));
+        for (size_t i = 0; i < refreshes; ++i) {
+            const Time& from = starts[i & 1023];
+            cursor.restart(from, from.toMinutes() ? Time::fromMinutes(from.toMinutes() - 1) : Time(23, 59));
+            ScheduledTrain train;
+            for (int k = 0; k < 10 && cursor.next(train); ++k) sum += train.schedule->time.toMinutes();
+        }
+        sink = sum;
+    });
+    suite.run("board/copyAndSort", lines, refreshes / 10, [&] {
+        long long sum = 0;
+        vector<TrainSchedule> all;
+        for (size_t i = 0; i < refreshes / 10; ++i) {
+            all.clear();
+            for (const auto& platform : station.getPlatforms()) {
+                for (const auto& line : platform->getLines()) {
+                    all.insert(all.end(), line->getSchedules().begin(), line->getSchedules().end());
+                }
+            }
+            sort(all.begin(), all.end(), [](const TrainSchedule& a, const TrainSchedule& b) { return a.time < b.time; });
+            auto it = lower_bound(all.begin(), all.end(), starts[i & 1023],
+                                  [](const TrainSchedule& schedule, const Time& t) { return schedule.time < t; });
+            for (int k = 0; k < 10 && it != all.end(); ++k, ++it) sum += it->time.toMinutes();
+        }
+        sink = sum;
+    });
+}
+
+// Planning a day of random mixed requests onto 4 platforms x 4 lines
+void benchAssignment(BenchSuite& suite, size_t count) {
+    RailwayStation<int> station(1, "Central");
+    for (int p = 1; p <= 4; ++p) station.addPlatform(p)->addLines({1, 2, 3, 4});
+    mt19937 rng(31);
+    vector<TrainRequest> requests(count);
+    for (auto& request : requests) {
+        request = {randomTime(rng), static_cast<TrainClass>(rng() % 4 == 0)};
+    }
+    const size_t rounds = 20;
+    suite.run("station/planTrains", count, rounds * count, [&] {
+        size_t placed = 0;
+        for (size_t i = 0; i < rounds; ++i) placed += station.planTrains(requests).assigned.size();
+        sink = static_cast<long long>(placed);
+    });
+}
+
+// Snapshot cost and the price of copy-on-write publishing: the same
+// hourly through trains go into `stations` x 4 x 4 empty lines directly,
+// one publish per train and 64 trains per publish
+void benchVersioned(BenchSuite& suite, int stations) {
+    auto buildEmpty = [&] {
+        auto railway = make_unique<RailwaySystem<int>>();
+        for (int s = 0; s < stations; ++s) {
+            railway->addStation(s, "Station " + to_string(s));
+            railway->findStation(s)->addPlatforms({1, 2, 3, 4});
+            for (int p = 1; p <= 4; ++p) railway->findStation(s)->findPlatform(p)->addLines({1, 2, 3, 4});
+        }
+        return railway;
+    };
+    auto empty = buildEmpty();
+    size_t inserts = size_t(stations) * 16 * 24;
+    auto insertAll = [&](auto&& add) {
+        size_t added = 0;
+        for (int hour = 0; hour < 24; ++hour) {
+            for (int s = 0; s < stations; ++s) {
+                for (int p = 1; p <= 4; ++p) {
+                    for (int l = 1; l <= 4; ++l) {
+                        added += static_cast<bool>(add(s, p, l, Time(hour, (s + p + l) % 60)));
+                    }
+                }
+            }
+        }
+        sink = static_cast<long long>(added);
+    };
+
+    auto direct = buildEmpty();
+    suite.run("versioned/baseline-tryAdd", size_t(stations), inserts, [&] {
+        insertAll([&](int s, int p, int l, const Time& time) {
+            return direct->findStation(s)->tryAddTrainSchedule(p, l, time, false);
+        });
+    });
+    VersionedRailwaySystem<int> single(*empty);
+    suite.run("versioned/publish-each", size_t(stations), inserts, [&] {
+        insertAll([&](int s, int p, int l, const Time& time) {
+            return single.tryAddTrainSchedule(s, p, l, time, THROUGH_TRAIN);
+        });
+    });
+    VersionedRailwaySystem<int> batched(*empty);
+    suite.run("versioned/publish-64", size_t(stations), inserts, [&] {
+        auto writer = batched.write();
+        size_t pending = 0;
+        insertAll([&](int s, int p, int l, const Time& time) {
+            if (++pending % 64 == 0) writer.publish();
+            return writer.tryAddTrainSchedule(s, p, l, time, THROUGH_TRAIN);
+        });
+    });
+
+    const size_t snapshots = 1000000;
+    suite.run("versioned/snapshot", size_t(stations), snapshots, [&] {
+        long long sum = 0;
+        for (size_t i = 0; i < snapshots; ++i) {
+            auto snapshot = single.snapshot();
+            sum += static_cast<long long>(snapshot.stationCount());
+        }
+        sink = sum;
+    });
+    suite.run("versioned/snapshot-traverse", size_t(stations), size_t(stations) * 16, [&] {
+        auto snapshot = single.snapshot();
+        long long sum = 0;
+        for (size_t s = 0; s < snapshot.stationCount(); ++s) {
+            for (const auto* platform : snapshot.station(s).getPlatforms()) {
+                for (const auto* line : platform->getLines()) sum += static_cast<long long>(line->getSchedules().size());
+            }
+        }
+        sink = sum;
+    });
+}
+
+// Loading a trusted timetable (dense lines of 144 trains, 1% of rows
+// aimed at conflicts) with the per-row check, and unchecked with one audit
+// at the end; then the audit alone on one thread and on every core
+void benchDeferredImport(BenchSuite& suite, int stations) {
+    WorkloadShape shape;
+    shape.stations = stations;
+    shape.trains = 144;
+    shape.conflictPercent = 1;
+    shape.seed = 3;
+    string text;
+    {
+        OutputBuffer out(text);
+        WorkloadGenerator(shape).writeImport<int>(out);
+    }
+    ostringstream errors;
+    RailwaySystem<int> checked;
+    suite.run("import/checked", shape.trainRows(), shape.trainRows(), [&] {
+        sink = static_cast<long long>(TimetableImporter<int>(checked, errors).importBuffer(text).rejected);
+    });
+    RailwaySystem<int> deferred;
+    suite.run("import/deferred+audit", shape.trainRows(), shape.trainRows(), [&] {
+        TimetableImporter<int> importer(deferred, errors);
+        importer.deferChecks();
+        sink = static_cast<long long>(importer.importBuffer(text).conflicts);
+    });
+
+    RailwaySystem<int> loaded;
+    TimetableImporter<int> importer(loaded, errors);
+    importer.deferChecks();
+    importer.importBuffer(text);
+    suite.run("audit/one-thread", shape.trainRows(), shape.trainRows(), [&] {
+        sink = static_cast<long long>(auditConflicts(loaded, 1).conflicts.size());
+    });
+    suite.run("audit/all-cores", shape.trainRows(), shape.trainRows(), [&] {
+        sink = static_cast<long long>(auditConflicts(loaded).conflicts.size());
+    });
+}
+
+int main(int argc, char* argv[]) {
+    string output = "bench_results.json";
+    string label = "unlabelled";
+    string filter;
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--label" && i + 1 < argc) {
+            label = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--quick") {
+            quick = true;
+        } else {
+            cerr << "Usage: " << argv[0] << " [--quick] [--filter <name>] [--label <text>] [--output <file>]\n";
+            return 1;
+        }
+    }
+
+    BenchSuite suite(filter);
+    for (int trains : {16, 48, 144}) {
+        benchLine(suite, trains);
+    }
+    benchWeeklyLine(suite);
+    for (int platforms : {2, 8, 32}) {
+        benchSlotQueries(suite, platforms);
+    }
+    for (int platforms : {2, 8, 32}) {
+        benchBoards(suite, platforms);
+    }
+    for (int conflictPercent : {10, 50, 90}) {
+        benchConflictHeavyInserts(suite, conflictPercent);
+    }
+    vector<NetworkShape> shapes = {{100, 4, 4, 24}, {1000, 4, 4, 24}};
+    if (!quick) shapes.push_back({10000, 4, 4, 24});
+    for (const auto& shape : shapes) {
+        auto railway = buildNetwork(shape);
+        benchLookups(suite, *railway, shape);
+        benchBulkAdds(suite, shape.stations);
+        benchDisplay(suite, *railway, shape);
+        benchFlatStorage(suite, *railway, shape);
+    }
+    for (int stations : {1000, 5000}) {
+        benchJourneys(suite, stations);
+    }
+    for (size_t requests : {1000, 10000}) {
+        benchAssignment(suite, requests);
+    }
+    for (int stations : {100, 1000}) {
+        benchVersioned(suite, stations);
+    }
+    for (int stations : {100, 1000}) {
+        benchDeferredImport(suite, stations);
+    }
+    suite.printScaling();
+    suite.writeJson(output, label);
+    cout << "\nResults written to " << output << "\n";
+    return 0;
+}
@@ -0,0 +1,206 @@
+// railway_concurrent.h
+#pragma once
+#include "railway.h"
+#include "railway_report.h"
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+
+// Thread-safe front end over a RailwaySystem
+//
+// Locking is layered and always taken in the same order:
+//   1. stationsLock  - the station set (exclusive only to add a station)
+//   2. station stripe - platforms and lines of one station
+//                       (exclusive only to add platforms or lines)
+//   3. line stripe    - schedules of one line
+//                       (exclusive only while a train is inserted,
+//                       removed or rescheduled)
+// Station and line locks are striped by node address, so writers on
+// different stations or lines run in parallel while readers hold each
+// lock shared and never see a half-inserted schedule.
+template<typename T>
+class ConcurrentRailwaySystem {
+private:
+    static constexpr size_t STATION_STRIPES = 64;
+    static constexpr size_t LINE_STRIPES = 256;
+
+    RailwaySystem<T> railway;
+    mutable shared_mutex stationsLock;
+    mutable array<shared_mutex, STATION_STRIPES> stationLocks;
+    mutable array<shared_mutex, LINE_STRIPES> lineLocks;
+
+    static size_t stripe(const void* node, size_t stripes) {
+        uint64_t bits = reinterpret_cast<uintptr_t>(node);
+        return static_cast<size_t>((bits * 0x9E3779B97F4A7C15ULL) >> 32) % stripes;
+    }
+
+    shared_mutex& stationLock(const void* station) const {
+        return stationLocks[stripe(station, STATION_STRIPES)];
+    }
+
+    shared_mutex& lineLock(const Line* line) const {
+        return lineLocks[stripe(line, LINE_STRIPES)];
+    }
+
+    template<typename System>
+    static auto& requireStation(System& system, LookupKey<T> id) {
+        auto* station = system.findStation(id);
+        if (!station) {
+            throw RailwayException("Station not found");
+        }
+        return *station;
+    }
+
+    template<typename Station>
+    static auto& requireLine(Station& station, int platformNumber, int lineNumber) {
+        auto* platform = station.findPlatform(platformNumber);
+        if (!platform) {
+            throw RailwayException("Platform not found");
+        }
+        auto* line = platform->findLine(lineNumber);
+        if (!line) {
+            throw RailwayException("Line not found on this platform");
+        }
+        return *line;
+    }
+
+public:
+    void addStation(T id, string name) {
+        unique_lock<shared_mutex> lock(stationsLock);
+        railway.addStation(move(id), move(name));
+    }
+
+    void addPlatforms(LookupKey<T> id, const vector<int>& platformNumbers) {
+        shared_lock<shared_mutex> systemLock(stationsLock);
+        auto& station = requireStation(railway, id);
+        unique_lock<shared_mutex> lock(stationLock(&station));
+        station.addPlatforms(platformNumbers);
+    }
+
+    void addLines(LookupKey<T> id, int platformNumber, const vector<int>& lineNumbers) {
+        shared_lock<shared_mutex> systemLock(stationsLock);
+        auto& station = requireStation(railway, id);
+        unique_lock<shared_mutex> lock(stationLock(&station));
+        auto* platform = station.findPlatform(platformNumber);
+        if (!platform) {
+            throw RailwayException("Platform not found");
+        }
+        platform->addLines(lineNumbers);
+    }
+
+    AddResult tryAddTrainSchedule(LookupKey<T> id, int platformNumber, int lineNumber,
+                                  const Time& time, TrainClass trainClass, DayMask days = DayMask()) {
+        RAILWAY_TIMED(AddTrainSchedule);
+        shared_lock<shared_mutex> systemLock(stationsLock);
+        auto* station = railway.findStation(id);
+        if (!station) {
+            return AddResult(AddStatus::StationNotFound);
+        }
+        shared_lock<shared_mutex> structureLock(stationLock(station));
+        auto* platform = station->findPlatform(platformNumber);
+        if (!platform) {
+            return AddResult(AddStatus::PlatformNotFound);
+        }
+        auto* line = platform->findLine(lineNumber);
+        if (!line) {
+            return AddResult(AddStatus::LineNotFound);
+        }
+        unique_lock<shared_mutex> lock(lineLock(line));
+        AddResult result = line->tryAddTrain(time, trainClass, days);
+        if (result) result.handle.platformNumber = platformNumber;
+        return result;
+    }
+
+    // Handles from tryAddTrainSchedule; the train is found and changed
+    // under its line's write lock, like an insert
+    bool removeTrain(LookupKey<T> id, const TrainHandle& handle) {
+        shared_lock<shared_mutex> systemLock(stationsLock);
+        auto* station = railway.findStation(id);
+        if (!station) return false;
+        shared_lock<shared_mutex> structureLock(stationLock(station));
+        auto* platform = station->findPlatform(handle.platformNumber);
+        auto* line = platform ? platform->findLine(handle.lineNumber) : nullptr;
+        if (!line) return false;
+        unique_lock<shared_mutex> lock(lineLock(line));
+        return line->removeTrain(handle.train);
+    }
+
+    AddResult rescheduleTrain(LookupKey<T> id, const TrainHandle& handle, const Time& time, TrainClass trainClass,
+                              DayMask days = DayMask()) {
+        shared_lock<shared_mutex> systemLock(stationsLock);
+        auto* station = railway.findStation(id);
+        if (!station) {
+            return AddResult(AddStatus::StationNotFound);
+        }
+        shared_lock<shared_mutex> structureLock(stationLock(station));
+        auto* platform = station->findPlatform(handle.platformNumber);
+        if (!platform) {
+            return AddResult(AddStatus::PlatformNotFound);
+        }
+        auto* line = platform->findLine(handle.lineNumber);
+        if (!line) {
+            return AddResult(AddStatus::LineNotFound);
+        }
+        unique_lock<shared_mutex> lock(lineLock(line));
+        AddResult result = line->rescheduleTrain(handle.train, time, trainClass, days);
+        if (result) result.handle.platformNumber = handle.platformNumber;
+        return result;
+    }
+
+    void addTrainSchedule(LookupKey<T> id, int platformNumber, int lineNumber, const Time& time, TrainClass trainClass,
+                          DayMask days = DayMask()) {
+        AddResult result = tryAddTrainSchedule(id, platformNumber, lineNumber, time, trainClass, days);
+        if (!result) {
+            throwAddFailure(result);
+        }
+    }
+
+    bool hasStation(LookupKey<T> id) const {
+        shared_lock<shared_mutex> systemLock(stationsLock);
+        return railway.findStation(id) != nullptr;
+    }
+
+    // Copy of one line's schedules, taken atomically with respect to inserts
+    vector<TrainSchedule> getSchedules(LookupKey<T> id, int platformNumber, int lineNumber) const {
+        shared_lock<shared_mutex> systemLock(stationsLock);
+        const auto& station = requireStation(railway, id);
+        shared_lock<shared_mutex> structureLock(stationLock(&station));
+        const auto& line = requireLine(station, platformNumber, lineNumber);
+        shared_lock<shared_mutex> lock(lineLock(&line));
+        return line.getSchedules();
+    }
+
+    // Renders a report while inserts continue; each line is written under
+    // its read lock, so every line appears either before or after any
+    // concurrent insert into it.
+    void writeReport(ReportWriter<T>& writer) const {
+        shared_lock<shared_mutex> systemLock(stationsLock);
+        writer.writeHeader(railway.getStations().empty());
+        for (const auto& station : railway.getStations()) {
+            if (!writer.includesStation(*station)) continue;
+            shared_lock<shared_mutex> structureLock(stationLock(station.get()));
+            writer.writeStationHeader(*station);
+            for (const auto& platform : station->getPlatforms()) {
+                if (!writer.includesPlatform(*platform)) continue;
+                writer.writePlatformHeader(*platform);
+                for (const auto& line : platform->getLines()) {
+                    shared_lock<shared_mutex> lock(lineLock(line.get()));
+                    writer.writeLine(*station, *platform, *line);
+                }
+            }
+        }
+    }
+
+    void displayAllStations() const {
+        RAILWAY_TIMED(Display);
+        cout.flush();
+        OutputBuffer out(STDOUT_FILENO);
+        ReportWriter<T> writer(out, ReportFormat::Table);
+        writeReport(writer);
+    }
+
+    // Direct access for single-threaded phases (setup, snapshots); callers
+    // must make sure no other thread is using the system meanwhile.
+    RailwaySystem<T>& unsynchronized() { return railway; }
+};
@@ -0,0 +1,189 @@
+// railway_flat.h
+#pragma once
+#include "railway.h"
+#include <cstdint>
+
+// Flat, read-optimised copy of a RailwaySystem
+//
+// Stations, platforms, lines and schedules each live in one contiguous
+// array. Children of a node occupy a contiguous index range in the next
+// array, and every child records its parent's index, so walking the whole
+// network is a linear pass over four arrays instead of a pointer chase per
+// node. The layout is built by compacting a RailwaySystem and is read-only;
+// keep adding through RailwaySystem and rebuild when a fresh view is needed.
+
+// Non-owning view of a run of schedules
+class ScheduleSpan {
+private:
+    const TrainSchedule* first;
+    size_t count;
+
+public:
+    ScheduleSpan(const TrainSchedule* data = nullptr, size_t size = 0) : first(data), count(size) {}
+
+    const TrainSchedule* begin() const { return first; }
+    const TrainSchedule* end() const { return first + count; }
+    const TrainSchedule& operator[](size_t i) const { return first[i]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+};
+
+template<typename T>
+class FlatRailwayNetwork {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct StationNode {
+        T id;
+        string name;
+        uint32_t firstPlatform;
+        uint32_t platformCount;
+    };
+
+    struct PlatformNode {
+        int number;
+        uint32_t station;
+        uint32_t firstLine;
+        uint32_t lineCount;
+    };
+
+    struct LineNode {
+        int number;
+        uint32_t platform;
+        uint32_t firstSchedule;
+        uint32_t scheduleCount;
+    };
+
+    class LineRef {
+    private:
+        const FlatRailwayNetwork* network;
+        uint32_t index;
+
+    public:
+        LineRef(const FlatRailwayNetwork* net = nullptr, uint32_t i = NONE) : network(net), index(i) {}
+
+        explicit operator bool() const { return index != NONE; }
+        uint32_t getIndex() const { return index; }
+        int getLineNumber() const { return network->lines[index].number; }
+
+        ScheduleSpan getSchedules() const {
+            const auto& node = network->lines[index];
+            return ScheduleSpan(network->schedules.data() + node.firstSchedule, node.scheduleCount);
+        }
+    };
+
+    class PlatformRef {
+    private:
+        const FlatRailwayNetwork* network;
+        uint32_t index;
+
+    public:
+        PlatformRef(const FlatRailwayNetwork* net = nullptr, uint32_t i = NONE) : network(net), index(i) {}
+
+        explicit operator bool() const { return index != NONE; }
+        uint32_t getIndex() const { return index; }
+        int getPlatformNumber() const { return network->platforms[index].number; }
+        size_t lineCount() const { return network->platforms[index].lineCount; }
+        LineRef line(size_t i) const { return LineRef(network, network->platforms[index].firstLine + i); }
+
+        // Lines of one platform are few and adjacent, so a scan beats hashing
+        LineRef findLine(int lineNumber) const {
+            const auto& node = network->platforms[index];
+            for (uint32_t i = node.firstLine; i < node.firstLine + node.lineCount; ++i) {
+                if (network->lines[i].number == lineNumber) return LineRef(network, i);
+            }
+            return LineRef(network);
+        }
+    };
+
+    class StationRef {
+    private:
+        const FlatRailwayNetwork* network;
+        uint32_t index;
+
+    public:
+        StationRef(const FlatRailwayNetwork* net = nullptr, uint32_t i = NONE) : network(net), index(i) {}
+
+        explicit operator bool() const { return index != NONE; }
+        uint32_t getIndex() const { return index; }
+        const T& getId() const { return network->stations[index].id; }
+        const string& getName() const { return network->stations[index].name; }
+        size_t platformCount() const { return network->stations[index].platformCount; }
+
+        PlatformRef platform(size_t i) const {
+            return PlatformRef(network, network->stations[index].firstPlatform + i);
+        }
+
+        PlatformRef findPlatform(int platformNumber) const {
+            const auto& node = network->stations[index];
+            for (uint32_t i = node.firstPlatform; i < node.firstPlatform + node.platformCount; ++i) {
+                if (network->platforms[i].number == platformNumber) return PlatformRef(network, i);
+            }
+            return PlatformRef(network);
+        }
+    };
+
+private:
+    vector<StationNode> stations;
+    vector<PlatformNode> platforms;
+    vector<LineNode> lines;
+    vector<TrainSchedule> schedules;
+    IdIndex<T, const StationNode> stationIndex;
+
+public:
+    explicit FlatRailwayNetwork(const RailwaySystem<T>& railway) {
+        size_t platformTotal = 0, lineTotal = 0, scheduleTotal = 0;
+        for (const auto& station : railway.getStations()) {
+            platformTotal += station->getPlatforms().size();
+            for (const auto& platform : station->getPlatforms()) {
+                lineTotal += platform->getLines().size();
+                for (const auto& line : platform->getLines()) {
+                    scheduleTotal += line->getSchedules().size();
+                }
+            }
+        }
+        stations.reserve(railway.getStations().size());
+        platforms.reserve(platformTotal);
+        lines.reserve(lineTotal);
+        schedules.reserve(scheduleTotal);
+
+        for (const auto& station : railway.getStations()) {
+            uint32_t stationIndexValue = static_cast<uint32_t>(stations.size());
+            stations.push_back({station->getId(), station->getName(),
+                                static_cast<uint32_t>(platforms.size()),
+                                static_cast<uint32_t>(station->getPlatforms().size())});
+            for (const auto& platform : station->getPlatforms()) {
+                uint32_t platformIndexValue = static_cast<uint32_t>(platforms.size());
+                platforms.push_back({platform->getPlatformNumber(), stationIndexValue,
+                                     static_cast<uint32_t>(lines.size()),
+                                     static_cast<uint32_t>(platform->getLines().size())});
+                for (const auto& line : platform->getLines()) {
+                    const auto& lineSchedules = line->getSchedules();
+                    lines.push_back({line->getLineNumber(), platformIndexValue,
+                                     static_cast<uint32_t>(schedules.size()),
+                                     static_cast<uint32_t>(lineSchedules.size())});
+                    schedules.insert(schedules.end(), lineSchedules.begin(), lineSchedules.end());
+                }
+            }
+        }
+        // Node addresses are stable from here on
+        for (const auto& station : stations) {
+            stationIndex.insert(station.id, &station);
+        }
+    }
+
+    FlatRailwayNetwork(const FlatRailwayNetwork&) = delete;
+    FlatRailwayNetwork& operator=(const FlatRailwayNetwork&) = delete;
+
+    StationRef findStation(LookupKey<T> id) const {
+        const StationNode* node = stationIndex.find(id);
+        return node ? StationRef(this, static_cast<uint32_t>(node - stations.data())) : StationRef(this);
+    }
+
+    StationRef station(size_t i) const { return StationRef(this, static_cast<uint32_t>(i)); }
+
+    const vector<StationNode>& getStationNodes() const { return stations; }
+    const vector<PlatformNode>& getPlatformNodes() const { return platforms; }
+    const vector<LineNode>& getLineNodes() const { return lines; }
+    const vector<TrainSchedule>& getAllSchedules() const { return schedules; }
+};
@@ -0,0 +1,487 @@
+// railway_import.h
+#pragma once
+#include "railway.h"
+#include "railway_audit.h"
+#include "railway_journal.h"
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+
+// Bulk timetable import
+//
+// One record per row, fields separated by commas (or tabs when the row
+// contains a tab). Blank rows and rows starting with '#' are ignored.
+//
+//   STATION,<id>,<name>
+//   PLATFORMS,<station id>,<platform>[,<platform>...]
+//   LINES,<station id>,<platform>,<line>[,<line>...]
+//   TRAIN,<station id>,<platform>,<line>,<HH:MM>,<S|T|class>[,<days>]
+//   HEADWAYS,<station id>,<platform>,<line>,<table>
+//
+// HEADWAYS adds a line with its own headway table (see parseHeadways) and
+// is only accepted by importers over a RuntimeHeadways network. A train's
+// class may also be given as a number (0 through, 1 stopping, higher
+// classes where the line's table has them).
+// <days> is daily (the default), weekdays, weekends, a day name (Mon ...
+// Sun) or a "MTWTFSS" pattern with '-' for days off, e.g. MTWTF--.
+//
+// Rows are parsed in place as string_views over the read buffer; a
+// rejected row is reported with its line number and the load continues.
+//
+// With checks deferred, train rows are only parsed and collected per
+// line. When the import finishes each line takes its rows in one
+// appendUnchecked call and the whole network is audited once; every
+// conflicting pair is reported (the trains stay) and counted.
+
+struct ImportStats {
+    size_t rows = 0;
+    size_t accepted = 0;
+    size_t rejected = 0;
+    size_t conflicts = 0;  // pairs found by the audit after a deferred import
+    double seconds = 0.0;
+
+    double rowsPerSecond() const { return seconds > 0.0 ? rows / seconds : 0.0; }
+};
+
+// Splits one row into fields without copying
+class FieldCursor {
+private:
+    string_view rest;
+    char delimiter;
+    bool exhausted;
+
+public:
+    explicit FieldCursor(string_view row)
+        : rest(row), delimiter(row.find('\t') != string_view::npos ? '\t' : ','),
+          exhausted(row.empty()) {}
+
+    bool next(string_view& field) {
+        if (exhausted) return false;
+        size_t pos = rest.find(delimiter);
+        if (pos == string_view::npos) {
+            field = rest;
+            exhausted = true;
+        } else {
+            field = rest.substr(0, pos);
+            rest.remove_prefix(pos + 1);
+        }
+        return true;
+    }
+
+    string_view require(const char* what) {
+        string_view field;
+        if (!next(field) || field.empty()) {
+            throw RailwayException(string("Missing ") + what);
+        }
+        return field;
+    }
+
+    bool done() const { return exhausted; }
+};
+
+inline int parseNumber(string_view field, const char* what) {
+    int value = 0;
+    auto result = from_chars(field.data(), field.data() + field.size(), value);
+    if (result.ec != errc() || result.ptr != field.data() + field.size()) {
+        throw RailwayException(string("Invalid ") + what + " '" + string(field) + "'");
+    }
+    return value;
+}
+
+inline Time parseTime(string_view field) {
+    size_t colon = field.find(':');
+    if (colon == string_view::npos) {
+        throw RailwayException("Invalid time '" + string(field) + "'");
+    }
+    return Time(parseNumber(field.substr(0, colon), "hours"),
+                parseNumber(field.substr(colon + 1), "minutes"));
+}
+
+inline bool parseTrainType(string_view field) {
+    if (field == "S" || field == "s") return true;
+    if (field == "T" || field == "t") return false;
+    throw RailwayException("Invalid train type '" + string(field) + "'");
+}
+
+// S, T or a class number
+inline TrainClass parseTrainClass(string_view field) {
+    if (!field.empty() && field[0] >= '0' && field[0] <= '9') {
+        int trainClass = parseNumber(field, "train class");
+        if (trainClass > UINT8_MAX) {
+            throw RailwayException("Invalid train class '" + string(field) + "'");
+        }
+        return static_cast<TrainClass>(trainClass);
+    }
+    return parseTrainType(field);
+}
+
+inline DayMask parseDays(string_view field) {
+    static const char* const names[] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+    static const char letters[] = "MTWTFSS";
+    if (field == "daily") return DayMask::daily();
+    if (field == "weekdays") return DayMask::weekdays();
+    if (field == "weekends") return DayMask::weekends();
+    for (int day = 0; day < DayMask::DAYS; ++day) {
+        if (field == names[day]) return DayMask::only(day);
+    }
+    if (field.size() == static_cast<size_t>(DayMask::DAYS)) {
+        uint8_t bits = 0;
+        for (int day = 0; day < DayMask::DAYS; ++day) {
+            if (field[day] == letters[day]) {
+                bits |= static_cast<uint8_t>(1 << day);
+            } else if (field[day] != '-') {
+                bits = 0xFF;
+                break;
+            }
+        }
+        if (bits != 0 && bits <= DayMask::ALL) return DayMask(bits);
+    }
+    throw RailwayException("Invalid days '" + string(field) + "'");
+}
+
+// Headway table for a RuntimeHeadways line, one row per train class:
+// "10 30; 30 30" is the standard through/stopping table
+inline RuntimeHeadways parseHeadways(string_view field) {
+    vector<vector<int>> rows;
+    while (!field.empty()) {
+        size_t end = field.find(';');
+        string_view row = field.substr(0, end);
+        field.remove_prefix(end == string_view::npos ? field.size() : end + 1);
+        rows.emplace_back();
+        while (true) {
+            size_t start = row.find_first_not_of(" \t");
+            if (start == string_view::npos) break;
+            row.remove_prefix(start);
+            size_t stop = row.find_first_of(" \t");
+            rows.back().push_back(parseNumber(row.substr(0, stop), "headway"));
+            row.remove_prefix(stop == string_view::npos ? row.size() : stop);
+        }
+    }
+    return RuntimeHeadways(rows);
+}
+
+// Conflict detail for error messages: "23:50 stopping train" plus the
+// days when the train does not run daily
+inline string describeTrain(const TrainSchedule& schedule) {
+    string text = schedule.time.toString();
+    if (schedule.trainClass == STOPPING_TRAIN) {
+        text += " stopping train";
+    } else if (schedule.trainClass == THROUGH_TRAIN) {
+        text += " through train";
+    } else {
+        text += " class " + to_string(schedule.trainClass) + " train";
+    }
+    if (!schedule.days.isDaily()) {
+        text += ", " + schedule.days.toString();
+    }
+    return text;
+}
+
+template<typename T>
+T parseStationId(string_view field) {
+    if constexpr (is_same<T, string>::value) {
+        return string(field);
+    } else if constexpr (is_integral<T>::value) {
+        T value{};
+        auto result = from_chars(field.data(), field.data() + field.size(), value);
+        if (result.ec != errc() || result.ptr != field.data() + field.size()) {
+            throw RailwayException("Invalid station ID '" + string(field) + "'");
+        }
+        return value;
+    } else {
+        static_assert(is_same<T, string>::value || is_integral<T>::value,
+                      "Timetable import supports string and integral station IDs");
+    }
+}
+
+// Lookup form of a station ID field: string IDs stay a view of the input
+template<typename T>
+auto parseStationKey(string_view field) {
+    if constexpr (is_same<T, string>::value) {
+        return field;
+    } else {
+        return parseStationId<T>(field);
+    }
+}
+
+template<typename T, typename Policy = StandardHeadways>
+class TimetableImporter {
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+    static constexpr bool JOURNALED = is_same<Policy, StandardHeadways>::value;
+
+    using Station = RailwayStation<T, Policy>;
+    using LineNode = BasicLine<Policy>;
+
+    RailwaySystem<T, Policy>& railway;
+    ostream& errors;
+    RailwayJournal<T>* journal;
+    ImportStats stats;
+    size_t lineNumber = 0;
+    bool deferred = false;
+    unsigned auditThreads = 0;
+    unordered_map<LineNode*, vector<TrainSchedule>> pendingTrains;
+    LineNode* lastLine = nullptr;  // rows usually arrive grouped by line
+    vector<TrainSchedule>* lastPending = nullptr;
+
+    Station& requireStation(FieldCursor& fields) {
+        auto* station = railway.findStation(parseStationKey<T>(fields.require("station ID")));
+        if (!station) {
+            throw RailwayException("Station not found");
+        }
+        return *station;
+    }
+
+    void reject(const char* message) {
+        ++stats.rejected;
+        errors << "line " << lineNumber << ": " << message;
+    }
+
+    // Returns false when the row was rejected and already reported. Train
+    // rows, the bulk of any timetable, go through the non-throwing insert.
+    bool applyRow(string_view row) {
+        FieldCursor fields(row);
+        string_view kind = fields.require("record type");
+
+        if (kind == "STATION") {
+            T id = parseStationId<T>(fields.require("station ID"));
+            string_view name = fields.require("station name");
+            if (!fields.done()) {
+                throw RailwayException("Too many fields");
+            }
+            if constexpr (JOURNALED) {
+                if (journal) {
+                    journal->addStation(move(id), string(name));
+                    return true;
+                }
+            }
+            railway.addStation(move(id), string(name));
+        } else if (kind == "PLATFORMS") {
+            auto& station = requireStation(fields);
+            vector<int> numbers;
+            string_view field;
+            while (fields.next(field)) {
+                numbers.push_back(parseNumber(field, "platform number"));
+            }
+            if constexpr (JOURNALED) {
+                if (journal) {
+                    journal->addPlatforms(station, numbers);
+                    return true;
+                }
+            }
+            station.addPlatforms(numbers);
+        } else if (kind == "LINES") {
+            auto& station = requireStation(fields);
+            auto* platform = station.findPlatform(parseNumber(fields.require("platform"), "platform number"));
+            if (!platform) {
+                throw RailwayException("Platform not found");
+            }
+            vector<int> numbers;
+            string_view field;
+            while (fields.next(field)) {
+                numbers.push_back(parseNumber(field, "line number"));
+            }
+            if constexpr (JOURNALED) {
+                if (journal) {
+                    journal->addLines(station, *platform, numbers);
+                    return true;
+                }
+            }
+            platform->addLines(numbers);
+        } else if (kind == "HEADWAYS") {
+            if constexpr (is_same<Policy, RuntimeHeadways>::value) {
+                auto& station = requireStation(fields);
+                auto* platform = station.findPlatform(parseNumber(fields.require("platform"), "platform number"));
+                if (!platform) {
+                    throw RailwayException("Platform not found");
+                }
+                int number = parseNumber(fields.require("line"), "line number");
+                RuntimeHeadways headways = parseHeadways(fields.require("headway table"));
+                if (!fields.done()) {
+                    throw RailwayException("Too many fields");
+                }
+                platform->addLine(number, move(headways));
+            } else {
+                throw RailwayException("Headway tables need a RuntimeHeadways network");
+            }
+        } else if (kind == "TRAIN") {
+            auto& station = requireStation(fields);
+            int platformNumber = parseNumber(fields.require("platform"), "platform number");
+            int trainLine = parseNumber(fields.require("line"), "line number");
+            Time time = parseTime(fields.require("time"));
+            TrainClass trainClass = parseTrainClass(fields.require("train type"));
+            string_view field;
+            DayMask days = fields.next(field) ? parseDays(field) : DayMask::daily();
+            if (!fields.done()) {
+                throw RailwayException("Too many fields");
+            }
+            if (deferred) {
+                auto* platform = station.findPlatform(platformNumber);
+                auto* line = platform ? platform->findLine(trainLine) : nullptr;
+                AddStatus status = !platform ? AddStatus::PlatformNotFound
+                                 : !line ? AddStatus::LineNotFound
+                                 : trainClass >= line->getPolicy().classCount() ? AddStatus::InvalidTrainClass
+                                 : AddStatus::Added;
+                if (status != AddStatus::Added) {
+                    reject(describe(status));
+                    errors << "\n";
+                    return false;
+                }
+                if (line != lastLine) {
+                    lastLine = line;
+                    lastPending = &pendingTrains[line];
+                }
+                lastPending->emplace_back(time, trainClass, days);
+                return true;
+            }
+            AddResult result(AddStatus::InvalidTrainClass);
+            if constexpr (JOURNALED) {
+                if (journal) {
+                    // Journal records carry the stopping flag only
+                    if (trainClass <= STOPPING_TRAIN) {
+                        result = journal->tryAddTrainSchedule(station, platformNumber, trainLine, time,
+                                                              trainClass == STOPPING_TRAIN, days);
+                    }
+                } else {
+                    result = station.tryAddTrainSchedule(platformNumber, trainLine, time, trainClass, days);
+                }
+            } else {
+                result = station.tryAddTrainSchedule(platformNumber, trainLine, time, trainClass, days);
+            }
+            if (!result) {
+                reject(describe(result.status));
+                if (result.status == AddStatus::Conflict) {
+                    errors << " (" << describeTrain(result.conflict) << ")";
+                }
+                errors << "\n";
+                return false;
+            }
+        } else {
+            throw RailwayException("Unknown record type '" + string(kind) + "'");
+        }
+        return true;
+    }
+
+    void processRow(string_view row) {
+        ++lineNumber;
+        if (!row.empty() && row.back() == '\r') {
+            row.remove_suffix(1);
+        }
+        if (row.empty() || row.front() == '#') {
+            return;
+        }
+        ++stats.rows;
+        try {
+            if (applyRow(row)) {
+                ++stats.accepted;
+            }
+        } catch (const RailwayException& e) {
+            reject(e.what());
+            errors << "\n";
+        }
+    }
+
+    // Applies every complete row in data and returns the bytes consumed.
+    // With final set, a trailing row without a newline is applied as well.
+    size_t processBuffer(const char* data, size_t size, bool final) {
+        size_t start = 0;
+        while (start < size) {
+            const void* newline = memchr(data + start, '\n', size - start);
+            if (!newline) {
+                if (final) {
+                    processRow(string_view(data + start, size - start));
+                    start = size;
+                }
+                break;
+            }
+            size_t end = static_cast<const char*>(newline) - data;
+            processRow(string_view(data + start, end - start));
+            start = end + 1;
+        }
+        return start;
+    }
+
+    void finish() {
+        if constexpr (JOURNALED) {
+            if (journal) journal->commit();
+        }
+        if (!deferred) return;
+        for (auto& entry : pendingTrains) {
+            entry.first->appendUnchecked(entry.second);
+        }
+        pendingTrains.clear();
+        lastLine = nullptr;
+        auto audit = auditConflicts(railway, auditThreads);
+        for (const auto& conflict : audit.conflicts) {
+            errors << "conflict at station " << conflict.station->getId() << " platform "
+                   << conflict.pair.first.platformNumber << " line " << conflict.pair.first.lineNumber << ": "
+                   << describeTrain(conflict.pair.firstSchedule) << " and "
+                   << describeTrain(conflict.pair.secondSchedule) << "\n";
+        }
+        stats.conflicts += audit.conflicts.size();
+    }
+
+public:
+    // With a journal, every accepted row is journaled and committed once
+    // the import finishes.
+    TimetableImporter(RailwaySystem<T, Policy>& system, ostream& errorStream,
+                      RailwayJournal<T>* mutationJournal = nullptr)
+        : railway(system), errors(errorStream), journal(mutationJournal) {
+        if (journal && !JOURNALED) {
+            throw RailwayException("Only standard-headway networks can be journaled");
+        }
+    }
+
+    ImportStats importBuffer(string_view text) {
+        auto begin = chrono::steady_clock::now();
+        processBuffer(text.data(), text.size(), true);
+        finish();
+        stats.seconds += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        return stats;
+    }
+
+    ImportStats importFile(const string& path) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            throw RailwayException("Cannot open import file '" + path + "'");
+        }
+        auto begin = chrono::steady_clock::now();
+        vector<char> buffer(BUFFER_SIZE);
+        size_t filled = 0;
+        while (true) {
+            if (filled == buffer.size()) {
+                buffer.resize(buffer.size() * 2);  // a single row larger than the buffer
+            }
+            size_t count = fread(buffer.data() + filled, 1, buffer.size() - filled, file);
+            filled += count;
+            bool final = count == 0;
+            size_t consumed = processBuffer(buffer.data(), filled, final);
+            memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+            filled -= consumed;
+            if (final) break;
+        }
+        bool failed = ferror(file) != 0;
+        fclose(file);
+        if (failed) {
+            throw RailwayException("Error reading import file '" + path + "'");
+        }
+        finish();
+        stats.seconds += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        return stats;
+    }
+
+    // Loads train rows unchecked and audits the network at the end of each
+    // import (threads = 0 uses every core). Cannot be journaled: replay
+    // relies on every journaled train having passed the check.
+    void deferChecks(unsigned threads = 0) {
+        if (journal) {
+            throw RailwayException("Deferred checks cannot be combined with a journal");
+        }
+        deferred = true;
+        auditThreads = threads;
+    }
+
+    const ImportStats& getStats() const { return stats; }
+};
@@ -0,0 +1,400 @@
+// railway_journal.h
+#pragma once
+#include "railway.h"
+#include "railway_snapshot.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Append-only journal of applied mutations
+//
+// Layout (native byte order, no padding):
+//   header  char[8] magic "RWJRNL\0\0", u32 version, u32 snapshot generation
+//   record  u32 payload size, u32 FNV-1a checksum of the payload, payload
+//   payload u8 kind, station id, then per kind:
+//             STATION   name
+//             PLATFORM  i32 platform
+//             LINE      i32 platform, i32 line
+//             TRAIN     i32 platform, i32 line, schedule (as in snapshots)
+//             REMOVE    i32 platform, i32 line, schedule removed
+//             MOVE      i32 platform, i32 line, old schedule, new schedule
+//
+// Mutations are applied first and journaled only once accepted. Records
+// collect in memory and reach the disk with one write and one fdatasync
+// per commit (group commit); commit() runs at batch boundaries and
+// whenever the pending records pass GROUP_COMMIT_BYTES.
+//
+// Opening a journal replays it on top of the state loaded from the
+// snapshot of the same generation. Every record was validated when it was
+// written, so trains are appended without conflict checks; removed and
+// moved trains are found by their schedule, which is unique on a line
+// since two equal schedules always conflict. A torn record
+// at the tail (a crash mid-commit) ends the replay and is cut off. After a
+// checkpoint (snapshot saved with the next generation), reset() empties
+// the journal; a journal older than the snapshot is discarded on open.
+
+constexpr char JOURNAL_MAGIC[8] = {'R', 'W', 'J', 'R', 'N', 'L', '\0', '\0'};
+constexpr uint32_t JOURNAL_VERSION = 3;  // versions 1 (daily trains only) and 2 (no removals) still replay
+
+struct JournalReplay {
+    size_t records = 0;
+    size_t tornBytes = 0;  // discarded incomplete tail
+    bool stale = false;    // journal predates the snapshot and was dropped
+    double seconds = 0.0;
+};
+
+inline uint32_t journalChecksum(string_view bytes) {
+    uint32_t hash = 2166136261u;
+    for (char c : bytes) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+template<typename T>
+class RailwayJournal {
+private:
+    static constexpr size_t GROUP_COMMIT_BYTES = 1 << 16;
+    static constexpr size_t HEADER_SIZE = sizeof(JOURNAL_MAGIC) + 2 * sizeof(uint32_t);
+    static constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+    enum class RecordKind : uint8_t { Station = 1, Platform = 2, Line = 3, Train = 4, Remove = 5, Move = 6 };
+
+    RailwaySystem<T>& railway;
+    string path;
+    int fd = -1;
+    SnapshotWriter pending;
+    SnapshotWriter record;
+    JournalReplay replayed;
+
+    void fail(const string& what) const {
+        throw RailwayException(what + " journal '" + path + "': " + strerror(errno));
+    }
+
+    void writeAll(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                fail("Cannot write");
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    void writeHeader(uint32_t generation) {
+        SnapshotWriter header;
+        for (char c : JOURNAL_MAGIC) header.write<char>(c);
+        header.write<uint32_t>(JOURNAL_VERSION);
+        header.write<uint32_t>(generation);
+        if (ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0) {
+            fail("Cannot reset");
+        }
+        writeAll(header.getBuffer().data(), header.getBuffer().size());
+        if (fdatasync(fd) != 0) {
+            fail("Cannot sync");
+        }
+    }
+
+    void beginRecord(RecordKind kind, const T& id) {
+        record.clear();
+        record.write<uint8_t>(static_cast<uint8_t>(kind));
+        SnapshotCodec<T>::write(record, id);
+    }
+
+    void endRecord() {
+        const string& payload = record.getBuffer();
+        pending.write<uint32_t>(static_cast<uint32_t>(payload.size()));
+        pending.write<uint32_t>(journalChecksum(payload));
+        pending.writeRaw(payload);
+        if (pending.getBuffer().size() >= GROUP_COMMIT_BYTES) {
+            commit();
+        }
+    }
+
+    RailwayStation<T>& replayStation(SnapshotReader& reader) {
+        auto* station = railway.findStation(SnapshotCodec<T>::readKey(reader));
+        if (!station) {
+            throw RailwayException("Journal refers to an unknown station");
+        }
+        return *station;
+    }
+
+    static Platform& replayPlatform(RailwayStation<T>& station, SnapshotReader& reader) {
+        auto* platform = station.findPlatform(reader.read<int32_t>());
+        if (!platform) {
+            throw RailwayException("Journal refers to an unknown platform");
+        }
+        return *platform;
+    }
+
+    static TrainId replayTrain(const Line& line, SnapshotReader& reader) {
+        TrainId train = line.findTrain(readSchedule(reader));
+        if (train == NO_TRAIN) {
+            throw RailwayException("Journal refers to an unknown train");
+        }
+        return train;
+    }
+
+    void replayRecord(string_view payload) {
+        SnapshotReader reader(payload.data(), payload.size());
+        auto kind = static_cast<RecordKind>(reader.read<uint8_t>());
+        switch (kind) {
+            case RecordKind::Station: {
+                T id = SnapshotCodec<T>::read(reader);
+                railway.addStation(move(id), string(reader.readBytes()));
+                break;
+            }
+            case RecordKind::Platform: {
+                replayStation(reader).addPlatform(reader.read<int32_t>());
+                break;
+            }
+            case RecordKind::Line: {
+                auto& station = replayStation(reader);
+                replayPlatform(station, reader).addLine(reader.read<int32_t>());
+                break;
+            }
+            case RecordKind::Train: {
+                auto& station = replayStation(reader);
+                auto& platform = replayPlatform(station, reader);
+                auto* line = platform.findLine(reader.read<int32_t>());
+                if (!line) {
+                    throw RailwayException("Journal refers to an unknown line");
+                }
+                line->appendTrusted(readSchedule(reader));
+                break;
+            }
+            case RecordKind::Remove:
+            case RecordKind::Move: {
+                auto& station = replayStation(reader);
+                auto& platform = replayPlatform(station, reader);
+                auto* line = platform.findLine(reader.read<int32_t>());
+                if (!line) {
+                    throw RailwayException("Journal refers to an unknown line");
+                }
+                TrainId train = replayTrain(*line, reader);
+                if (kind == RecordKind::Remove) {
+                    line->removeTrain(train);
+                    break;
+                }
+                TrainSchedule moved = readSchedule(reader);
+                if (!line->rescheduleTrain(train, moved.time, moved.trainClass, moved.days)) {
+                    throw RailwayException("Journal moves a train into a conflict");
+                }
+                break;
+            }
+            default:
+                throw RailwayException("Journal holds an unknown record kind");
+        }
+        if (!reader.atEnd()) {
+            throw RailwayException("Journal record has trailing data");
+        }
+    }
+
+    // Applies every intact record and returns the offset where the valid
+    // part of the journal ends.
+    size_t replay(const char* data, size_t size) {
+        size_t offset = HEADER_SIZE;
+        while (size - offset >= RECORD_HEADER_SIZE) {
+            uint32_t payloadSize, checksum;
+            memcpy(&payloadSize, data + offset, sizeof(uint32_t));
+            memcpy(&checksum, data + offset + sizeof(uint32_t), sizeof(uint32_t));
+            if (payloadSize > size - offset - RECORD_HEADER_SIZE) break;
+            string_view payload(data + offset + RECORD_HEADER_SIZE, payloadSize);
+            if (journalChecksum(payload) != checksum) break;
+            replayRecord(payload);
+            ++replayed.records;
+            offset += RECORD_HEADER_SIZE + payloadSize;
+        }
+        return offset;
+    }
+
+    void open(uint32_t generation) {
+        auto begin = chrono::steady_clock::now();
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            fail("Cannot open");
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            fail("Cannot read");
+        }
+        size_t size = static_cast<size_t>(info.st_size);
+        if (size == 0) {
+            writeHeader(generation);
+            return;
+        }
+
+        vector<char> data(size);
+        size_t filled = 0;
+        while (filled < size) {
+            ssize_t count = ::pread(fd, data.data() + filled, size - filled, static_cast<off_t>(filled));
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) fail("Cannot read");
+            filled += static_cast<size_t>(count);
+        }
+
+        SnapshotReader header(data.data(), size);
+        for (char expected : JOURNAL_MAGIC) {
+            if (header.read<char>() != expected) {
+                throw RailwayException("Not a railway journal: '" + path + "'");
+            }
+        }
+        uint32_t version = header.read<uint32_t>();
+        if (version == 0 || version > JOURNAL_VERSION) {
+            throw RailwayException("Unsupported journal version " + to_string(version));
+        }
+        uint32_t journalGeneration = header.read<uint32_t>();
+        if (journalGeneration < generation) {
+            replayed.stale = true;
+            writeHeader(generation);
+            return;
+        }
+        if (journalGeneration > generation) {
+            throw RailwayException("Journal '" + path + "' is newer than the loaded snapshot");
+        }
+
+        size_t validEnd = replay(data.data(), size);
+        replayed.tornBytes = size - validEnd;
+        if (replayed.tornBytes > 0 && (ftruncate(fd, static_cast<off_t>(validEnd)) != 0 || fdatasync(fd) != 0)) {
+            fail("Cannot repair");
+        }
+        if (lseek(fd, 0, SEEK_END) < 0) {
+            fail("Cannot seek");
+        }
+        replayed.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    }
+
+public:
+    // Opens (creating if needed) the journal at path and replays it into
+    // system, which must hold the snapshot of the given generation.
+    RailwayJournal(RailwaySystem<T>& system, string journalPath, uint32_t generation = 0)
+        : railway(system), path(move(journalPath)) {
+        try {
+            open(generation);
+        } catch (...) {
+            if (fd >= 0) ::close(fd);
+            throw;
+        }
+    }
+
+    ~RailwayJournal() {
+        try {
+            commit();
+        } catch (const RailwayException&) {}
+        ::close(fd);
+    }
+
+    RailwayJournal(const RailwayJournal&) = delete;
+    RailwayJournal& operator=(const RailwayJournal&) = delete;
+
+    // Makes every mutation journaled so far durable
+    void commit() {
+        const string& data = pending.getBuffer();
+        if (data.empty()) return;
+        writeAll(data.data(), data.size());
+        if (fdatasync(fd) != 0) {
+            fail("Cannot sync");
+        }
+        pending.clear();
+    }
+
+    // Starts an empty journal on top of a freshly saved snapshot
+    void reset(uint32_t generation) {
+        pending.clear();
+        writeHeader(generation);
+    }
+
+    RailwayStation<T>* addStation(T id, string name) {
+        auto* station = railway.addStation(move(id), move(name));
+        beginRecord(RecordKind::Station, station->getId());
+        record.writeBytes(station->getName());
+        endRecord();
+        return station;
+    }
+
+    // Platforms and lines are journaled one by one, so a list rejected
+    // part-way still records exactly the ones that were added.
+    void addPlatforms(RailwayStation<T>& station, const vector<int>& platformNumbers) {
+        if (platformNumbers.empty()) {
+            throw RailwayException("No platform numbers provided");
+        }
+        for (int platformNumber : platformNumbers) {
+            station.addPlatform(platformNumber);
+            beginRecord(RecordKind::Platform, station.getId());
+            record.write<int32_t>(platformNumber);
+            endRecord();
+        }
+    }
+
+    void addLines(RailwayStation<T>& station, Platform& platform, const vector<int>& lineNumbers) {
+        if (lineNumbers.empty()) {
+            throw RailwayException("No line numbers provided");
+        }
+        for (int lineNumber : lineNumbers) {
+            platform.addLine(lineNumber);
+            beginRecord(RecordKind::Line, station.getId());
+            record.write<int32_t>(platform.getPlatformNumber());
+            record.write<int32_t>(lineNumber);
+            endRecord();
+        }
+    }
+
+    AddResult tryAddTrainSchedule(RailwayStation<T>& station, int platformNumber, int lineNumber,
+                                  const Time& time, bool isStoppingTrain, DayMask days = DayMask()) {
+        AddResult result = station.tryAddTrainSchedule(platformNumber, lineNumber, time, isStoppingTrain, days);
+        if (result) {
+            beginRecord(RecordKind::Train, station.getId());
+            record.write<int32_t>(platformNumber);
+            record.write<int32_t>(lineNumber);
+            writeSchedule(record, TrainSchedule(time, isStoppingTrain, days));
+            endRecord();
+        }
+        return result;
+    }
+
+    void addTrainSchedule(RailwayStation<T>& station, int platformNumber, int lineNumber,
+                          const Time& time, bool isStoppingTrain, DayMask days = DayMask()) {
+        AddResult result = tryAddTrainSchedule(station, platformNumber, lineNumber, time, isStoppingTrain, days);
+        if (!result) {
+            throwAddFailure(result);
+        }
+    }
+
+    bool removeTrain(RailwayStation<T>& station, const TrainHandle& handle) {
+        const TrainSchedule* found = station.findTrain(handle);
+        if (!found) return false;
+        TrainSchedule removed = *found;
+        station.removeTrain(handle);
+        beginRecord(RecordKind::Remove, station.getId());
+        record.write<int32_t>(handle.platformNumber);
+        record.write<int32_t>(handle.lineNumber);
+        writeSchedule(record, removed);
+        endRecord();
+        return true;
+    }
+
+    AddResult rescheduleTrain(RailwayStation<T>& station, const TrainHandle& handle, const Time& time,
+                              bool isStoppingTrain, DayMask days = DayMask()) {
+        const TrainSchedule* found = station.findTrain(handle);
+        TrainSchedule previous = found ? *found : TrainSchedule(Time(), THROUGH_TRAIN);
+        AddResult result = station.rescheduleTrain(handle, time, isStoppingTrain, days);
+        if (result) {
+            beginRecord(RecordKind::Move, station.getId());
+            record.write<int32_t>(handle.platformNumber);
+            record.write<int32_t>(handle.lineNumber);
+            writeSchedule(record, previous);
+            writeSchedule(record, TrainSchedule(time, isStoppingTrain, days));
+            endRecord();
+        }
+        return result;
+    }
+
+    const JournalReplay& getReplay() const { return replayed; }
+    size_t pendingBytes() const { return pending.getBuffer().size(); }
+};
@@ -0,0 +1,290 @@
+// railway_journey.h
+#pragma once
+#include "railway.h"
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+// Earliest-arrival journeys across stations (connection scan)
+//
+// A connection is one hop of a train: it leaves station A at a time and
+// reaches station B later, possibly after midnight. All connections live
+// in one contiguous array sorted by departure, so a query is a single
+// forward pass starting at the first departure after the requested time
+// and stopping once no later departure can improve the destination.
+//
+// Connections that share a trip number belong to the same train: staying
+// on board needs no transfer time, changing trains needs the planner's
+// minimum transfer time. Journeys cover one service day: a passenger who
+// arrives after midnight cannot board again that day.
+
+struct JourneyLeg {
+    uint32_t from;  // station indexes, see JourneyPlanner::getStation
+    uint32_t to;
+    Time departure;
+    Time arrival;
+    uint32_t trip;
+};
+
+struct Journey {
+    vector<JourneyLeg> legs;
+    Time departure;
+    Time arrival;
+    int minutes;  // door to door, from the first departure
+
+    bool arrivesNextDay() const { return departure.toMinutes() + minutes >= Time::MINUTES_PER_DAY; }
+};
+
+template<typename T>
+struct JourneyQuery {
+    T from;
+    T to;
+    Time departAfter;
+};
+
+template<typename T>
+class JourneyPlanner {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+private:
+    static constexpr uint16_t UNREACHED = UINT16_MAX;
+
+    struct Connection {
+        uint32_t from;
+        uint32_t to;
+        uint32_t trip;
+        uint16_t departure;  // minute of day
+        uint16_t arrival;    // minutes since the start of the departure day
+    };
+
+    // Per-query state, kept between queries and reset only where touched
+    struct ScanState {
+        vector<uint16_t> arrival;
+        vector<uint32_t> boarded;  // connection the best arrival boarded at
+        vector<uint32_t> alighted; // connection the best arrival left at
+        vector<uint32_t> tripEntry;
+        vector<uint32_t> touchedStations;
+        vector<uint32_t> touchedTrips;
+        vector<uint8_t> isTarget;
+    };
+
+    const RailwaySystem<T>& railway;
+    vector<const RailwayStation<T>*> stations;
+    unordered_map<const RailwayStation<T>*, uint32_t> stationIndex;
+    vector<Connection> connections;
+    uint32_t tripCount = 0;
+    int transferMinutes;
+    bool sorted = true;
+    ScanState state;
+
+    uint32_t indexOf(LookupKey<T> id, bool create) {
+        const auto* station = railway.findStation(id);
+        if (!station) {
+            throw RailwayException("Station not found");
+        }
+        auto it = stationIndex.find(station);
+        if (it != stationIndex.end()) return it->second;
+        if (!create) return NONE;
+        uint32_t index = static_cast<uint32_t>(stations.size());
+        stations.push_back(station);
+        stationIndex.emplace(station, index);
+        return index;
+    }
+
+    void prepare() {
+        if (!sorted) {
+            stable_sort(connections.begin(), connections.end(), [](const Connection& a, const Connection& b) {
+                return a.departure != b.departure ? a.departure < b.departure : a.arrival < b.arrival;
+            });
+            sorted = true;
+        }
+        state.arrival.resize(stations.size(), UNREACHED);
+        state.boarded.resize(stations.size(), NONE);
+        state.alighted.resize(stations.size(), NONE);
+        state.isTarget.resize(stations.size(), 0);
+        state.tripEntry.resize(tripCount, NONE);
+    }
+
+    void reach(uint32_t station, uint16_t minute, uint32_t boarded, uint32_t alighted) {
+        if (state.arrival[station] == UNREACHED) {
+            state.touchedStations.push_back(station);
+        }
+        state.arrival[station] = minute;
+        state.boarded[station] = boarded;
+        state.alighted[station] = alighted;
+    }
+
+    void resetScan() {
+        for (uint32_t station : state.touchedStations) {
+            state.arrival[station] = UNREACHED;
+            state.boarded[station] = NONE;
+            state.alighted[station] = NONE;
+        }
+        for (uint32_t trip : state.touchedTrips) {
+            state.tripEntry[trip] = NONE;
+        }
+        state.touchedStations.clear();
+        state.touchedTrips.clear();
+    }
+
+    // Latest arrival among the targets; the scan can stop at the first
+    // departure after it
+    uint16_t targetBound(const vector<uint32_t>& targets) const {
+        uint16_t bound = 0;
+        for (uint32_t target : targets) {
+            bound = max(bound, state.arrival[target]);
+        }
+        return bound;
+    }
+
+    // Earliest arrivals from source to every target, leaving at or after
+    // departAfter. Results stay in state until the next resetScan().
+    void scan(uint32_t source, uint16_t departAfter, const vector<uint32_t>& targets) {
+        reach(source, departAfter, NONE, NONE);
+        for (uint32_t target : targets) state.isTarget[target] = 1;
+        uint16_t bound = targetBound(targets);
+
+        auto first = lower_bound(connections.begin(), connections.end(), departAfter,
+                                 [](const Connection& c, uint16_t minute) { return c.departure < minute; });
+        for (auto it = first; it != connections.end() && it->departure < bound; ++it) {
+            const Connection& c = *it;
+            uint32_t index = static_cast<uint32_t>(it - connections.begin());
+            bool onBoard = c.trip != NONE && state.tripEntry[c.trip] != NONE;
+            if (!onBoard) {
+                uint16_t ready = state.arrival[c.from];
+                if (ready == UNREACHED) continue;
+                int change = c.from == source ? 0 : transferMinutes;
+                if (ready + change > c.departure) continue;
+                if (c.trip != NONE) {
+                    state.tripEntry[c.trip] = index;
+                    state.touchedTrips.push_back(c.trip);
+                }
+            }
+            if (c.arrival < state.arrival[c.to]) {
+                reach(c.to, c.arrival, c.trip != NONE ? state.tripEntry[c.trip] : index, index);
+                if (state.isTarget[c.to]) bound = targetBound(targets);
+            }
+        }
+        for (uint32_t target : targets) state.isTarget[target] = 0;
+    }
+
+    optional<Journey> journeyTo(uint32_t source, uint32_t target, uint16_t departAfter) const {
+        if (target == source) {
+            return Journey{{}, Time::fromMinutes(departAfter), Time::fromMinutes(departAfter), 0};
+        }
+        if (state.arrival[target] == UNREACHED) return nullopt;
+        Journey journey;
+        for (uint32_t station = target; station != source;) {
+            const Connection& board = connections[state.boarded[station]];
+            const Connection& alight = connections[state.alighted[station]];
+            journey.legs.push_back({board.from, alight.to, Time::fromMinutes(board.departure),
+                                    Time::fromMinutes(alight.arrival % Time::MINUTES_PER_DAY), board.trip});
+            station = board.from;
+        }
+        reverse(journey.legs.begin(), journey.legs.end());
+        int start = journey.legs.front().departure.toMinutes();
+        journey.departure = journey.legs.front().departure;
+        journey.arrival = Time::fromMinutes(state.arrival[target] % Time::MINUTES_PER_DAY);
+        journey.minutes = state.arrival[target] - start;
+        return journey;
+    }
+
+public:
+    explicit JourneyPlanner(const RailwaySystem<T>& system, int minimumTransferMinutes = 0)
+        : railway(system), transferMinutes(minimumTransferMinutes) {
+        if (minimumTransferMinutes < 0 || minimumTransferMinutes >= Time::MINUTES_PER_DAY) {
+            throw RailwayException("Invalid transfer time");
+        }
+    }
+
+    // Adds a hop from one station to another. An arrival earlier than the
+    // departure is on the next day. Hops with the same trip number (other
+    // than NONE) are one train and must be added in travel order.
+    void addConnection(LookupKey<T> from, const Time& departure, LookupKey<T> to, const Time& arrival,
+                       uint32_t trip = NONE) {
+        uint32_t fromIndex = indexOf(from, true);
+        uint32_t toIndex = indexOf(to, true);
+        if (fromIndex == toIndex) {
+            throw RailwayException("Connection must link two different stations");
+        }
+        int duration = (arrival.toMinutes() - departure.toMinutes() + Time::MINUTES_PER_DAY) % Time::MINUTES_PER_DAY;
+        if (duration == 0) {
+            throw RailwayException("Connection must take at least one minute");
+        }
+        if (trip != NONE && trip >= tripCount) {
+            tripCount = trip + 1;
+        }
+        uint16_t start = static_cast<uint16_t>(departure.toMinutes());
+        if (!connections.empty()) {
+            const Connection& last = connections.back();
+            sorted = sorted && (last.departure < start || (last.departure == start && last.arrival <= start + duration));
+        }
+        connections.push_back({fromIndex, toIndex, trip, start, static_cast<uint16_t>(start + duration)});
+    }
+
+    // Earliest arrival at `to` leaving `from` at or after departAfter, or
+    // nothing when `to` cannot be reached the same service day
+    optional<Journey> earliestArrival(LookupKey<T> from, LookupKey<T> to, const Time& departAfter) {
+        uint32_t source = indexOf(from, false);
+        uint32_t target = indexOf(to, false);
+        if (source == NONE || target == NONE) {
+            return from == to ? optional<Journey>(Journey{{}, departAfter, departAfter, 0}) : nullopt;
+        }
+        prepare();
+        uint16_t start = static_cast<uint16_t>(departAfter.toMinutes());
+        scan(source, start, {target});
+        auto journey = journeyTo(source, target, start);
+        resetScan();
+        return journey;
+    }
+
+    // Answers many queries at once. Queries from the same station and time
+    // share one scan, and the scan state is reused across the batch.
+    vector<optional<Journey>> earliestArrivals(const vector<JourneyQuery<T>>& queries) {
+        vector<optional<Journey>> results(queries.size());
+        vector<uint32_t> sources(queries.size()), targets(queries.size());
+        vector<size_t> order;
+        order.reserve(queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            sources[i] = indexOf(queries[i].from, false);
+            targets[i] = indexOf(queries[i].to, false);
+            if (sources[i] == NONE || targets[i] == NONE) {
+                if (queries[i].from == queries[i].to) {
+                    results[i] = Journey{{}, queries[i].departAfter, queries[i].departAfter, 0};
+                }
+                continue;
+            }
+            order.push_back(i);
+        }
+        sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            if (sources[a] != sources[b]) return sources[a] < sources[b];
+            return queries[a].departAfter < queries[b].departAfter;
+        });
+
+        prepare();
+        vector<uint32_t> groupTargets;
+        for (size_t begin = 0; begin < order.size();) {
+            size_t end = begin;
+            uint32_t source = sources[order[begin]];
+            const Time& departAfter = queries[order[begin]].departAfter;
+            groupTargets.clear();
+            while (end < order.size() && sources[order[end]] == source && queries[order[end]].departAfter == departAfter) {
+                groupTargets.push_back(targets[order[end]]);
+                ++end;
+            }
+            uint16_t start = static_cast<uint16_t>(departAfter.toMinutes());
+            scan(source, start, groupTargets);
+            for (size_t i = begin; i < end; ++i) {
+                results[order[i]] = journeyTo(source, targets[order[i]], start);
+            }
+            resetScan();
+            begin = end;
+        }
+        return results;
+    }
+
+    const RailwayStation<T>& getStation(uint32_t index) const { return *stations[index]; }
+    size_t getConnectionCount() const { return connections.size(); }
+    int getTransferMinutes() const { return transferMinutes; }
+};
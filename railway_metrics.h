@@ -0,0 +1,280 @@
+// railway_metrics.h
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+using namespace std;
+
+// Operation counters and latency histograms
+//
+// Compiled in only when RAILWAY_METRICS is defined; otherwise the
+// RAILWAY_COUNT / RAILWAY_TIMED hooks expand to nothing and their
+// arguments are never evaluated.
+//
+// Each thread counts into its own block with plain relaxed loads and
+// stores (no locked instructions, no sharing). Blocks are registered once
+// per thread, kept after the thread exits and reused by later threads, so
+// collectMetrics() can sum them at any time.
+
+enum class MetricCounter : uint8_t {
+    ConflictChecks,
+    ConflictRejections,
+    StationLookups,
+    StationProbes,
+    PlatformLookups,
+    PlatformProbes,
+    LineLookups,
+    LineProbes,
+    Count
+};
+
+enum class MetricHistogram : uint8_t { AddTrainSchedule, Display, Count };
+
+enum class MetricsFormat { Text, Json };
+
+constexpr size_t METRIC_COUNTERS = static_cast<size_t>(MetricCounter::Count);
+constexpr size_t METRIC_HISTOGRAMS = static_cast<size_t>(MetricHistogram::Count);
+constexpr size_t LATENCY_BUCKETS = 40;  // bucket b holds latencies below 2^b ns
+
+inline const char* metricName(MetricCounter counter) {
+    static const char* const names[] = {
+        "conflict_checks", "conflict_rejections", "station_lookups", "station_probes",
+        "platform_lookups", "platform_probes", "line_lookups", "line_probes"};
+    return names[static_cast<size_t>(counter)];
+}
+
+inline const char* metricName(MetricHistogram histogram) {
+    static const char* const names[] = {"add_train_schedule", "display"};
+    return names[static_cast<size_t>(histogram)];
+}
+
+inline size_t latencyBucket(uint64_t nanoseconds) {
+    size_t bucket = nanoseconds == 0 ? 0 : 64 - static_cast<size_t>(__builtin_clzll(nanoseconds));
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+struct LatencyHistogram {
+    array<uint64_t, LATENCY_BUCKETS> buckets{};
+    uint64_t count = 0;
+    uint64_t totalNanoseconds = 0;
+
+    double mean() const { return count ? double(totalNanoseconds) / count : 0.0; }
+
+    // Upper bound of the bucket holding the given quantile
+    uint64_t percentile(double quantile) const {
+        uint64_t rank = static_cast<uint64_t>(quantile * count);
+        uint64_t seen = 0;
+        for (size_t b = 0; b < LATENCY_BUCKETS; ++b) {
+            seen += buckets[b];
+            if (seen > rank) return uint64_t(1) << b;
+        }
+        return count ? uint64_t(1) << (LATENCY_BUCKETS - 1) : 0;
+    }
+};
+
+struct MetricsSnapshot {
+    array<uint64_t, METRIC_COUNTERS> counters{};
+    array<LatencyHistogram, METRIC_HISTOGRAMS> histograms{};
+
+    uint64_t get(MetricCounter counter) const { return counters[static_cast<size_t>(counter)]; }
+    const LatencyHistogram& get(MetricHistogram histogram) const {
+        return histograms[static_cast<size_t>(histogram)];
+    }
+};
+
+class ThreadMetrics {
+private:
+    struct Histogram {
+        array<atomic<uint64_t>, LATENCY_BUCKETS> buckets{};
+        atomic<uint64_t> total{0};
+    };
+
+    array<atomic<uint64_t>, METRIC_COUNTERS> counters{};
+    array<Histogram, METRIC_HISTOGRAMS> histograms{};
+
+    // Only the owning thread writes, so a load and a store replace the
+    // read-modify-write; readers see a value that is at worst slightly old.
+    static void bump(atomic<uint64_t>& value, uint64_t amount) {
+        value.store(value.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+
+public:
+    atomic<bool> inUse{false};
+
+    void add(MetricCounter counter, uint64_t amount) { bump(counters[static_cast<size_t>(counter)], amount); }
+
+    void record(MetricHistogram histogram, uint64_t nanoseconds) {
+        Histogram& target = histograms[static_cast<size_t>(histogram)];
+        bump(target.buckets[latencyBucket(nanoseconds)], 1);
+        bump(target.total, nanoseconds);
+    }
+
+    void addTo(MetricsSnapshot& snapshot) const {
+        for (size_t c = 0; c < METRIC_COUNTERS; ++c) {
+            snapshot.counters[c] += counters[c].load(memory_order_relaxed);
+        }
+        for (size_t h = 0; h < METRIC_HISTOGRAMS; ++h) {
+            LatencyHistogram& out = snapshot.histograms[h];
+            for (size_t b = 0; b < LATENCY_BUCKETS; ++b) {
+                uint64_t hits = histograms[h].buckets[b].load(memory_order_relaxed);
+                out.buckets[b] += hits;
+                out.count += hits;
+            }
+            out.totalNanoseconds += histograms[h].total.load(memory_order_relaxed);
+        }
+    }
+
+    void clear() {
+        for (auto& counter : counters) counter.store(0, memory_order_relaxed);
+        for (auto& histogram : histograms) {
+            for (auto& bucket : histogram.buckets) bucket.store(0, memory_order_relaxed);
+            histogram.total.store(0, memory_order_relaxed);
+        }
+    }
+};
+
+class MetricsRegistry {
+private:
+    mutex lock;
+    vector<unique_ptr<ThreadMetrics>> blocks;
+
+public:
+    static MetricsRegistry& instance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    ThreadMetrics* acquire() {
+        lock_guard<mutex> guard(lock);
+        for (auto& block : blocks) {
+            if (!block->inUse.load(memory_order_relaxed)) {
+                block->inUse.store(true, memory_order_relaxed);
+                return block.get();
+            }
+        }
+        blocks.push_back(make_unique<ThreadMetrics>());
+        blocks.back()->inUse.store(true, memory_order_relaxed);
+        return blocks.back().get();
+    }
+
+    void release(ThreadMetrics* block) {
+        lock_guard<mutex> guard(lock);
+        block->inUse.store(false, memory_order_relaxed);
+    }
+
+    MetricsSnapshot collect() {
+        lock_guard<mutex> guard(lock);
+        MetricsSnapshot snapshot;
+        for (const auto& block : blocks) block->addTo(snapshot);
+        return snapshot;
+    }
+
+    void reset() {
+        lock_guard<mutex> guard(lock);
+        for (auto& block : blocks) block->clear();
+    }
+};
+
+// The calling thread's block, registered on first use
+inline ThreadMetrics& threadMetrics() {
+    struct Handle {
+        ThreadMetrics* block = MetricsRegistry::instance().acquire();
+        ~Handle() { MetricsRegistry::instance().release(block); }
+    };
+    thread_local Handle handle;
+    return *handle.block;
+}
+
+class ScopedLatency {
+private:
+    MetricHistogram histogram;
+    chrono::steady_clock::time_point begin;
+
+public:
+    explicit ScopedLatency(MetricHistogram target) : histogram(target), begin(chrono::steady_clock::now()) {}
+    ~ScopedLatency() {
+        auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin);
+        threadMetrics().record(histogram, static_cast<uint64_t>(elapsed.count()));
+    }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+};
+
+#ifdef RAILWAY_METRICS
+constexpr bool METRICS_ENABLED = true;
+#define RAILWAY_COUNT(counter, amount) threadMetrics().add(MetricCounter::counter, (amount))
+#define RAILWAY_TIMED_CONCAT(name, line) name##line
+#define RAILWAY_TIMED_NAME(line) RAILWAY_TIMED_CONCAT(railwayLatency, line)
+#define RAILWAY_TIMED(histogram) ScopedLatency RAILWAY_TIMED_NAME(__LINE__)(MetricHistogram::histogram)
+#else
+constexpr bool METRICS_ENABLED = false;
+#define RAILWAY_COUNT(counter, amount) ((void)0)
+#define RAILWAY_TIMED(histogram) ((void)0)
+#endif
+
+inline MetricsSnapshot collectMetrics() { return MetricsRegistry::instance().collect(); }
+inline void resetMetrics() { MetricsRegistry::instance().reset(); }
+
+inline void writeMetrics(ostream& out, MetricsFormat format, const MetricsSnapshot& snapshot = collectMetrics()) {
+    if (format == MetricsFormat::Json) {
+        out << "{\"enabled\":" << (METRICS_ENABLED ? "true" : "false") << ",\"counters\":{";
+        for (size_t c = 0; c < METRIC_COUNTERS; ++c) {
+            out << (c ? "," : "") << '"' << metricName(MetricCounter(c)) << "\":" << snapshot.counters[c];
+        }
+        out << "},\"histograms\":{";
+        for (size_t h = 0; h < METRIC_HISTOGRAMS; ++h) {
+            const LatencyHistogram& histogram = snapshot.histograms[h];
+            out << (h ? "," : "") << '"' << metricName(MetricHistogram(h)) << "\":{\"count\":" << histogram.count
+                << ",\"mean_ns\":" << static_cast<uint64_t>(histogram.mean())
+                << ",\"p50_ns\":" << histogram.percentile(0.50) << ",\"p99_ns\":" << histogram.percentile(0.99)
+                << ",\"buckets\":[";
+            bool first = true;
+            for (size_t b = 0; b < LATENCY_BUCKETS; ++b) {
+                if (!histogram.buckets[b]) continue;
+                out << (first ? "" : ",") << "{\"below_ns\":" << (uint64_t(1) << b)
+                    << ",\"count\":" << histogram.buckets[b] << '}';
+                first = false;
+            }
+            out << "]}";
+        }
+        out << "}}\n";
+        return;
+    }
+
+    out << "\n=== Metrics ===\n";
+    if (!METRICS_ENABLED) {
+        out << "Metrics are disabled in this build (compile with -DRAILWAY_METRICS).\n";
+        return;
+    }
+    // The caller's formatting is put back once the table is written
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    for (size_t c = 0; c < METRIC_COUNTERS; ++c) {
+        out << left << setw(24) << metricName(MetricCounter(c)) << right << setw(14) << snapshot.counters[c] << '\n';
+    }
+    auto averageProbes = [&](MetricCounter lookups, MetricCounter probes) {
+        uint64_t count = snapshot.get(lookups);
+        return count ? double(snapshot.get(probes)) / count : 0.0;
+    };
+    out << fixed << setprecision(2)
+        << "avg station probes      " << setw(14) << averageProbes(MetricCounter::StationLookups, MetricCounter::StationProbes) << '\n'
+        << "avg platform probes     " << setw(14) << averageProbes(MetricCounter::PlatformLookups, MetricCounter::PlatformProbes) << '\n'
+        << "avg line probes         " << setw(14) << averageProbes(MetricCounter::LineLookups, MetricCounter::LineProbes) << '\n';
+    out << "\n" << left << setw(24) << "latency" << right << setw(10) << "count" << setw(12) << "mean ns"
+        << setw(12) << "p50 ns <" << setw(12) << "p99 ns <" << '\n';
+    for (size_t h = 0; h < METRIC_HISTOGRAMS; ++h) {
+        const LatencyHistogram& histogram = snapshot.histograms[h];
+        out << left << setw(24) << metricName(MetricHistogram(h)) << right << setw(10) << histogram.count
+            << setw(12) << setprecision(0) << histogram.mean() << setw(12) << histogram.percentile(0.50)
+            << setw(12) << histogram.percentile(0.99) << '\n';
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
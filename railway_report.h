@@ -0,0 +1,523 @@
+// railway_report.h
+#pragma once
+#include "railway.h"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <optional>
+#include <unistd.h>
+
+// Report engine
+//
+// Rows are formatted straight into a large reusable buffer that is handed
+// to write(2) (or appended to a string) only when full, so dumping a big
+// network costs a handful of syscalls and memory stays bounded by the
+// buffer size however many rows are written.
+
+class OutputBuffer {
+private:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 18;
+
+    vector<char> buffer;
+    size_t used = 0;
+    int fd = -1;
+    string* target = nullptr;
+
+    void drain(const char* data, size_t size) {
+        if (target) {
+            target->append(data, size);
+            return;
+        }
+        while (size > 0) {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw RailwayException(string("Report write failed: ") + strerror(errno));
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+public:
+    explicit OutputBuffer(int fileDescriptor, size_t capacity = DEFAULT_CAPACITY)
+        : buffer(capacity), fd(fileDescriptor) {}
+
+    explicit OutputBuffer(string& sink, size_t capacity = DEFAULT_CAPACITY)
+        : buffer(capacity), target(&sink) {}
+
+    ~OutputBuffer() {
+        try {
+            flush();
+        } catch (const RailwayException&) {}
+    }
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void flush() {
+        if (used > 0) {
+            size_t size = used;
+            used = 0;
+            drain(buffer.data(), size);
+        }
+    }
+
+    // Returns room for at least size bytes (size must not exceed the
+    // capacity); finish with commit().
+    char* reserve(size_t size) {
+        if (buffer.size() - used < size) flush();
+        return buffer.data() + used;
+    }
+
+    void commit(const char* end) { used = static_cast<size_t>(end - buffer.data()); }
+
+    void append(char c) {
+        if (used == buffer.size()) flush();
+        buffer[used++] = c;
+    }
+
+    void append(string_view text) {
+        if (text.size() > buffer.size() - used) {
+            flush();
+            if (text.size() > buffer.size()) {
+                drain(text.data(), text.size());
+                return;
+            }
+        }
+        memcpy(buffer.data() + used, text.data(), text.size());
+        used += text.size();
+    }
+
+    void appendRepeated(char c, size_t count) {
+        while (count > 0) {
+            if (used == buffer.size()) flush();
+            size_t chunk = min(count, buffer.size() - used);
+            memset(buffer.data() + used, c, chunk);
+            used += chunk;
+            count -= chunk;
+        }
+    }
+
+    // Right-aligned in a field of width characters, like setw
+    void appendPadded(string_view text, size_t width) {
+        if (text.size() < width) appendRepeated(' ', width - text.size());
+        append(text);
+    }
+
+    void appendInt(long long value) {
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), value);
+        append(string_view(digits, result.ptr - digits));
+    }
+
+    void appendTime(const Time& time) {
+        char* out = reserve(Time::FORMATTED_SIZE);
+        commit(time.format(out));
+    }
+};
+
+// Writes a station ID as text
+template<typename T>
+void appendId(OutputBuffer& out, const T& id) {
+    if constexpr (is_convertible<const T&, string_view>::value) {
+        out.append(string_view(id));
+    } else if constexpr (is_integral<T>::value) {
+        out.appendInt(static_cast<long long>(id));
+    } else {
+        ostringstream text;
+        text << id;
+        out.append(text.str());
+    }
+}
+
+enum class ReportFormat { Table, Csv, JsonLines };
+
+template<typename T>
+struct ReportFilter {
+    optional<T> station;
+    optional<int> platform;
+    Time from = Time(0, 0);
+    Time to = Time(23, 59);
+
+    bool matchesTime(const Time& time) const { return !(time < from) && !(to < time); }
+};
+
+template<typename T>
+class ReportWriter {
+private:
+    OutputBuffer& out;
+    ReportFormat format;
+    ReportFilter<T> filter;
+
+    static const char* trainType(const TrainSchedule& schedule) {
+        return schedule.isStoppingTrain() ? "Stopping" : "Through";
+    }
+
+    void appendDays(DayMask days) {
+        char* end = out.reserve(DayMask::FORMATTED_SIZE);
+        out.commit(days.format(end));
+    }
+
+    void appendCsvField(string_view text) {
+        if (text.find_first_of(",\"\r\n") == string_view::npos) {
+            out.append(text);
+            return;
+        }
+        out.append('"');
+        for (char c : text) {
+            if (c == '"') out.append('"');
+            out.append(c);
+        }
+        out.append('"');
+    }
+
+    void appendJsonString(string_view text) {
+        out.append('"');
+        for (char c : text) {
+            switch (c) {
+                case '"': out.append("\\\""); break;
+                case '\\': out.append("\\\\"); break;
+                case '\n': out.append("\\n"); break;
+                case '\r': out.append("\\r"); break;
+                case '\t': out.append("\\t"); break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        static const char hex[] = "0123456789abcdef";
+                        out.append("\\u00");
+                        out.append(hex[(c >> 4) & 0xF]);
+                        out.append(hex[c & 0xF]);
+                    } else {
+                        out.append(c);
+                    }
+            }
+        }
+        out.append('"');
+    }
+
+    void appendIdField(const T& id) {
+        if constexpr (is_integral<T>::value) {
+            appendId(out, id);
+        } else if constexpr (is_convertible<const T&, string_view>::value) {
+            appendTextField(string_view(id));
+        } else {
+            ostringstream text;
+            text << id;
+            appendTextField(text.str());
+        }
+    }
+
+    void appendTextField(string_view text) {
+        if (format == ReportFormat::Csv) {
+            appendCsvField(text);
+        } else {
+            appendJsonString(text);
+        }
+    }
+
+    template<typename LineNode>
+    void writeTableLine(const LineNode& line) {
+        out.append("\nLine ");
+        out.appendInt(line.getLineNumber());
+        out.append(" Schedule:\n");
+        out.appendPadded("Time", 10);
+        out.appendPadded("Train Type", 15);
+        out.append('\n');
+        out.appendRepeated('-', 25);
+        out.append('\n');
+        for (const auto& schedule : line.getSchedules()) {
+            if (!filter.matchesTime(schedule.time)) continue;
+            out.appendRepeated(' ', 10 - Time::FORMATTED_SIZE);
+            out.appendTime(schedule.time);
+            out.appendPadded(trainType(schedule), 15);
+            if (!schedule.days.isDaily()) {
+                out.appendRepeated(' ', 2);
+                appendDays(schedule.days);
+            }
+            out.append('\n');
+        }
+        out.appendRepeated('-', 25);
+        out.append('\n');
+    }
+
+    template<typename Station, typename PlatformNode, typename LineNode>
+    void writeRecordLine(const Station& station, const PlatformNode& platform, const LineNode& line) {
+        const T& id = station.getId();
+        const string& name = station.getName();
+        for (const auto& schedule : line.getSchedules()) {
+            if (!filter.matchesTime(schedule.time)) continue;
+            if (format == ReportFormat::Csv) {
+                appendIdField(id);
+                out.append(',');
+                appendCsvField(name);
+                out.append(',');
+                out.appendInt(platform.getPlatformNumber());
+                out.append(',');
+                out.appendInt(line.getLineNumber());
+                out.append(',');
+                out.appendTime(schedule.time);
+                out.append(schedule.isStoppingTrain() ? ",S," : ",T,");
+                appendDays(schedule.days);
+                out.append('\n');
+            } else {
+                out.append("{\"station\":");
+                appendIdField(id);
+                out.append(",\"name\":");
+                appendJsonString(name);
+                out.append(",\"platform\":");
+                out.appendInt(platform.getPlatformNumber());
+                out.append(",\"line\":");
+                out.appendInt(line.getLineNumber());
+                out.append(",\"time\":\"");
+                out.appendTime(schedule.time);
+                out.append(schedule.isStoppingTrain() ? "\",\"type\":\"stopping\",\"days\":\""
+                                                    : "\",\"type\":\"through\",\"days\":\"");
+                appendDays(schedule.days);
+                out.append("\"}\n");
+            }
+        }
+    }
+
+public:
+    ReportWriter(OutputBuffer& output, ReportFormat reportFormat, ReportFilter<T> reportFilter = {})
+        : out(output), format(reportFormat), filter(move(reportFilter)) {}
+
+    // Stations, platforms and lines are taken generically, so versioned
+    // snapshot nodes and every headway policy render through the same code
+    template<typename Station>
+    bool includesStation(const Station& station) const {
+        return !filter.station || station.getId() == *filter.station;
+    }
+
+    template<typename PlatformNode>
+    bool includesPlatform(const PlatformNode& platform) const {
+        return !filter.platform || platform.getPlatformNumber() == *filter.platform;
+    }
+
+    void writeHeader(bool empty) {
+        if (format == ReportFormat::Table) {
+            out.append("\n=== Railway System Status ===\n");
+            if (empty) out.append("No stations in the system.\n");
+        } else if (format == ReportFormat::Csv) {
+            out.append("station_id,station_name,platform,line,time,train_type,days\n");
+        }
+    }
+
+    template<typename Station, typename PlatformNode, typename LineNode>
+    void writeLine(const Station& station, const PlatformNode& platform, const LineNode& line) {
+        if (format == ReportFormat::Table) {
+            writeTableLine(line);
+        } else {
+            writeRecordLine(station, platform, line);
+        }
+    }
+
+    template<typename PlatformNode>
+    void writePlatformHeader(const PlatformNode& platform) {
+        if (format == ReportFormat::Table) {
+            out.append("\nPlatform ");
+            out.appendInt(platform.getPlatformNumber());
+            out.append(":\n");
+            if (platform.getLines().empty()) {
+                out.append("No lines on this platform.\n");
+            }
+        }
+    }
+
+    template<typename Station, typename PlatformNode>
+    void writePlatform(const Station& station, const PlatformNode& platform) {
+        writePlatformHeader(platform);
+        for (const auto& line : platform.getLines()) {
+            writeLine(station, platform, *line);
+        }
+    }
+
+    template<typename Station>
+    void writeStationHeader(const Station& station) {
+        if (format == ReportFormat::Table) {
+            out.append("\nStation ID: ");
+            appendId(out, station.getId());
+            out.append("\nName: ");
+            out.append(station.getName());
+            out.append('\n');
+            if (station.getPlatforms().empty()) {
+                out.append("No platforms in this station.\n");
+            }
+        }
+    }
+
+    template<typename Station>
+    void writeStation(const Station& station) {
+        writeStationHeader(station);
+        for (const auto& platform : station.getPlatforms()) {
+            if (includesPlatform(*platform)) {
+                writePlatform(station, *platform);
+            }
+        }
+    }
+
+    template<typename Policy>
+    void write(const RailwaySystem<T, Policy>& railway) {
+        writeHeader(railway.getStations().empty());
+        for (const auto& station : railway.getStations()) {
+            if (includesStation(*station)) {
+                writeStation(*station);
+            }
+        }
+    }
+};
+
+template<typename T, typename Policy>
+void RailwaySystem<T, Policy>::displayAllStations() const {
+    RAILWAY_TIMED(Display);
+    cout.flush();
+    OutputBuffer out(STDOUT_FILENO);
+    ReportWriter<T>(out, ReportFormat::Table).write(*this);
+}
+
+// Table view that keeps the rendered text of every line, platform and
+// station and re-renders only the subtrees whose revision moved since the
+// previous view. A full view after one insert formats one line, rebuilds
+// the two enclosing fragments from cached pieces and copies the rest.
+template<typename T, typename Policy = StandardHeadways>
+class IncrementalTableView {
+private:
+    static constexpr size_t FRAGMENT_CAPACITY = 1 << 12;
+
+    using Station = RailwayStation<T, Policy>;
+    using PlatformNode = BasicPlatform<Policy>;
+    using LineNode = BasicLine<Policy>;
+    using System = RailwaySystem<T, Policy>;
+
+    struct LineFragment {
+        uint64_t revision = 0;  // no node has revision 0, so fresh entries render
+        string text;
+    };
+
+    struct PlatformFragment {
+        uint64_t revision = 0;
+        string header;
+        string text;  // header followed by the line fragments
+        unordered_map<const LineNode*, LineFragment> lines;
+    };
+
+    struct StationFragment {
+        uint64_t revision = 0;
+        uint64_t seen = 0;  // last pass that found the station
+        string header;
+        string text;  // header followed by the platform fragments
+        unordered_map<const PlatformNode*, PlatformFragment> platforms;
+    };
+
+    unordered_map<const Station*, StationFragment> stations;
+    size_t rendered = 0;  // fragments formatted by the last view
+    uint64_t pass = 0;
+
+    template<typename Write>
+    string render(Write write) {
+        string text;
+        {
+            OutputBuffer out(text, FRAGMENT_CAPACITY);
+            ReportWriter<T> writer(out, ReportFormat::Table);
+            write(writer);
+        }
+        ++rendered;
+        return text;
+    }
+
+    // Brings a platform fragment up to date; with changes set, the header
+    // and every changed line are copied there as well.
+    void refresh(const Station& station, const PlatformNode& platform,
+                 PlatformFragment& fragment, OutputBuffer* changes) {
+        if (fragment.revision == platform.getRevision()) return;
+        fragment.header = render([&](ReportWriter<T>& writer) { writer.writePlatformHeader(platform); });
+        if (changes) changes->append(fragment.header);
+        unordered_map<const LineNode*, LineFragment> lines;
+        lines.reserve(platform.getLines().size());
+        fragment.text = fragment.header;
+        for (const auto& line : platform.getLines()) {
+            auto found = fragment.lines.find(line.get());
+            LineFragment cached = found != fragment.lines.end() ? move(found->second) : LineFragment();
+            if (cached.revision != line->getRevision()) {
+                cached.text = render([&](ReportWriter<T>& writer) { writer.writeLine(station, platform, *line); });
+                cached.revision = line->getRevision();
+                if (changes) changes->append(cached.text);
+            }
+            fragment.text += cached.text;
+            lines.emplace(line.get(), move(cached));
+        }
+        fragment.lines = move(lines);
+        fragment.revision = platform.getRevision();
+    }
+
+    void refresh(const Station& station, StationFragment& fragment, OutputBuffer* changes) {
+        if (fragment.revision == station.getRevision()) return;
+        fragment.header = render([&](ReportWriter<T>& writer) { writer.writeStationHeader(station); });
+        if (changes) changes->append(fragment.header);
+        unordered_map<const PlatformNode*, PlatformFragment> platforms;
+        platforms.reserve(station.getPlatforms().size());
+        fragment.text = fragment.header;
+        for (const auto& platform : station.getPlatforms()) {
+            auto found = fragment.platforms.find(platform.get());
+            PlatformFragment cached = found != fragment.platforms.end() ? move(found->second) : PlatformFragment();
+            refresh(station, *platform, cached, changes);
+            fragment.text += cached.text;
+            platforms.emplace(platform.get(), move(cached));
+        }
+        fragment.platforms = move(platforms);
+        fragment.revision = station.getRevision();
+    }
+
+    // Walks the stations in order, dropping cache entries for stations
+    // that are gone, and hands each up-to-date fragment to visit. The
+    // cache is updated in place, so an unchanged network allocates nothing.
+    template<typename Visit>
+    void refreshAll(const System& railway, OutputBuffer* changes, Visit visit) {
+        rendered = 0;
+        ++pass;
+        for (const auto& station : railway.getStations()) {
+            StationFragment& cached = stations[station.get()];
+            cached.seen = pass;
+            refresh(*station, cached, changes);
+            visit(cached);
+        }
+        if (stations.size() != railway.getStations().size()) {
+            for (auto it = stations.begin(); it != stations.end();) {
+                it = it->second.seen == pass ? next(it) : stations.erase(it);
+            }
+        }
+    }
+
+public:
+    // Same output as RailwaySystem::displayAllStations
+    void writeAll(const System& railway, OutputBuffer& out) {
+        ReportWriter<T>(out, ReportFormat::Table).writeHeader(railway.getStations().empty());
+        refreshAll(railway, nullptr, [&](const StationFragment& fragment) { out.append(fragment.text); });
+    }
+
+    // Only what changed since the previous view: the header of each changed
+    // station and platform, followed by its changed lines.
+    void writeChanges(const System& railway, OutputBuffer& out) {
+        out.append("\n=== Changes Since Last View ===\n");
+        refreshAll(railway, &out, [](const StationFragment&) {});
+        if (rendered == 0) {
+            out.append("No changes since last view.\n");
+        }
+    }
+
+    void display(const System& railway) {
+        RAILWAY_TIMED(Display);
+        cout.flush();
+        OutputBuffer out(STDOUT_FILENO);
+        writeAll(railway, out);
+    }
+
+    void displayChanges(const System& railway) {
+        RAILWAY_TIMED(Display);
+        cout.flush();
+        OutputBuffer out(STDOUT_FILENO);
+        writeChanges(railway, out);
+    }
+
+    size_t getRenderedFragments() const { return rendered; }
+};
@@ -0,0 +1,300 @@
+// railway_script.h
+#pragma once
+#include "railway.h"
+#include "railway_import.h"
+#include "railway_journal.h"
+#include "railway_report.h"
+#include <cerrno>
+#include <unistd.h>
+
+// Line-oriented command protocol for driving the system from another
+// process. Every command line gets exactly one response line:
+//
+//   ADD_STATION <id> <name...>                     -> OK
+//   ADD_PLATFORMS <id> <platform>...               -> OK
+//   ADD_LINES <id> <platform> <line>...            -> OK
+//   ADD_TRAIN <id> <platform> <line> <HH:MM> <S|T> [<days>]
+//                                                  -> OK | CONFLICT <HH:MM> <S|T> [<days>]
+//   QUERY <id>                                     -> OK <platforms> <lines> <trains> <name...>
+//   QUERY <id> <platform>                          -> OK <line>...
+//   QUERY <id> <platform> <line>                   -> OK <HH:MM><S|T>[/<days>]... (time order)
+//
+// Days are written as in imports (see parseDays) and left out for daily
+// trains; responses always use the "MTWTFSS" pattern.
+// Failures answer "ERR <message>". Input is read in large blocks; all
+// complete commands in a block are applied and their responses leave in
+// a single write, so a controller can pipeline thousands of commands.
+
+// Splits a command line on spaces and tabs without copying
+class TokenCursor {
+private:
+    string_view rest;
+
+    void skipSpace() {
+        size_t start = rest.find_first_not_of(" \t");
+        rest.remove_prefix(start == string_view::npos ? rest.size() : start);
+    }
+
+public:
+    explicit TokenCursor(string_view line) : rest(line) { skipSpace(); }
+
+    bool next(string_view& token) {
+        if (rest.empty()) return false;
+        size_t end = rest.find_first_of(" \t");
+        token = rest.substr(0, end);
+        rest.remove_prefix(end == string_view::npos ? rest.size() : end);
+        skipSpace();
+        return true;
+    }
+
+    string_view require(const char* what) {
+        string_view token;
+        if (!next(token)) {
+            throw RailwayException(string("Missing ") + what);
+        }
+        return token;
+    }
+
+    // Everything after the tokens consumed so far
+    string_view remainder() const { return rest; }
+    bool done() const { return rest.empty(); }
+};
+
+template<typename T>
+class CommandProcessor {
+private:
+    static constexpr size_t BATCH_SIZE = 1 << 20;
+
+    RailwaySystem<T>& railway;
+    RailwayJournal<T>* journal;
+
+    RailwayStation<T>& requireStation(TokenCursor& tokens) {
+        auto* station = railway.findStation(parseStationKey<T>(tokens.require("station ID")));
+        if (!station) {
+            throw RailwayException("Station not found");
+        }
+        return *station;
+    }
+
+    static Platform& requirePlatform(RailwayStation<T>& station, TokenCursor& tokens) {
+        auto* platform = station.findPlatform(parseNumber(tokens.require("platform"), "platform number"));
+        if (!platform) {
+            throw RailwayException("Platform not found");
+        }
+        return *platform;
+    }
+
+    static vector<int> numberList(TokenCursor& tokens, const char* what) {
+        vector<int> numbers;
+        string_view token;
+        while (tokens.next(token)) {
+            numbers.push_back(parseNumber(token, what));
+        }
+        return numbers;
+    }
+
+    static void expectEnd(const TokenCursor& tokens) {
+        if (!tokens.done()) {
+            throw RailwayException("Too many arguments");
+        }
+    }
+
+    static void appendDays(OutputBuffer& out, DayMask days) {
+        char* end = out.reserve(DayMask::FORMATTED_SIZE);
+        out.commit(days.format(end));
+    }
+
+    static void appendSchedule(OutputBuffer& out, const TrainSchedule& schedule) {
+        out.appendTime(schedule.time);
+        out.append(schedule.isStoppingTrain() ? 'S' : 'T');
+        if (!schedule.days.isDaily()) {
+            out.append('/');
+            appendDays(out, schedule.days);
+        }
+    }
+
+    void query(TokenCursor& tokens, OutputBuffer& out) {
+        auto& station = requireStation(tokens);
+        if (tokens.done()) {
+            size_t lines = 0, trains = 0;
+            for (const auto& platform : station.getPlatforms()) {
+                lines += platform->getLines().size();
+                for (const auto& line : platform->getLines()) {
+                    trains += line->getSchedules().size();
+                }
+            }
+            out.append("OK ");
+            out.appendInt(static_cast<long long>(station.getPlatforms().size()));
+            out.append(' ');
+            out.appendInt(static_cast<long long>(lines));
+            out.append(' ');
+            out.appendInt(static_cast<long long>(trains));
+            out.append(' ');
+            out.append(station.getName());
+            out.append('\n');
+            return;
+        }
+        auto& platform = requirePlatform(station, tokens);
+        if (tokens.done()) {
+            out.append("OK");
+            for (const auto& line : platform.getLines()) {
+                out.append(' ');
+                out.appendInt(line->getLineNumber());
+            }
+            out.append('\n');
+            return;
+        }
+        auto* line = platform.findLine(parseNumber(tokens.require("line"), "line number"));
+        if (!line) {
+            throw RailwayException("Line not found on this platform");
+        }
+        expectEnd(tokens);
+        out.append("OK");
+        for (const auto& schedule : line->getTimeline()) {
+            out.append(' ');
+            appendSchedule(out, schedule);
+        }
+        out.append('\n');
+    }
+
+    void apply(string_view command, TokenCursor& tokens, OutputBuffer& out) {
+        if (command == "ADD_TRAIN") {
+            auto& station = requireStation(tokens);
+            int platformNumber = parseNumber(tokens.require("platform"), "platform number");
+            int lineNumber = parseNumber(tokens.require("line"), "line number");
+            Time time = parseTime(tokens.require("time"));
+            bool isStoppingTrain = parseTrainType(tokens.require("train type"));
+            string_view token;
+            DayMask days = tokens.next(token) ? parseDays(token) : DayMask::daily();
+            expectEnd(tokens);
+            AddResult result = journal
+                ? journal->tryAddTrainSchedule(station, platformNumber, lineNumber, time, isStoppingTrain, days)
+                : station.tryAddTrainSchedule(platformNumber, lineNumber, time, isStoppingTrain, days);
+            if (result) {
+                out.append("OK\n");
+            } else if (result.status == AddStatus::Conflict) {
+                out.append("CONFLICT ");
+                out.appendTime(result.conflict.time);
+                out.append(result.conflict.isStoppingTrain() ? " S" : " T");
+                if (!result.conflict.days.isDaily()) {
+                    out.append(' ');
+                    appendDays(out, result.conflict.days);
+                }
+                out.append('\n');
+            } else {
+                out.append("ERR ");
+                out.append(describe(result.status));
+                out.append('\n');
+            }
+        } else if (command == "ADD_STATION") {
+            T id = parseStationId<T>(tokens.require("station ID"));
+            if (tokens.done()) {
+                throw RailwayException("Missing station name");
+            }
+            if (journal) {
+                journal->addStation(move(id), string(tokens.remainder()));
+            } else {
+                railway.addStation(move(id), string(tokens.remainder()));
+            }
+            out.append("OK\n");
+        } else if (command == "ADD_PLATFORMS") {
+            auto& station = requireStation(tokens);
+            auto numbers = numberList(tokens, "platform number");
+            if (journal) {
+                journal->addPlatforms(station, numbers);
+            } else {
+                station.addPlatforms(numbers);
+            }
+            out.append("OK\n");
+        } else if (command == "ADD_LINES") {
+            auto& station = requireStation(tokens);
+            auto& platform = requirePlatform(station, tokens);
+            auto numbers = numberList(tokens, "line number");
+            if (journal) {
+                journal->addLines(station, platform, numbers);
+            } else {
+                platform.addLines(numbers);
+            }
+            out.append("OK\n");
+        } else if (command == "QUERY") {
+            query(tokens, out);
+        } else {
+            throw RailwayException("Unknown command '" + string(command) + "'");
+        }
+    }
+
+public:
+    // With a journal, each block's mutations are committed before its
+    // responses are sent, so an OK is never lost to a crash.
+    explicit CommandProcessor(RailwaySystem<T>& system, RailwayJournal<T>* mutationJournal = nullptr)
+        : railway(system), journal(mutationJournal) {}
+
+    // Runs one command line (without its newline) and appends the response
+    void execute(string_view line, OutputBuffer& out) {
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        TokenCursor tokens(line);
+        string_view command;
+        if (!tokens.next(command)) {
+            out.append("ERR Empty command\n");
+            return;
+        }
+        try {
+            apply(command, tokens, out);
+        } catch (const RailwayException& e) {
+            out.append("ERR ");
+            out.append(e.what());
+            out.append('\n');
+        }
+    }
+
+    // Runs every complete line in data and returns the bytes consumed.
+    // With final set, a trailing line without a newline runs as well.
+    size_t executeBatch(const char* data, size_t size, bool final, OutputBuffer& out) {
+        size_t start = 0;
+        while (start < size) {
+            const void* newline = memchr(data + start, '\n', size - start);
+            if (!newline) {
+                if (final) {
+                    execute(string_view(data + start, size - start), out);
+                    start = size;
+                }
+                break;
+            }
+            size_t end = static_cast<const char*>(newline) - data;
+            execute(string_view(data + start, end - start), out);
+            start = end + 1;
+        }
+        return start;
+    }
+
+    // Serves commands from inputFd until end of input, flushing responses
+    // once per block read.
+    size_t serve(int inputFd, int outputFd) {
+        OutputBuffer out(outputFd);
+        vector<char> buffer(BATCH_SIZE);
+        size_t filled = 0;
+        size_t commands = 0;
+        while (true) {
+            if (filled == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+            ssize_t count = ::read(inputFd, buffer.data() + filled, buffer.size() - filled);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                throw RailwayException(string("Command input failed: ") + strerror(errno));
+            }
+            filled += static_cast<size_t>(count);
+            bool final = count == 0;
+            size_t consumed = executeBatch(buffer.data(), filled, final, out);
+            commands += count_if(buffer.data(), buffer.data() + consumed, [](char c) { return c == '\n'; });
+            memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+            filled -= consumed;
+            if (journal) journal->commit();
+            out.flush();
+            if (final) break;
+        }
+        return commands;
+    }
+};
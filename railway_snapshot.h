@@ -0,0 +1,271 @@
+// railway_snapshot.h
+#pragma once
+#include "railway.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary snapshot of the station -> platform -> line -> schedule tree
+//
+// Layout (native byte order, no padding):
+//   header    char[8] magic "RWSNAP\0\0", u32 version, u32 generation, u64 station count
+//   station   id, u32 name length, name bytes, u32 platform count
+//   platform  i32 number, u32 line count
+//   line      i32 number, u32 schedule count, then per schedule in
+//             insertion order a u16 (minute of day << 1 | stopping flag),
+//             with bit 15 set when a u8 day mask follows (daily trains
+//             omit it)
+//
+// Loading maps the file and rebuilds the model straight from it. Every
+// schedule in a snapshot was accepted when it was saved, so lines are
+// restored without repeating the conflict checks.
+//
+// The generation counts checkpoints: a journal (railway_journal.h) only
+// replays on top of the snapshot generation it was started against.
+
+constexpr char SNAPSHOT_MAGIC[8] = {'R', 'W', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr uint32_t SNAPSHOT_VERSION = 2;  // version 1 files (daily trains only) still load
+
+class SnapshotWriter {
+private:
+    string buffer;
+
+public:
+    template<typename U>
+    void write(U value) {
+        static_assert(is_trivially_copyable<U>::value, "Snapshot fields must be trivially copyable");
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(U));
+    }
+
+    void writeBytes(string_view bytes) {
+        write<uint32_t>(static_cast<uint32_t>(bytes.size()));
+        buffer.append(bytes.data(), bytes.size());
+    }
+
+    void writeRaw(string_view bytes) { buffer.append(bytes.data(), bytes.size()); }
+
+    const string& getBuffer() const { return buffer; }
+    void clear() { buffer.clear(); }
+
+    // Writes to a temporary file and renames it over path, so a crash
+    // mid-save never leaves a truncated snapshot behind.
+    void commit(const string& path) const {
+        string tempPath = path + ".tmp";
+        FILE* file = fopen(tempPath.c_str(), "wb");
+        if (!file) {
+            throw RailwayException("Cannot create snapshot '" + tempPath + "'");
+        }
+        bool ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        ok = fflush(file) == 0 && ok;
+        ok = fsync(fileno(file)) == 0 && ok;
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+            remove(tempPath.c_str());
+            throw RailwayException("Cannot write snapshot '" + path + "'");
+        }
+    }
+};
+
+class SnapshotReader {
+private:
+    const char* cursor;
+    const char* end;
+
+public:
+    SnapshotReader(const char* data, size_t size) : cursor(data), end(data + size) {}
+
+    template<typename U>
+    U read() {
+        if (static_cast<size_t>(end - cursor) < sizeof(U)) {
+            throw RailwayException("Snapshot is truncated");
+        }
+        U value;
+        memcpy(&value, cursor, sizeof(U));
+        cursor += sizeof(U);
+        return value;
+    }
+
+    string_view readBytes() {
+        uint32_t size = read<uint32_t>();
+        if (static_cast<size_t>(end - cursor) < size) {
+            throw RailwayException("Snapshot is truncated");
+        }
+        string_view bytes(cursor, size);
+        cursor += size;
+        return bytes;
+    }
+
+    size_t remaining() const { return static_cast<size_t>(end - cursor); }
+    bool atEnd() const { return cursor == end; }
+};
+
+// Station ID encoding: strings are length-prefixed, trivially copyable IDs
+// are stored as raw bytes.
+template<typename T, typename = void>
+struct SnapshotCodec;
+
+template<>
+struct SnapshotCodec<string> {
+    static void write(SnapshotWriter& writer, const string& id) { writer.writeBytes(id); }
+    static string read(SnapshotReader& reader) { return string(reader.readBytes()); }
+    static string_view readKey(SnapshotReader& reader) { return reader.readBytes(); }
+};
+
+template<typename T>
+struct SnapshotCodec<T, enable_if_t<is_trivially_copyable<T>::value>> {
+    static void write(SnapshotWriter& writer, const T& id) { writer.write<T>(id); }
+    static T read(SnapshotReader& reader) { return reader.read<T>(); }
+    static T readKey(SnapshotReader& reader) { return reader.read<T>(); }
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+
+public:
+    explicit MappedFile(const string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw RailwayException("Cannot open snapshot '" + path + "'");
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw RailwayException("Cannot read snapshot '" + path + "'");
+        }
+        size = static_cast<size_t>(info.st_size);
+        if (size > 0) {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                close(fd);
+                throw RailwayException("Cannot map snapshot '" + path + "'");
+            }
+            madvise(mapped, size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(mapped);
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (data) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* getData() const { return data; }
+    size_t getSize() const { return size; }
+};
+
+constexpr uint16_t SCHEDULE_HAS_DAYS = 0x8000;
+
+inline void writeSchedule(SnapshotWriter& writer, const TrainSchedule& schedule) {
+    uint16_t packed = static_cast<uint16_t>((schedule.time.toMinutes() << 1) | schedule.trainClass);
+    if (schedule.days.isDaily()) {
+        writer.write<uint16_t>(packed);
+    } else {
+        writer.write<uint16_t>(packed | SCHEDULE_HAS_DAYS);
+        writer.write<uint8_t>(schedule.days.getBits());
+    }
+}
+
+inline TrainSchedule readSchedule(SnapshotReader& reader) {
+    uint16_t packed = reader.read<uint16_t>();
+    int minute = (packed & ~SCHEDULE_HAS_DAYS) >> 1;
+    if (minute >= Time::MINUTES_PER_DAY) {
+        throw RailwayException("Snapshot holds an invalid time");
+    }
+    uint8_t days = (packed & SCHEDULE_HAS_DAYS) ? reader.read<uint8_t>() : DayMask::ALL;
+    if (days == 0 || days > DayMask::ALL) {
+        throw RailwayException("Snapshot holds an invalid day mask");
+    }
+    return TrainSchedule(Time::fromMinutes(minute), (packed & 1) != 0, DayMask(days));
+}
+
+template<typename T>
+void saveSnapshot(const RailwaySystem<T>& railway, const string& path, uint32_t generation = 0) {
+    SnapshotWriter writer;
+    for (char c : SNAPSHOT_MAGIC) writer.write<char>(c);
+    writer.write<uint32_t>(SNAPSHOT_VERSION);
+    writer.write<uint32_t>(generation);
+    writer.write<uint64_t>(railway.getStations().size());
+
+    for (const auto& station : railway.getStations()) {
+        SnapshotCodec<T>::write(writer, station->getId());
+        writer.writeBytes(station->getName());
+        writer.write<uint32_t>(static_cast<uint32_t>(station->getPlatforms().size()));
+        for (const auto& platform : station->getPlatforms()) {
+            writer.write<int32_t>(platform->getPlatformNumber());
+            writer.write<uint32_t>(static_cast<uint32_t>(platform->getLines().size()));
+            for (const auto& line : platform->getLines()) {
+                writer.write<int32_t>(line->getLineNumber());
+                writer.write<uint32_t>(static_cast<uint32_t>(line->getSchedules().size()));
+                for (const auto& schedule : line->getSchedules()) {
+                    writeSchedule(writer, schedule);
+                }
+            }
+        }
+    }
+    writer.commit(path);
+}
+
+// Loads a snapshot into an empty system and returns its generation. The
+// system is left untouched if the file is rejected.
+template<typename T>
+uint32_t loadSnapshot(RailwaySystem<T>& railway, const string& path) {
+    if (!railway.getStations().empty()) {
+        throw RailwayException("Snapshots can only be loaded into an empty system");
+    }
+    RailwaySystem<T> loaded;
+    MappedFile file(path);
+    SnapshotReader reader(file.getData(), file.getSize());
+
+    for (char expected : SNAPSHOT_MAGIC) {
+        if (reader.read<char>() != expected) {
+            throw RailwayException("Not a railway snapshot: '" + path + "'");
+        }
+    }
+    uint32_t version = reader.read<uint32_t>();
+    if (version == 0 || version > SNAPSHOT_VERSION) {
+        throw RailwayException("Unsupported snapshot version " + to_string(version));
+    }
+    uint32_t generation = reader.read<uint32_t>();
+
+    uint64_t stationCount = reader.read<uint64_t>();
+    for (uint64_t s = 0; s < stationCount; ++s) {
+        T id = SnapshotCodec<T>::read(reader);
+        auto* station = loaded.addStation(move(id), string(reader.readBytes()));
+        uint32_t platformCount = reader.read<uint32_t>();
+        for (uint32_t p = 0; p < platformCount; ++p) {
+            auto* platform = station->addPlatform(reader.read<int32_t>());
+            uint32_t lineCount = reader.read<uint32_t>();
+            for (uint32_t l = 0; l < lineCount; ++l) {
+                auto* line = platform->addLine(reader.read<int32_t>());
+                uint32_t scheduleCount = reader.read<uint32_t>();
+                if (scheduleCount > reader.remaining() / sizeof(uint16_t)) {
+                    throw RailwayException("Snapshot is truncated");
+                }
+                vector<TrainSchedule> schedules;
+                schedules.reserve(scheduleCount);
+                for (uint32_t i = 0; i < scheduleCount; ++i) {
+                    schedules.push_back(readSchedule(reader));
+                }
+                line->restoreSchedules(move(schedules));
+            }
+        }
+    }
+    if (!reader.atEnd()) {
+        throw RailwayException("Snapshot has trailing data");
+    }
+    railway = move(loaded);
+    return generation;
+}
@@ -1,7 +1,107 @@
 // railway_tests.cpp
 #include "railway.h"
+#include "railway_import.h"
+#include "railway_snapshot.h"
+#include "railway_flat.h"
+#include "railway_report.h"
+#include "railway_concurrent.h"
+#include "railway_script.h"
+#include "railway_journal.h"
+#include "railway_journey.h"
+#include "railway_workload.h"
+#include "railway_versioned.h"
+#include "railway_audit.h"
 #include <cassert>
+#include <cstdlib>
+#include <fcntl.h>
+#include <new>
 #include <iostream>
+#include <functional>
+#include <random>
+#include <set>
+#include <sstream>
+#include <fstream>
+#include <atomic>
+#include <thread>
+
+// Counts every heap allocation, for the allocation-free path checks.
+// Every form of operator new and delete is replaced, all over malloc and
+// free, so sanitizers see matching pairs. The shared helpers are kept out
+// of line: once inlined, the compiler pairs malloc with operator delete
+// and warns about a mismatch that is not there.
+std::atomic<size_t> allocationCount{0};
+
+__attribute__((noinline)) void* countedAllocate(std::size_t size, std::size_t alignment) noexcept {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) return std::malloc(size);
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+__attribute__((noinline)) void countedRelease(void* block) noexcept { std::free(block); }
+
+void* countedAllocateOrThrow(std::size_t size, std::size_t alignment) {
+    if (void* block = countedAllocate(size, alignment)) return block;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) { return countedAllocateOrThrow(size, 0); }
+void* operator new[](std::size_t size) { return countedAllocateOrThrow(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return countedAllocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return countedAllocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* block) noexcept { countedRelease(block); }
+void operator delete[](void* block) noexcept { countedRelease(block); }
+void operator delete(void* block, std::size_t) noexcept { countedRelease(block); }
+void operator delete[](void* block, std::size_t) noexcept { countedRelease(block); }
+void operator delete(void* block, std::align_val_t) noexcept { countedRelease(block); }
+void operator delete[](void* block, std::align_val_t) noexcept { countedRelease(block); }
+void operator delete(void* block, std::size_t, std::align_val_t) noexcept { countedRelease(block); }
+void operator delete[](void* block, std::size_t, std::align_val_t) noexcept { countedRelease(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { countedRelease(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { countedRelease(block); }
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept { countedRelease(block); }
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept { countedRelease(block); }
+
+// Station ID types without std::hash, used to exercise the index fallbacks
+struct OrderedId {
+    int value;
+    bool operator==(const OrderedId& other) const { return value == other.value; }
+    bool operator<(const OrderedId& other) const { return value < other.value; }
+};
+
+struct EqualityOnlyId {
+    int value;
+    bool operator==(const EqualityOnlyId& other) const { return value == other.value; }
+};
+
+// Through, stopping, freight and express trains
+inline constexpr HeadwayTable<4> FREIGHT_HEADWAY_TABLE = {{
+    {10, 30, 20, 15},
+    {30, 30, 30, 30},
+    {20, 30, 40, 25},
+    {15, 30, 25, 5},
+}};
+
+using FreightHeadways = FixedHeadways<4, FREIGHT_HEADWAY_TABLE>;
+constexpr TrainClass FREIGHT_TRAIN = 2;
+constexpr TrainClass EXPRESS_TRAIN = 3;
+
+static_assert(FreightHeadways::headway(FREIGHT_TRAIN, EXPRESS_TRAIN) == 25, "table lookup at compile time");
+static_assert(FreightHeadways::widest() == 40, "widest gap known at compile time");
+static_assert(StandardHeadways::headway(THROUGH_TRAIN, STOPPING_TRAIN) == STOPPING_HEADWAY, "standard rules");
 
 class TestRailwaySystem {
 private:
@@ -239,6 +339,1929 @@ private:
         } catch (const RailwayException&) {}
     }
 
+    static bool referenceCanAdd(const std::vector<TrainSchedule>& schedules,
+                                const Time& newTime, bool isStoppingTrain) {
+        for (const auto& schedule : schedules) {
+            int timeDiff = schedule.time.getCircularDifference(newTime);
+            int gap = (isStoppingTrain || schedule.isStoppingTrain()) ? 30 : 10;
+            if (timeDiff < gap) return false;
+        }
+        return true;
+    }
+
+    void testScheduleIndex() {
+        std::cout << "Testing ordered schedule index...\n";
+
+        // Boundaries of both headway windows
+        Line line(1);
+        line.addTrain(Time(10, 0), true);
+        assert(!line.canAddTrain(Time(9, 31), false));
+        assert(line.canAddTrain(Time(9, 30), false));
+        assert(!line.canAddTrain(Time(10, 29), true));
+        assert(line.canAddTrain(Time(10, 30), true));
+        line.addTrain(Time(12, 0), false);
+        assert(!line.canAddTrain(Time(12, 9), false));
+        assert(line.canAddTrain(Time(12, 10), false));
+        assert(!line.canAddTrain(Time(12, 29), true));
+
+        // Randomised comparison against the pairwise rule (daily trains wrap
+        // round midnight)
+        std::mt19937 rng(2024);
+        for (int round = 0; round < 50; ++round) {
+            Line randomLine(1);
+            for (int i = 0; i < 400; ++i) {
+                Time time(rng() % 24, rng() % 60);
+                bool stopping = rng() % 3 == 0;
+                bool expected = referenceCanAdd(randomLine.getSchedules(), time, stopping);
+                assert(randomLine.canAddTrain(time, stopping) == expected);
+                if (expected) {
+                    randomLine.addTrain(time, stopping);
+                }
+            }
+            const auto& timeline = randomLine.getTimeline();
+            assert(timeline.size() == randomLine.getSchedules().size());
+            assert(std::is_sorted(timeline.begin(), timeline.end(),
+                [](const TrainSchedule& a, const TrainSchedule& b) { return a.time < b.time; }));
+        }
+    }
+
+    template<typename T, typename MakeId>
+    void checkStationIndex(MakeId makeId) {
+        RailwaySystem<T> railway;
+        for (int i = 0; i < 200; ++i) {
+            railway.addStation(makeId(i), "Station");
+        }
+        for (int i = 0; i < 200; ++i) {
+            auto* station = railway.findStation(makeId(i));
+            assert(station != nullptr && station->getId() == makeId(i));
+            assert(railway.getStations()[i].get() == station);
+        }
+        assert(railway.findStation(makeId(500)) == nullptr);
+        try {
+            railway.addStation(makeId(7), "Duplicate");
+            assert(false && "Should throw exception for duplicate station ID");
+        } catch (const RailwayException&) {}
+    }
+
+    void testLookupIndexes() {
+        std::cout << "Testing lookup indexes...\n";
+
+        checkStationIndex<std::string>([](int i) { return "S" + std::to_string(i); });
+        checkStationIndex<int>([](int i) { return i; });
+        checkStationIndex<OrderedId>([](int i) { return OrderedId{i}; });
+        checkStationIndex<EqualityOnlyId>([](int i) { return EqualityOnlyId{i}; });
+
+        // Platforms and lines keep insertion order for display
+        RailwayStation<int> station(1, "Central");
+        station.addPlatforms({5, 3, 9});
+        station.addPlatform(1);
+        const auto& platforms = station.getPlatforms();
+        assert(platforms.size() == 4);
+        assert(platforms[0]->getPlatformNumber() == 5 && platforms[3]->getPlatformNumber() == 1);
+        assert(station.findPlatform(9) == platforms[2].get());
+
+        auto* platform = station.findPlatform(3);
+        platform->addLines({8, 2});
+        platform->addLine(4);
+        assert(platform->getLines()[1]->getLineNumber() == 2);
+        assert(platform->findLine(4) == platform->getLines()[2].get());
+        assert(platform->findLine(5) == nullptr);
+
+        station.addTrainSchedule(3, 4, Time(8, 0), true);
+        assert(platform->findLine(4)->getSchedules().size() == 1);
+    }
+
+    void testTimetableImport() {
+        std::cout << "Testing timetable import...\n";
+
+        RailwaySystem<std::string> railway;
+        std::ostringstream errors;
+        TimetableImporter<std::string> importer(railway, errors);
+        ImportStats stats = importer.importBuffer(
+            "# network\n"
+            "STATION,S1,Central Station\n"
+            "STATION\tS2\tNorth, East\n"
+            "PLATFORMS,S1,1,2\n"
+            "LINES,S1,1,1,2\r\n"
+            "\n"
+            "TRAIN,S1,1,1,10:00,S\n"
+            "TRAIN,S1,1,1,10:15,T\n"         // line 8: conflict
+            "TRAIN,S1,1,2,10:15,T\n"
+            "TRAIN,S9,1,1,11:00,S\n"         // line 10: unknown station
+            "TRAIN,S1,1,1,25:00,S\n"         // line 11: bad time
+            "BOGUS,S1\n"                     // line 12: unknown record
+            "TRAIN,S1,1,1,11:00,t");          // no trailing newline
+
+        assert(stats.rows == 11);
+        assert(stats.accepted == 7);
+        assert(stats.rejected == 4);
+        std::string report = errors.str();
+        assert(report.find("line 8: Time slot conflicts") != std::string::npos);
+        assert(report.find("line 10: Station not found") != std::string::npos);
+        assert(report.find("line 11: Invalid time format") != std::string::npos);
+        assert(report.find("line 12: Unknown record type 'BOGUS'") != std::string::npos);
+
+        auto* station = railway.findStation("S2");
+        assert(station != nullptr && station->getName() == "North, East");
+        auto* line = railway.findStation("S1")->findPlatform(1)->findLine(1);
+        assert(line->getSchedules().size() == 2);
+        assert(!line->getSchedules()[1].isStoppingTrain());
+
+        RailwaySystem<int> numbered;
+        TimetableImporter<int> numberedImporter(numbered, errors);
+        stats = numberedImporter.importBuffer("STATION,42,Depot\nSTATION,x1,Bad\n");
+        assert(stats.accepted == 1 && stats.rejected == 1);
+        assert(numbered.findStation(42) != nullptr);
+    }
+
+    void testSnapshot() {
+        std::cout << "Testing binary snapshots...\n";
+
+        RailwaySystem<std::string> railway;
+        railway.addStation("S1", "Central");
+        railway.addStation("S2", "North");
+        auto* station = railway.findStation("S1");
+        station->addPlatforms({2, 1});
+        station->findPlatform(2)->addLines({3, 1});
+        // Weekday late trains and a Monday-only early one never meet at midnight
+        station->addTrainSchedule(2, 3, Time(23, 59), false, DayMask::weekdays());
+        station->addTrainSchedule(2, 3, Time(0, 0), true, DayMask::only(0));
+        station->addTrainSchedule(2, 3, Time(12, 0), false);
+
+        const std::string path = "/tmp/railway_tests_snapshot.bin";
+        saveSnapshot(railway, path);
+
+        RailwaySystem<std::string> restored;
+        loadSnapshot(restored, path);
+        assert(restored.getStations().size() == 2);
+        assert(restored.getStations()[1]->getName() == "North");
+        auto* restoredStation = restored.findStation("S1");
+        assert(restoredStation->getPlatforms()[0]->getPlatformNumber() == 2);
+        auto* line = restoredStation->findPlatform(2)->findLine(3);
+        assert(line->getSchedules() == station->findPlatform(2)->findLine(3)->getSchedules());
+        assert(line->getTimeline().front().time == Time(0, 0));
+
+        // Restored lines keep enforcing the headway rules
+        try {
+            restoredStation->addTrainSchedule(2, 3, Time(12, 5), false);
+            assert(false && "Should throw exception for conflict on restored line");
+        } catch (const TimeConflictException&) {}
+
+        try {
+            loadSnapshot(restored, path);
+            assert(false && "Should throw exception when loading into a populated system");
+        } catch (const RailwayException&) {}
+
+        // Truncated and foreign files are rejected without touching the system
+        std::ifstream in(path, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::ofstream(path, std::ios::binary) << bytes.substr(0, bytes.size() - 1);
+        RailwaySystem<std::string> empty;
+        try {
+            loadSnapshot(empty, path);
+            assert(false && "Should throw exception for truncated snapshot");
+        } catch (const RailwayException&) {}
+        std::ofstream(path, std::ios::binary) << "not a snapshot";
+        try {
+            loadSnapshot(empty, path);
+            assert(false && "Should throw exception for bad magic");
+        } catch (const RailwayException&) {}
+        assert(empty.getStations().empty());
+
+        RailwaySystem<int> numbered;
+        numbered.addStation(7, "Depot");
+        saveSnapshot(numbered, path);
+        RailwaySystem<int> numberedCopy;
+        loadSnapshot(numberedCopy, path);
+        assert(numberedCopy.findStation(7) != nullptr);
+        std::remove(path.c_str());
+    }
+
+    void testFlatNetwork() {
+        std::cout << "Testing flat network storage...\n";
+
+        RailwaySystem<std::string> railway;
+        railway.addStation("S1", "Central");
+        railway.addStation("S2", "North");
+        railway.addStation("S3", "Empty");
+        railway.findStation("S1")->addPlatforms({4, 2});
+        railway.findStation("S2")->addPlatform(1);
+        railway.findStation("S1")->findPlatform(2)->addLines({7, 3});
+        railway.findStation("S2")->findPlatform(1)->addLine(1);
+        railway.findStation("S1")->addTrainSchedule(2, 3, Time(9, 0), true);
+        railway.findStation("S1")->addTrainSchedule(2, 3, Time(8, 0), false);
+        railway.findStation("S2")->addTrainSchedule(1, 1, Time(6, 0), true);
+
+        FlatRailwayNetwork<std::string> network(railway);
+        assert(network.getStationNodes().size() == 3);
+        assert(network.getPlatformNodes().size() == 3);
+        assert(network.getLineNodes().size() == 3);
+        assert(network.getAllSchedules().size() == 3);
+
+        auto station = network.findStation("S1");
+        assert(station && station.getName() == "Central");
+        assert(station.platformCount() == 2 && station.platform(0).getPlatformNumber() == 4);
+        assert(!station.findPlatform(9));
+        auto line = station.findPlatform(2).findLine(3);
+        assert(line && line.getLineNumber() == 3);
+        auto schedules = line.getSchedules();
+        assert(schedules.size() == 2 && schedules[0].time == Time(9, 0) && !schedules[1].isStoppingTrain());
+        assert(!station.findPlatform(2).findLine(1));
+        assert(!network.findStation("S9"));
+        assert(network.findStation("S3").platformCount() == 0);
+
+        // Parent links point back up the hierarchy
+        const auto& lineNode = network.getLineNodes()[line.getIndex()];
+        const auto& platformNode = network.getPlatformNodes()[lineNode.platform];
+        assert(platformNode.number == 2 && platformNode.station == station.getIndex());
+        assert(network.findStation("S2").findPlatform(1).findLine(1).getSchedules()[0].time == Time(6, 0));
+    }
+
+    void testCompactTime() {
+        std::cout << "Testing compact Time representation...\n";
+
+        static_assert(sizeof(Time) == 2, "Time should be a 2-byte minute of day");
+        static_assert(sizeof(TrainSchedule) <= 4, "TrainSchedule should stay compact");
+        constexpr Time morning(7, 45);
+        constexpr Time evening = Time::fromMinutes(19 * 60 + 5);
+        static_assert(morning < evening, "constexpr comparison");
+        static_assert(evening.getDifference(morning) == 680, "constexpr difference");
+        static_assert(morning.toMinutes() == 465 && evening.getHours() == 19, "constexpr accessors");
+
+        char buffer[Time::FORMATTED_SIZE + 1] = {};
+        char* end = Time(0, 5).format(buffer);
+        assert(end == buffer + Time::FORMATTED_SIZE);
+        assert(std::string(buffer) == "00:05");
+        assert(Time(23, 59).toString() == "23:59");
+        assert(Time::fromMinutes(0) == Time(0, 0));
+        assert(Time(10, 0) != Time(10, 1));
+
+        try {
+            Time::fromMinutes(Time::MINUTES_PER_DAY);
+            assert(false && "Should throw exception for minute past the end of day");
+        } catch (const RailwayException&) {}
+    }
+
+    template<typename T>
+    static std::string renderReport(const RailwaySystem<T>& railway, ReportFormat format,
+                                    ReportFilter<T> filter = {}) {
+        std::string text;
+        OutputBuffer out(text, 16);  // tiny buffer exercises the flush path
+        ReportWriter<T>(out, format, filter).write(railway);
+        out.flush();
+        return text;
+    }
+
+    void testReportWriter() {
+        std::cout << "Testing report writer...\n";
+
+        RailwaySystem<std::string> railway;
+        assert(renderReport(railway, ReportFormat::Table) ==
+               "\n=== Railway System Status ===\nNo stations in the system.\n");
+
+        railway.addStation("S1", "Central, Main");
+        railway.addStation("S2", "North");
+        auto* station = railway.findStation("S1");
+        station->addPlatforms({1, 2});
+        station->findPlatform(1)->addLine(1);
+        station->addTrainSchedule(1, 1, Time(9, 5), true);
+        station->addTrainSchedule(1, 1, Time(7, 0), false);
+
+        assert(renderReport(railway, ReportFormat::Table) ==
+               "\n=== Railway System Status ===\n"
+               "\nStation ID: S1\nName: Central, Main\n"
+               "\nPlatform 1:\n"
+               "\nLine 1 Schedule:\n"
+               "      Time     Train Type\n"
+               "-------------------------\n"
+               "     09:05       Stopping\n"
+               "     07:00        Through\n"
+               "-------------------------\n"
+               "\nPlatform 2:\nNo lines on this platform.\n"
+               "\nStation ID: S2\nName: North\nNo platforms in this station.\n");
+
+        assert(renderReport(railway, ReportFormat::Csv) ==
+               "station_id,station_name,platform,line,time,train_type,days\n"
+               "S1,\"Central, Main\",1,1,09:05,S,MTWTFSS\n"
+               "S1,\"Central, Main\",1,1,07:00,T,MTWTFSS\n");
+
+        ReportFilter<std::string> morning;
+        morning.from = Time(6, 0);
+        morning.to = Time(8, 0);
+        assert(renderReport(railway, ReportFormat::JsonLines, morning) ==
+               "{\"station\":\"S1\",\"name\":\"Central, Main\",\"platform\":1,\"line\":1,"
+               "\"time\":\"07:00\",\"type\":\"through\",\"days\":\"MTWTFSS\"}\n");
+
+        ReportFilter<std::string> onlyNorth;
+        onlyNorth.station = "S2";
+        assert(renderReport(railway, ReportFormat::Table, onlyNorth) ==
+               "\n=== Railway System Status ===\n"
+               "\nStation ID: S2\nName: North\nNo platforms in this station.\n");
+
+        ReportFilter<std::string> platformTwo;
+        platformTwo.platform = 2;
+        assert(renderReport(railway, ReportFormat::Csv, platformTwo) ==
+               "station_id,station_name,platform,line,time,train_type,days\n");
+
+        RailwaySystem<int> numbered;
+        numbered.addStation(12, "Depot \"A\"");
+        numbered.findStation(12)->addPlatform(3);
+        numbered.findStation(12)->findPlatform(3)->addLine(1);
+        numbered.findStation(12)->addTrainSchedule(3, 1, Time(23, 59), true);
+        assert(renderReport(numbered, ReportFormat::JsonLines) ==
+               "{\"station\":12,\"name\":\"Depot \\\"A\\\"\",\"platform\":3,\"line\":1,"
+               "\"time\":\"23:59\",\"type\":\"stopping\",\"days\":\"MTWTFSS\"}\n");
+    }
+
+    static bool conflictFree(const std::vector<TrainSchedule>& schedules) {
+        for (size_t i = 0; i < schedules.size(); ++i) {
+            for (size_t j = i + 1; j < schedules.size(); ++j) {
+                int gap = (schedules[i].isStoppingTrain() || schedules[j].isStoppingTrain()) ? 30 : 10;
+                if (schedules[i].time.getDifference(schedules[j].time) < gap) return false;
+            }
+        }
+        return true;
+    }
+
+    void testConcurrentInserts() {
+        std::cout << "Testing concurrent inserts...\n";
+
+        ConcurrentRailwaySystem<std::string> railway;
+        const std::vector<std::string> stations = {"S1", "S2", "S3"};
+        for (const auto& id : stations) {
+            railway.addStation(id, "Station " + id);
+            railway.addPlatforms(id, {1, 2});
+            railway.addLines(id, 1, {1, 2});
+            railway.addLines(id, 2, {1});
+        }
+
+        const int threadCount = 8;
+        const int attempts = 3000;
+        std::atomic<int> accepted{0};
+        std::atomic<int> removed{0};
+        std::atomic<bool> writing{true};
+        std::atomic<bool> readerOk{true};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&, t] {
+                std::mt19937 rng(t + 1);
+                // Each thread removes and reschedules only its own trains
+                std::vector<std::pair<std::string, TrainHandle>> mine;
+                for (int i = 0; i < attempts; ++i) {
+                    if (!mine.empty() && rng() % 6 == 0) {
+                        size_t pick = rng() % mine.size();
+                        const auto& [id, handle] = mine[pick];
+                        if (rng() % 2) {
+                            bool gone = railway.removeTrain(id, handle);
+                            assert(gone && !railway.removeTrain(id, handle));
+                            (void)gone;
+                            ++removed;
+                            mine[pick] = mine.back();
+                            mine.pop_back();
+                        } else {
+                            AddResult moved = railway.rescheduleTrain(id, handle, Time(rng() % 24, rng() % 60),
+                                                                      STOPPING_TRAIN);
+                            assert(moved ? moved.handle == handle : moved.status == AddStatus::Conflict);
+                            (void)moved;
+                        }
+                        continue;
+                    }
+                    const auto& id = stations[rng() % stations.size()];
+                    int platform = 1 + rng() % 2;
+                    int line = platform == 1 ? 1 + rng() % 2 : 1;
+                    AddResult result = railway.tryAddTrainSchedule(id, platform, line, Time(rng() % 24, rng() % 60),
+                                                                    rng() % 4 == 0 ? STOPPING_TRAIN : THROUGH_TRAIN);
+                    if (result) {
+                        assert(result.handle.platformNumber == platform && result.handle.lineNumber == line);
+                        mine.emplace_back(id, result.handle);
+                        ++accepted;
+                    } else {
+                        assert(result.status == AddStatus::Conflict);
+                    }
+                }
+            });
+        }
+        // Structural writes and readers run alongside the inserts
+        threads.emplace_back([&] {
+            for (int i = 0; i < 50; ++i) {
+                std::string id = "X" + std::to_string(i);
+                railway.addStation(id, "Extra");
+                railway.addPlatforms(id, {1});
+                railway.addLines(id, 1, {1, 2, 3});
+                railway.addTrainSchedule(id, 1, 2, Time(12, 0), STOPPING_TRAIN);
+            }
+        });
+        std::thread reader([&] {
+            while (writing) {
+                for (const auto& id : stations) {
+                    if (!conflictFree(railway.getSchedules(id, 1, 1))) readerOk = false;
+                }
+                std::string text;
+                OutputBuffer out(text);
+                ReportWriter<std::string> writer(out, ReportFormat::Csv);
+                railway.writeReport(writer);
+            }
+        });
+        for (auto& thread : threads) thread.join();
+        writing = false;
+        reader.join();
+        assert(readerOk);
+
+        size_t stored = 0;
+        for (const auto& id : stations) {
+            for (auto key : {std::make_pair(1, 1), std::make_pair(1, 2), std::make_pair(2, 1)}) {
+                auto schedules = railway.getSchedules(id, key.first, key.second);
+                assert(conflictFree(schedules));
+                stored += schedules.size();
+            }
+        }
+        assert(stored == static_cast<size_t>(accepted - removed) && removed > 0);
+        assert(railway.hasStation("X49"));
+        assert(!railway.removeTrain("nowhere", TrainHandle{1, 1, 0}));
+        assert(railway.rescheduleTrain("S1", TrainHandle{1, 9, 0}, Time(1, 0), THROUGH_TRAIN).status ==
+               AddStatus::LineNotFound);
+        assert(railway.getSchedules("X49", 1, 2).size() == 1);
+
+        try {
+            railway.addTrainSchedule("S1", 3, 1, Time(1, 0), STOPPING_TRAIN);
+            assert(false && "Should throw exception for non-existent platform");
+        } catch (const RailwayException&) {}
+    }
+
+    void testFreeSlotQueries() {
+        std::cout << "Testing free slot queries...\n";
+
+        // The masks agree with canAddTrain at every minute
+        std::mt19937 rng(99);
+        for (int round = 0; round < 20; ++round) {
+            Line line(1);
+            for (int i = 0; i < 60; ++i) {
+                Time time = Time::fromMinutes(rng() % Time::MINUTES_PER_DAY);
+                bool stopping = rng() % 2 == 0;
+                if (line.canAddTrain(time, stopping)) line.addTrain(time, stopping);
+            }
+            for (int minute = 0; minute < Time::MINUTES_PER_DAY; ++minute) {
+                for (bool stopping : {false, true}) {
+                    bool free = !line.getBlockedMask(stopping).test(minute);
+                    assert(free == line.canAddTrain(Time::fromMinutes(minute), stopping));
+                }
+            }
+        }
+
+        Line line(1);
+        assert(line.nextFreeSlot(Time(5, 0), true) == Time(5, 0));
+        line.addTrain(Time(10, 0), true);
+        line.addTrain(Time(11, 0), false);
+        assert(line.nextFreeSlot(Time(9, 45), true) == Time(10, 30));
+        assert(line.nextFreeSlot(Time(9, 45), false) == Time(10, 30));
+        assert(line.nextFreeSlot(Time(10, 55), false) == Time(11, 10));
+        assert(line.nextFreeSlot(Time(10, 55), true) == Time(11, 30));
+        auto windows = line.freeWindows(true);
+        assert(windows.size() == 3);
+        assert((windows[0] == TimeWindow{Time(0, 0), Time(9, 30)}));
+        assert((windows[1] == TimeWindow{Time(10, 30), Time(10, 30)}));
+        assert((windows[2] == TimeWindow{Time(11, 30), Time(23, 59)}));
+
+        // A day that is completely blocked has no slot
+        Line busy(2);
+        for (int minute = 0; minute < Time::MINUTES_PER_DAY; minute += 10) {
+            busy.addTrain(Time::fromMinutes(minute), false);
+        }
+        assert(!busy.nextFreeSlot(Time(0, 0), true));
+        assert(busy.freeWindows(false).empty());
+
+        // Platforms and stations are free where any line is free
+        RailwayStation<int> station(1, "Central");
+        station.addPlatforms({1, 2});
+        station.findPlatform(1)->addLines({1, 2});
+        station.findPlatform(2)->addLine(1);
+        assert(station.findPlatform(2)->nextFreeSlot(Time(0, 0), false) == Time(0, 0));
+        for (int minute = 0; minute < Time::MINUTES_PER_DAY; minute += 30) {
+            station.addTrainSchedule(1, 1, Time::fromMinutes(minute), true);
+            station.addTrainSchedule(1, 2, Time::fromMinutes(minute), true);
+        }
+        for (int minute = 0; minute < 12 * 60; minute += 30) {
+            station.addTrainSchedule(2, 1, Time::fromMinutes(minute), true);
+        }
+        assert(!station.findPlatform(1)->nextFreeSlot(Time(0, 0), false));
+        assert(station.findPlatform(2)->nextFreeSlot(Time(3, 0), true) == Time(12, 0));
+        assert(station.nextFreeSlot(Time(3, 0), true) == Time(12, 0));
+        assert(station.findPlatform(2)->findFreeLine(Time(12, 0), true)->getLineNumber() == 1);
+        assert(station.findPlatform(1)->findFreeLine(Time(12, 0), true) == nullptr);
+        auto stationWindows = station.freeWindows(false);
+        assert(stationWindows.size() == 1);
+        // The 00:00 stopping train also blocks the half hour before midnight
+        assert((stationWindows[0] == TimeWindow{Time(12, 0), Time(23, 30)}));
+        assert(Platform(9).freeWindows(true).empty());
+
+        // Restored lines rebuild their masks
+        Line restored(3);
+        restored.restoreSchedules(line.getSchedules());
+        assert(restored.nextFreeSlot(Time(9, 45), true) == Time(10, 30));
+    }
+
+    void testTryAddTrain() {
+        std::cout << "Testing non-throwing insert API...\n";
+
+        RailwaySystem<std::string> railway;
+        railway.addStation("S1", "Central");
+        auto* station = railway.findStation("S1");
+        station->addPlatform(1);
+        station->findPlatform(1)->addLine(1);
+
+        AddResult added = station->tryAddTrainSchedule(1, 1, Time(10, 0), true);
+        assert(added && added.status == AddStatus::Added);
+
+        AddResult conflict = station->tryAddTrainSchedule(1, 1, Time(10, 20), false);
+        assert(!conflict && conflict.status == AddStatus::Conflict);
+        assert(conflict.conflict == TrainSchedule(Time(10, 0), true));
+
+        assert(station->tryAddTrainSchedule(2, 1, Time(12, 0), true).status == AddStatus::PlatformNotFound);
+        assert(station->tryAddTrainSchedule(1, 2, Time(12, 0), true).status == AddStatus::LineNotFound);
+        assert(railway.tryAddTrainSchedule("S9", 1, 1, Time(12, 0), true).status == AddStatus::StationNotFound);
+        assert(railway.tryAddTrainSchedule("S1", 1, 1, Time(12, 0), false));
+        assert(station->findPlatform(1)->findLine(1)->getSchedules().size() == 2);
+
+        // The throwing API keeps its exception types and messages
+        try {
+            station->addTrainSchedule(1, 1, Time(12, 5), false);
+            assert(false && "Should throw exception for time conflict");
+        } catch (const TimeConflictException& e) {
+            assert(std::string(e.what()) == "Time slot conflicts with existing schedule");
+        }
+        try {
+            station->addTrainSchedule(1, 7, Time(15, 0), false);
+            assert(false && "Should throw exception for non-existent line");
+        } catch (const TimeConflictException&) {
+            assert(false && "Missing line is not a time conflict");
+        } catch (const RailwayException& e) {
+            assert(std::string(e.what()) == "Line not found on this platform");
+        }
+
+        ConcurrentRailwaySystem<std::string> concurrent;
+        concurrent.addStation("S1", "Central");
+        concurrent.addPlatforms("S1", {1});
+        concurrent.addLines("S1", 1, {1});
+        assert(concurrent.tryAddTrainSchedule("S1", 1, 1, Time(8, 0), THROUGH_TRAIN));
+        assert(concurrent.tryAddTrainSchedule("S1", 1, 1, Time(8, 5), THROUGH_TRAIN).conflict.time == Time(8, 0));
+        assert(concurrent.tryAddTrainSchedule("S2", 1, 1, Time(8, 0), THROUGH_TRAIN).status ==
+               AddStatus::StationNotFound);
+        // Inserts and moves accept the same classes
+        assert(concurrent.tryAddTrainSchedule("S1", 1, 1, Time(9, 0), 2).status == AddStatus::InvalidTrainClass);
+        TrainHandle handle = concurrent.tryAddTrainSchedule("S1", 1, 1, Time(10, 0), STOPPING_TRAIN).handle;
+        assert(concurrent.rescheduleTrain("S1", handle, Time(10, 0), 2).status == AddStatus::InvalidTrainClass);
+    }
+
+    std::string runScript(RailwaySystem<std::string>& railway, const std::string& commands) {
+        std::string responses;
+        {
+            OutputBuffer out(responses);
+            CommandProcessor<std::string> processor(railway);
+            size_t consumed = processor.executeBatch(commands.data(), commands.size(), true, out);
+            assert(consumed == commands.size());
+        }
+        return responses;
+    }
+
+    void testScriptMode() {
+        std::cout << "Testing scripted command mode...\n";
+
+        RailwaySystem<std::string> railway;
+        std::string responses = runScript(railway,
+            "ADD_STATION S1 Central Station\n"
+            "ADD_PLATFORMS S1 1 2\n"
+            "ADD_LINES S1 1 1 2\n"
+            "ADD_TRAIN S1 1 1 10:00 S\n"
+            "ADD_TRAIN S1 1 1 09:00 T\n"
+            "ADD_TRAIN S1 1 1 10:20 T\n"
+            "ADD_TRAIN S1 1 9 10:00 S\r\n"
+            "QUERY S1\n"
+            "QUERY S1 1\n"
+            "QUERY S1 1 1\n"
+            "QUERY S9\n"
+            "ADD_TRAIN S1 1 1 25:00 S\n"
+            "\n"
+            "REMOVE S1\n"
+            "ADD_STATION S1 Duplicate\n"
+            "QUERY S1 2");
+        assert(responses ==
+            "OK\n"
+            "OK\n"
+            "OK\n"
+            "OK\n"
+            "OK\n"
+            "CONFLICT 10:00 S\n"
+            "ERR Line not found on this platform\n"
+            "OK 2 2 2 Central Station\n"
+            "OK 1 2\n"
+            "OK 09:00T 10:00S\n"
+            "ERR Station not found\n"
+            "ERR Invalid time format\n"
+            "ERR Empty command\n"
+            "ERR Unknown command 'REMOVE'\n"
+            "ERR Station ID already exists\n"
+            "OK\n");
+
+        // A trailing partial command waits for the next block
+        std::string pending = "QUERY S1 1 1\nQUERY S1";
+        std::string out;
+        {
+            OutputBuffer buffer(out);
+            CommandProcessor<std::string> processor(railway);
+            size_t consumed = processor.executeBatch(pending.data(), pending.size(), false, buffer);
+            assert(consumed == pending.find('\n') + 1);
+        }
+        assert(out == "OK 09:00T 10:00S\n");
+
+        // End to end through file descriptors
+        int input[2], output[2];
+        assert(pipe(input) == 0 && pipe(output) == 0);
+        std::string commands = "ADD_TRAIN S1 1 2 11:00 S\nQUERY S1 1 2\n";
+        assert(write(input[1], commands.data(), commands.size()) == static_cast<ssize_t>(commands.size()));
+        close(input[1]);
+        assert(CommandProcessor<std::string>(railway).serve(input[0], output[1]) == 2);
+        close(input[0]);
+        close(output[1]);
+        char reply[64];
+        ssize_t size = read(output[0], reply, sizeof(reply));
+        close(output[0]);
+        assert(std::string(reply, size) == "OK\nOK 11:00S\n");
+    }
+
+    void testJournal() {
+        std::cout << "Testing mutation journal...\n";
+
+        const std::string path = "/tmp/railway_tests_journal.bin";
+        const std::string snapshotPath = "/tmp/railway_tests_journal_snapshot.bin";
+        std::remove(path.c_str());
+
+        RailwaySystem<std::string> railway;
+        {
+            RailwayJournal<std::string> journal(railway, path);
+            assert(journal.getReplay().records == 0);
+            auto* station = journal.addStation("S1", "Central");
+            journal.addPlatforms(*station, {1, 2});
+            journal.addLines(*station, *station->findPlatform(1), {1});
+            assert(journal.tryAddTrainSchedule(*station, 1, 1, Time(10, 0), true));
+            assert(!journal.tryAddTrainSchedule(*station, 1, 1, Time(10, 10), false));
+            try {
+                journal.addPlatforms(*station, {3, 1});
+                assert(false && "Should throw exception for duplicate platform");
+            } catch (const RailwayException&) {}
+            journal.commit();
+            assert(journal.pendingBytes() == 0);
+
+            // Importer rows are journaled too
+            std::ostringstream errors;
+            TimetableImporter<std::string> importer(railway, errors, &journal);
+            assert(importer.importBuffer("TRAIN,S1,1,1,08:00,T\nTRAIN,S1,1,1,08:05,T\n").rejected == 1);
+            assert(journal.pendingBytes() == 0);
+        }
+
+        auto sameSchedules = [](const RailwaySystem<std::string>& a, const RailwaySystem<std::string>& b) {
+            return a.findStation("S1")->findPlatform(1)->findLine(1)->getSchedules() ==
+                   b.findStation("S1")->findPlatform(1)->findLine(1)->getSchedules();
+        };
+
+        // Replay rebuilds the same state, including the partly added list
+        RailwaySystem<std::string> recovered;
+        {
+            RailwayJournal<std::string> journal(recovered, path);
+            assert(journal.getReplay().records == 7);
+            assert(journal.getReplay().tornBytes == 0);
+        }
+        assert(sameSchedules(railway, recovered));
+        assert(recovered.findStation("S1")->getPlatforms().size() == 3);
+        auto* line = recovered.findStation("S1")->findPlatform(1)->findLine(1);
+        assert(line->getTimeline().front().time == Time(8, 0));
+        assert(!line->canAddTrain(Time(10, 20), false));
+
+        // A torn tail from a crash mid-commit is cut off
+        {
+            std::ofstream torn(path, std::ios::binary | std::ios::app);
+            torn.write("\x20\0\0\0garbage", 11);
+        }
+        {
+            RailwaySystem<std::string> afterCrash;
+            RailwayJournal<std::string> journal(afterCrash, path);
+            assert(journal.getReplay().records == 7);
+            assert(journal.getReplay().tornBytes == 11);
+            assert(sameSchedules(railway, afterCrash));
+            journal.tryAddTrainSchedule(*afterCrash.findStation("S1"), 1, 1, Time(20, 0), false);
+        }
+        {
+            RailwaySystem<std::string> repaired;
+            RailwayJournal<std::string> journal(repaired, path);
+            assert(journal.getReplay().records == 8 && journal.getReplay().tornBytes == 0);
+
+            // Checkpoint: snapshot of the next generation, then an empty journal
+            saveSnapshot(repaired, snapshotPath, 1);
+            journal.reset(1);
+            journal.tryAddTrainSchedule(*repaired.findStation("S1"), 1, 1, Time(21, 0), false);
+        }
+        {
+            RailwaySystem<std::string> restored;
+            uint32_t generation = loadSnapshot(restored, snapshotPath);
+            assert(generation == 1);
+            RailwayJournal<std::string> journal(restored, path, generation);
+            assert(journal.getReplay().records == 1);
+            assert(restored.findStation("S1")->findPlatform(1)->findLine(1)->getSchedules().size() == 4);
+
+            // A snapshot saved without resetting the journal makes it stale
+            saveSnapshot(restored, snapshotPath, 2);
+        }
+        {
+            RailwaySystem<std::string> restored;
+            RailwayJournal<std::string> journal(restored, path, loadSnapshot(restored, snapshotPath));
+            assert(journal.getReplay().stale && journal.getReplay().records == 0);
+            assert(restored.findStation("S1")->findPlatform(1)->findLine(1)->getSchedules().size() == 4);
+        }
+        try {
+            RailwaySystem<std::string> empty;
+            RailwayJournal<std::string> journal(empty, path, 1);
+            assert(false && "Should reject a journal newer than the snapshot");
+        } catch (const RailwayException&) {}
+
+        std::remove(path.c_str());
+        std::remove(snapshotPath.c_str());
+    }
+
+    void testPeriodicSchedules() {
+        std::cout << "Testing periodic schedules...\n";
+
+        DayMask weekdays = DayMask::weekdays();
+        assert(weekdays.toString() == "MTWTF--");
+        assert(DayMask::only(6).following() == DayMask::only(0));
+        assert(weekdays.following().toString() == "-TWTFS-");
+        assert(!weekdays.overlaps(DayMask::weekends()));
+        assert(parseDays("weekends") == DayMask::weekends());
+        assert(parseDays("Sun") == DayMask::only(6));
+        assert(parseDays("M-W-F--").toString() == "M-W-F--");
+        try {
+            parseDays("MX-----");
+            assert(false && "Should reject an invalid day pattern");
+        } catch (const RailwayException&) {}
+        try {
+            DayMask(0);
+            assert(false && "Should reject an empty day mask");
+        } catch (const RailwayException&) {}
+
+        // Headways wrap around midnight
+        Line daily(1);
+        daily.addTrain(Time(23, 50), false);
+        assert(daily.canAddTrain(Time(0, 5), false));
+        assert(!daily.canAddTrain(Time(0, 5), true));
+        assert(!daily.canAddTrain(Time(23, 45), true));
+        assert(daily.findConflict(Time(0, 10), true)->time == Time(23, 50));
+
+        // Trains on disjoint days never conflict
+        Line weekly(1);
+        weekly.addTrain(Time(12, 0), true, weekdays);
+        assert(weekly.canAddTrain(Time(12, 0), true, DayMask::weekends()));
+        assert(!weekly.canAddTrain(Time(12, 10), false, DayMask::only(2)));
+        weekly.addTrain(Time(12, 0), true, DayMask::weekends());
+        assert(!weekly.canAddTrain(Time(12, 0), true));
+
+        // A late Friday train blocks early Saturday, a late Sunday train
+        // blocks early Monday
+        Line wrap(1);
+        wrap.addTrain(Time(23, 50), true, weekdays);
+        assert(!wrap.canAddTrain(Time(0, 5), true, DayMask::only(5)));
+        assert(wrap.canAddTrain(Time(0, 5), true, DayMask::only(0)));
+        assert(!wrap.canAddTrain(Time(23, 30), true, DayMask::only(3)));
+        wrap.addTrain(Time(23, 50), true, DayMask::only(6));
+        assert(!wrap.canAddTrain(Time(0, 5), true, DayMask::only(0)));
+
+        // On-demand masks agree with the conflict check
+        for (DayMask days : {DayMask::daily(), weekdays, DayMask::only(0), DayMask::only(5), DayMask::weekends()}) {
+            for (bool stopping : {false, true}) {
+                MinuteMask mask = wrap.getBlockedMask(stopping, days);
+                for (int minute = 0; minute < Time::MINUTES_PER_DAY; ++minute) {
+                    assert(mask.test(minute) == !wrap.canAddTrain(Time::fromMinutes(minute), stopping, days));
+                }
+            }
+        }
+
+        // Days travel through imports, scripts, snapshots and the journal
+        RailwaySystem<std::string> railway;
+        std::ostringstream errors;
+        TimetableImporter<std::string> importer(railway, errors);
+        auto summary = importer.importBuffer(
+            "STATION,S1,Central\nPLATFORMS,S1,1\nLINES,S1,1,1\n"
+            "TRAIN,S1,1,1,23:50,S,weekdays\nTRAIN,S1,1,1,00:05,S,Mon\nTRAIN,S1,1,1,00:05,S,Sat\n");
+        assert(summary.rejected == 1);
+        assert(errors.str().find("23:50 stopping train, MTWTF--") != std::string::npos);
+
+        assert(runScript(railway, "ADD_TRAIN S1 1 1 00:10 S weekends\n"
+                                  "ADD_TRAIN S1 1 1 12:00 T\n"
+                                  "QUERY S1 1 1\n") ==
+               "CONFLICT 23:50 S MTWTF--\nOK\nOK 00:05S/M------ 12:00T 23:50S/MTWTF--\n");
+
+        const std::string snapshotPath = "/tmp/railway_tests_periodic.bin";
+        const std::string journalPath = "/tmp/railway_tests_periodic_journal.bin";
+        std::remove(journalPath.c_str());
+        saveSnapshot(railway, snapshotPath);
+        RailwaySystem<std::string> loaded;
+        loadSnapshot(loaded, snapshotPath);
+        auto schedules = [](const RailwaySystem<std::string>& system) {
+            return system.findStation("S1")->findPlatform(1)->findLine(1)->getSchedules();
+        };
+        assert(schedules(loaded) == schedules(railway));
+        {
+            RailwayJournal<std::string> journal(loaded, journalPath);
+            journal.addTrainSchedule(*loaded.findStation("S1"), 1, 1, Time(18, 0), true, DayMask::only(6));
+        }
+        RailwaySystem<std::string> recovered;
+        loadSnapshot(recovered, snapshotPath);
+        {
+            RailwayJournal<std::string> journal(recovered, journalPath);
+            assert(journal.getReplay().records == 1);
+        }
+        assert(schedules(recovered) == schedules(loaded));
+        assert(!recovered.findStation("S1")->findPlatform(1)->findLine(1)->canAddTrain(Time(18, 0), true, DayMask::weekends()));
+        std::remove(snapshotPath.c_str());
+        std::remove(journalPath.c_str());
+    }
+
+    void testJourneyPlanner() {
+        std::cout << "Testing journey planner...\n";
+
+        RailwaySystem<std::string> railway;
+        for (const char* id : {"A", "B", "C", "D", "E"}) railway.addStation(id, id);
+
+        // Trip 1 runs A-B-C; changing at B for the direct B-C hop needs a transfer
+        JourneyPlanner<std::string> planner(railway, 5);
+        planner.addConnection("B", Time(8, 32), "C", Time(8, 50));
+        planner.addConnection("A", Time(8, 0), "B", Time(8, 30), 1);
+        planner.addConnection("B", Time(8, 35), "C", Time(9, 0), 1);
+        planner.addConnection("B", Time(8, 40), "C", Time(8, 55));
+        planner.addConnection("C", Time(23, 30), "D", Time(0, 20));
+        planner.addConnection("C", Time(9, 30), "E", Time(9, 45));
+        assert(planner.getConnectionCount() == 6);
+
+        auto journey = planner.earliestArrival("A", "C", Time(7, 0));
+        assert(journey && journey->arrival == Time(8, 55));
+        assert(journey->departure == Time(8, 0) && journey->minutes == 55);
+        assert(journey->legs.size() == 2);
+        assert(planner.getStation(journey->legs[0].to).getId() == "B");
+        assert(journey->legs[1].departure == Time(8, 40));
+
+        // Staying on trip 1 beats the later change at B when the change is too tight
+        JourneyPlanner<std::string> tight(railway, 15);
+        tight.addConnection("A", Time(8, 0), "B", Time(8, 30), 1);
+        tight.addConnection("B", Time(8, 35), "C", Time(9, 0), 1);
+        tight.addConnection("B", Time(8, 40), "C", Time(8, 55));
+        journey = tight.earliestArrival("A", "C", Time(8, 0));
+        assert(journey && journey->arrival == Time(9, 0));
+        assert(journey->legs.size() == 1 && journey->legs[0].trip == 1);
+        assert(tight.getStation(journey->legs[0].from).getId() == "A");
+
+        // Arrivals after midnight are reported, further travel that day is not
+        journey = planner.earliestArrival("C", "D", Time(12, 0));
+        assert(journey && journey->arrival == Time(0, 20) && journey->arrivesNextDay());
+        assert(journey->minutes == 50);
+        assert(!planner.earliestArrival("A", "E", Time(9, 0)));
+        assert(!planner.earliestArrival("D", "A", Time(0, 0)));
+        assert(planner.earliestArrival("E", "E", Time(6, 0))->minutes == 0);
+        try {
+            planner.earliestArrival("A", "Z", Time(8, 0));
+            assert(false && "Should throw exception for unknown station");
+        } catch (const RailwayException&) {}
+        try {
+            planner.addConnection("A", Time(8, 0), "B", Time(8, 0));
+            assert(false && "Should reject a zero-length connection");
+        } catch (const RailwayException&) {}
+
+        // Random networks against a brute-force fixpoint, single and batch
+        std::mt19937 rng(17);
+        const int stations = 40;
+        const int transfer = 5;
+        RailwaySystem<int> network;
+        for (int s = 0; s < stations; ++s) network.addStation(s, "Station");
+        JourneyPlanner<int> random(network, transfer);
+        struct Hop { int from, to, departure, arrival; };
+        std::vector<Hop> hops;
+        for (int i = 0; i < 600; ++i) {
+            int from = rng() % stations, to = rng() % stations;
+            if (from == to) continue;
+            int departure = rng() % Time::MINUTES_PER_DAY;
+            int arrival = departure + 1 + rng() % 90;
+            hops.push_back({from, to, departure, arrival});
+            random.addConnection(from, Time::fromMinutes(departure), to,
+                                 Time::fromMinutes(arrival % Time::MINUTES_PER_DAY));
+        }
+        auto reference = [&](int source, int departAfter) {
+            std::vector<int> best(stations, INT32_MAX);
+            best[source] = departAfter;
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (const auto& hop : hops) {
+                    if (best[hop.from] == INT32_MAX) continue;
+                    int ready = best[hop.from] + (hop.from == source ? 0 : transfer);
+                    if (ready <= hop.departure && hop.departure >= departAfter && hop.arrival < best[hop.to]) {
+                        best[hop.to] = hop.arrival;
+                        changed = true;
+                    }
+                }
+            }
+            return best;
+        };
+        std::vector<JourneyQuery<int>> queries;
+        for (int q = 0; q < 200; ++q) {
+            queries.push_back({int(rng() % stations), int(rng() % stations), Time::fromMinutes(rng() % 1200)});
+        }
+        queries.push_back(queries.front());
+        auto batch = random.earliestArrivals(queries);
+        for (size_t q = 0; q < queries.size(); ++q) {
+            const auto& query = queries[q];
+            auto best = reference(query.from, query.departAfter.toMinutes());
+            auto single = random.earliestArrival(query.from, query.to, query.departAfter);
+            assert(single.has_value() == (best[query.to] != INT32_MAX));
+            assert(batch[q].has_value() == single.has_value());
+            if (!single) continue;
+            assert(single->departure.toMinutes() + single->minutes == best[query.to]);
+            assert(batch[q]->minutes == single->minutes && batch[q]->departure == single->departure);
+            for (size_t leg = 1; leg < single->legs.size(); ++leg) {
+                assert(single->legs[leg - 1].to == single->legs[leg].from);
+                assert(single->legs[leg - 1].arrival.toMinutes() + transfer <= single->legs[leg].departure.toMinutes());
+            }
+        }
+    }
+
+    void testAllocationFreePaths() {
+        std::cout << "Testing allocation-free lookups and views...\n";
+
+        RailwaySystem<std::string> railway;
+        runScript(railway, "ADD_STATION Central-Interchange-0001 Central Interchange\n"
+                           "ADD_PLATFORMS Central-Interchange-0001 1 2\n"
+                           "ADD_LINES Central-Interchange-0001 1 1 2\n"
+                           "ADD_TRAIN Central-Interchange-0001 1 1 10:00 S\n"
+                           "ADD_TRAIN Central-Interchange-0001 1 2 10:00 T weekdays\n");
+        std::string_view id = "Central-Interchange-0001";
+        const std::string commands = "ADD_TRAIN Central-Interchange-0001 1 1 10:10 S\n"
+                                     "QUERY Central-Interchange-0001\n"
+                                     "QUERY Central-Interchange-0001 1 2\n";
+
+        int devNull = open("/dev/null", O_WRONLY);
+        IncrementalTableView<std::string> view;
+        CommandProcessor<std::string> processor(railway);
+        {
+            OutputBuffer out(devNull);
+            view.writeAll(railway, out);
+            size_t before = allocationCount.load();
+            for (int i = 0; i < 100; ++i) {
+                assert(railway.findStation(id) != nullptr);
+                assert(railway.getStations().front()->getName() == "Central Interchange");
+                processor.executeBatch(commands.data(), commands.size(), true, out);
+                view.writeAll(railway, out);
+            }
+            assert(allocationCount.load() == before);
+        }
+        close(devNull);
+    }
+
+    void testHeadwayPolicies() {
+        std::cout << "Testing headway policies...\n";
+
+        BasicLine<FreightHeadways> line(1);
+        line.addTrain(Time(10, 0), FREIGHT_TRAIN);
+        assert(!line.canAddTrain(Time(10, 24), EXPRESS_TRAIN));
+        assert(line.canAddTrain(Time(10, 25), EXPRESS_TRAIN));
+        assert(!line.canAddTrain(Time(10, 39), FREIGHT_TRAIN));
+        assert(line.canAddTrain(Time(9, 20), FREIGHT_TRAIN));
+        assert(line.canAddTrain(Time(9, 40), THROUGH_TRAIN));
+        line.addTrain(Time(10, 40), EXPRESS_TRAIN);
+        assert(line.canAddTrain(Time(10, 45), EXPRESS_TRAIN));
+        assert(!line.canAddTrain(Time(10, 44), EXPRESS_TRAIN));
+        assert(line.findConflict(Time(23, 50), FREIGHT_TRAIN) == nullptr);
+
+        // Classes outside the table are refused, not read out of bounds
+        assert(line.tryAddTrain(Time(15, 0), 4).status == AddStatus::InvalidTrainClass);
+        assert(!line.canAddTrain(Time(15, 0), 4));
+        try {
+            line.getBlockedMask(4);
+            assert(false && "Should throw exception for an unknown train class");
+        } catch (const RailwayException&) {}
+        try {
+            line.findConflict(Time(15, 0), 4);
+            assert(false && "Should throw exception for an unknown train class");
+        } catch (const RailwayException&) {}
+        MinuteMask scratch;
+        try {
+            line.blockAround(scratch, TrainSchedule(Time(15, 0), 4), THROUGH_TRAIN, DayMask::daily());
+            assert(false && "Should throw exception for an unknown train class");
+        } catch (const RailwayException&) {}
+        try {
+            line.blockAround(scratch, TrainSchedule(Time(15, 0), FREIGHT_TRAIN), 4, DayMask::daily());
+            assert(false && "Should throw exception for an unknown train class");
+        } catch (const RailwayException&) {}
+        assert(scratch.nextSet(0) == Time::MINUTES_PER_DAY);
+
+        // Masks agree with the conflict check for every class
+        for (TrainClass trainClass = 0; trainClass < FreightHeadways::CLASSES; ++trainClass) {
+            for (DayMask days : {DayMask::daily(), DayMask::weekends()}) {
+                MinuteMask mask = line.getBlockedMask(trainClass, days);
+                for (int minute = 0; minute < Time::MINUTES_PER_DAY; ++minute) {
+                    assert(mask.test(minute) == !line.canAddTrain(Time::fromMinutes(minute), trainClass, days));
+                }
+            }
+        }
+
+        // The whole model follows the policy
+        RailwaySystem<int, FreightHeadways> freight;
+        freight.addStation(1, "Yard")->addPlatform(1)->addLines({1, 2});
+        assert(freight.tryAddTrainSchedule(1, 1, 1, Time(6, 0), FREIGHT_TRAIN));
+        assert(freight.tryAddTrainSchedule(1, 1, 1, Time(6, 30), FREIGHT_TRAIN).status == AddStatus::Conflict);
+        assert(freight.findStation(1)->findPlatform(1)->findFreeLine(Time(6, 30), FREIGHT_TRAIN)->getLineNumber() == 2);
+        assert(freight.findStation(1)->nextFreeSlot(Time(6, 0), FREIGHT_TRAIN) == Time(6, 0));
+
+        // Runtime tables, one per line, e.g. read from a data file
+        assert(parseHeadways("10 30; 30 30").headway(THROUGH_TRAIN, STOPPING_TRAIN) == 30);
+        for (const char* invalid : {"10 30; 20 30", "10 30", "0", "10 x; 30 30", "1 1 1 1 1; 1 1 1 1 1; 1 1 1 1 1; "
+                                    "1 1 1 1 1; 1 1 1 1 1", "300"}) {
+            try {
+                parseHeadways(invalid);
+                assert(false && "Should reject an invalid headway table");
+            } catch (const RailwayException&) {}
+        }
+        RailwaySystem<std::string, RuntimeHeadways> configured;
+        auto* platform = configured.addStation("S1", "Central")->addPlatform(1);
+        platform->addLine(1);
+        platform->addLine(2, parseHeadways("5 5; 5 5"));
+        platform->addLine(3, parseHeadways("10 20 45; 20 20 45; 45 45 60"));
+        auto* station = configured.findStation("S1");
+        for (int l = 1; l <= 3; ++l) station->addTrainSchedule(1, l, Time(12, 0), STOPPING_TRAIN);
+        assert(!platform->findLine(1)->canAddTrain(Time(12, 20), THROUGH_TRAIN));
+        assert(platform->findLine(2)->canAddTrain(Time(12, 5), STOPPING_TRAIN));
+        assert(!platform->findLine(3)->canAddTrain(Time(12, 40), FREIGHT_TRAIN));
+        assert(platform->findLine(3)->canAddTrain(Time(12, 45), FREIGHT_TRAIN));
+        assert(station->tryAddTrainSchedule(1, 1, Time(18, 0), FREIGHT_TRAIN).status == AddStatus::InvalidTrainClass);
+        assert(platform->findLine(3)->getPolicy().widest() == 60);
+
+        // Imports build runtime-table lines from HEADWAYS rows
+        RailwaySystem<std::string, RuntimeHeadways> imported;
+        std::ostringstream importErrors;
+        ImportStats importStats = TimetableImporter<std::string, RuntimeHeadways>(imported, importErrors).importBuffer(
+            "STATION,S1,Central\nPLATFORMS,S1,1\nLINES,S1,1,1\nHEADWAYS,S1,1,2,10 20 45; 20 20 45; 45 45 60\n"
+            "TRAIN,S1,1,2,12:00,2\nTRAIN,S1,1,2,12:40,S\nTRAIN,S1,1,2,12:45,T\nTRAIN,S1,1,1,13:00,2\n"
+            "HEADWAYS,S1,1,3,10 30; 20 30\n");
+        assert(importStats.accepted == 6 && importStats.rejected == 3);
+        const auto* importedLine = imported.findStation("S1")->findPlatform(1)->findLine(2);
+        assert(importedLine->getPolicy().widest() == 60 && importedLine->getSchedules().size() == 2);
+        assert(importedLine->getSchedules()[0].trainClass == FREIGHT_TRAIN);
+        assert(importErrors.str().find("line 8: Train class not covered") != std::string::npos);
+        assert(!imported.findStation("S1")->findPlatform(1)->findLine(3));
+
+        RailwaySystem<std::string> standardImport;
+        std::ostringstream standardErrors;
+        ImportStats standardStats = TimetableImporter<std::string>(standardImport, standardErrors).importBuffer(
+            "STATION,S1,Central\nPLATFORMS,S1,1\nHEADWAYS,S1,1,1,10 30; 30 30\nLINES,S1,1,1\nTRAIN,S1,1,1,08:00,2\n");
+        assert(standardStats.rejected == 2);
+        assert(standardErrors.str().find("need a RuntimeHeadways network") != std::string::npos);
+
+        RailwaySystem<std::string, RuntimeHeadways> deferredRuntime;
+        std::ostringstream deferredErrors;
+        TimetableImporter<std::string, RuntimeHeadways> deferredImporter(deferredRuntime, deferredErrors);
+        deferredImporter.deferChecks(1);
+        ImportStats deferredStats = deferredImporter.importBuffer(
+            "STATION,S1,Central\nPLATFORMS,S1,1\nHEADWAYS,S1,1,1,5 5; 5 5\n"
+            "TRAIN,S1,1,1,12:00,T\nTRAIN,S1,1,1,12:04,S\nTRAIN,S1,1,1,12:10,2\n");
+        assert(deferredStats.rejected == 1 && deferredStats.conflicts == 1);
+
+        // Reports and displays work for every policy
+        std::string table = renderView([&](OutputBuffer& out) {
+            ReportWriter<std::string>(out, ReportFormat::Table).write(configured);
+        });
+        assert(table.find("Line 3 Schedule:") != std::string::npos);
+        assert(captureStdout([&] { configured.displayAllStations(); }) == table);
+        IncrementalTableView<std::string, RuntimeHeadways> configuredView;
+        assert(renderView([&](OutputBuffer& out) { configuredView.writeAll(configured, out); }) == table);
+        station->addTrainSchedule(1, 2, Time(12, 5), THROUGH_TRAIN);
+        assert(renderView([&](OutputBuffer& out) { configuredView.writeChanges(configured, out); })
+                   .find("12:05") != std::string::npos);
+
+        std::string freightTable = renderView([&](OutputBuffer& out) {
+            ReportWriter<int>(out, ReportFormat::Csv).write(freight);
+        });
+        assert(freightTable.find("1,Yard,1,1,06:00,T,MTWTFSS") != std::string::npos);
+        assert(captureStdout([&] { freight.displayAllStations(); }).find("Station ID: 1") != std::string::npos);
+        IncrementalTableView<int, FreightHeadways> freightView;
+        assert(renderView([&](OutputBuffer& out) { freightView.writeAll(freight, out); }) ==
+               captureStdout([&] { freight.displayAllStations(); }));
+    }
+
+    void testWorkloadGenerator() {
+        std::cout << "Testing workload generator...\n";
+
+        WorkloadShape shape;
+        shape.stations = 20;
+        shape.platforms = 2;
+        shape.lines = 3;
+        shape.trains = 40;
+        shape.conflictPercent = 25;
+        shape.seed = 9;
+        assert(parseWorkloadShape("20x2x3x40").trainRows() == shape.trainRows());
+
+        auto render = [](const WorkloadShape& workload) {
+            std::string text;
+            {
+                OutputBuffer out(text);
+                WorkloadGenerator(workload).writeImport(out);
+            }
+            return text;
+        };
+        std::string text = render(shape);
+        assert(text == render(shape));
+        WorkloadShape reseeded = shape;
+        reseeded.seed = 10;
+        assert(text != render(reseeded));
+
+        // Exactly the rows aimed at a conflict are rejected, through the
+        // importer and through the direct load alike
+        WorkloadGenerator generator(shape);
+        RailwaySystem<std::string> direct;
+        ImportStats loaded = generator.load(direct);
+        size_t aimed = generator.getConflictRows();
+        assert(aimed > shape.trainRows() / 6 && aimed < shape.trainRows() / 3);
+        assert(loaded.rejected == aimed);
+        assert(loaded.rows == shape.stations * (2 + shape.platforms) + shape.trainRows());
+
+        RailwaySystem<std::string> imported;
+        std::ostringstream errors;
+        ImportStats stats = TimetableImporter<std::string>(imported, errors).importBuffer(text);
+        assert(stats.rows == loaded.rows && stats.rejected == aimed && stats.accepted == loaded.accepted);
+        for (size_t s = 0; s < direct.getStations().size(); ++s) {
+            const auto& a = *direct.getStations()[s];
+            const auto& b = *imported.getStations()[s];
+            assert(a.getId() == b.getId() && a.getName() == b.getName());
+            for (size_t p = 0; p < a.getPlatforms().size(); ++p) {
+                for (size_t l = 0; l < a.getPlatforms()[p]->getLines().size(); ++l) {
+                    assert(a.getPlatforms()[p]->getLines()[l]->getSchedules() ==
+                           b.getPlatforms()[p]->getLines()[l]->getSchedules());
+                }
+            }
+        }
+
+        // Dense through-only lines and integer IDs
+        shape.trains = 144;
+        shape.conflictPercent = 0;
+        RailwaySystem<int> dense;
+        assert(WorkloadGenerator(shape).load(dense).rejected == 0);
+        assert(dense.findStation(19)->findPlatform(2)->findLine(3)->getSchedules().size() == 144);
+        try {
+            shape.trains = 145;
+            WorkloadGenerator rejected(shape);
+            assert(false && "Should reject more trains than a line can hold");
+        } catch (const RailwayException&) {}
+
+        // The optimized conflict paths agree with the linear reference
+        DifferentialResult differential = runDifferential(50000, 3);
+        assert(differential.inserts == 50000);
+        assert(differential.mismatches == 0);
+        assert(differential.accepted > 1000 && differential.accepted < differential.inserts);
+    }
+
+    // Most trains of one class that fit on `lines` empty lines, by trying
+    // every line (or none) for each request
+    static size_t bruteForceAssignable(const vector<TrainRequest>& requests, int lines) {
+        size_t best = 0;
+        vector<vector<TrainSchedule>> placed(lines);
+        auto fits = [](const vector<TrainSchedule>& schedules, const TrainRequest& request) {
+            return referenceCanAddTrain(schedules, request.time, request.trainClass);
+        };
+        function<void(size_t, size_t)> search = [&](size_t next, size_t count) {
+            best = max(best, count);
+            if (next == requests.size() || count + (requests.size() - next) <= best) return;
+            for (auto& line : placed) {
+                if (!fits(line, requests[next])) continue;
+                line.push_back(TrainSchedule(requests[next].time, requests[next].trainClass));
+                search(next + 1, count + 1);
+                line.pop_back();
+            }
+            search(next + 1, count);
+        };
+        search(0, 0);
+        return best;
+    }
+
+    void testTrainAssignment() {
+        std::cout << "Testing batch train assignment...\n";
+
+        // Through trains every 5 minutes alternate between two lines
+        RailwayStation<int> station(1, "Central");
+        station.addPlatform(1)->addLines({1, 2});
+        vector<TrainRequest> requests;
+        for (int minute = 8 * 60; minute <= 9 * 60; minute += 5) {
+            requests.push_back({Time::fromMinutes(minute), THROUGH_TRAIN});
+        }
+        TrainPlan plan = station.assignTrains(requests);
+        assert(plan.assigned.size() == requests.size() && plan.unplaced.empty());
+        assert(plan.assigned[0].lineNumber == 1 && plan.assigned[1].lineNumber == 2);
+        assert(station.findPlatform(1)->findLine(1)->getSchedules().size() == 7);
+        assert(station.findPlatform(1)->findLine(2)->getSchedules().size() == 6);
+
+        // Existing trains, midnight and unknown classes are respected
+        RailwayStation<int> night(2, "Night");
+        night.addPlatform(1)->addLine(1);
+        night.addTrainSchedule(1, 1, Time(0, 10), true);
+        requests = {{Time(23, 50), STOPPING_TRAIN}, {Time(0, 50), THROUGH_TRAIN}, {Time(0, 20), THROUGH_TRAIN},
+                    {Time(12, 0), 7}};
+        plan = night.planTrains(requests);
+        assert(night.findPlatform(1)->findLine(1)->getSchedules().size() == 1);
+        assert(plan.assigned.size() == 1 && plan.assigned[0].request == 1);
+        assert((plan.unplaced == vector<size_t>{2, 3, 0}));
+
+        // Windows that cross midnight: starting the sweep at 00:00 would
+        // take 00:05 and lose both of the others
+        RailwayStation<int> wrap(4, "Wrap");
+        wrap.addPlatform(1)->addLine(1);
+        requests = {{Time(0, 5), THROUGH_TRAIN}, {Time(23, 58), THROUGH_TRAIN}, {Time(0, 8), THROUGH_TRAIN}};
+        plan = wrap.planTrains(requests);
+        assert(plan.assigned.size() == 2 && (plan.unplaced == vector<size_t>{0}));
+
+        // Plans are conflict-free, placed trains are counted exactly once,
+        // and with one train class nothing better exists, over the whole
+        // day and around midnight in particular
+        mt19937 rng(17);
+        for (int round = 0; round < 400; ++round) {
+            int lines = 1 + static_cast<int>(rng() % 3);
+            TrainClass trainClass = rng() % 2 ? STOPPING_TRAIN : THROUGH_TRAIN;
+            int spread = trainClass == STOPPING_TRAIN ? 120 : 40;
+            bool midnight = round % 2 == 0;
+            requests.clear();
+            for (int i = 0, count = 2 + static_cast<int>(rng() % 8); i < count; ++i) {
+                int minute = midnight ? Time::MINUTES_PER_DAY - spread / 2 + static_cast<int>(rng() % spread)
+                                      : static_cast<int>(rng() % Time::MINUTES_PER_DAY);
+                requests.push_back({Time::fromMinutes(minute % Time::MINUTES_PER_DAY), trainClass});
+            }
+            RailwayStation<int> trial(round, "Trial");
+            trial.addPlatform(1)->addLine(1);
+            if (lines > 1) trial.addPlatform(2)->addLines(lines == 2 ? vector<int>{1} : vector<int>{1, 2});
+            plan = trial.assignTrains(requests);
+            assert(plan.assigned.size() + plan.unplaced.size() == requests.size());
+            assert(plan.assigned.size() == bruteForceAssignable(requests, lines));
+            size_t stored = 0;
+            for (const auto& platform : trial.getPlatforms()) {
+                for (const auto& line : platform->getLines()) {
+                    const auto& schedules = line->getSchedules();
+                    for (size_t i = 0; i < schedules.size(); ++i) {
+                        vector<TrainSchedule> others(schedules.begin(), schedules.begin() + i);
+                        assert(referenceCanAddTrain(others, schedules[i].time, schedules[i].trainClass));
+                    }
+                    stored += schedules.size();
+                }
+            }
+            assert(stored == plan.assigned.size());
+        }
+
+        // A full day of mixed requests on a busy station
+        RailwayStation<int> busy(3, "Busy");
+        for (int p = 1; p <= 4; ++p) busy.addPlatform(p)->addLines({1, 2, 3, 4});
+        requests.clear();
+        for (int i = 0; i < 3000; ++i) {
+            requests.push_back({Time::fromMinutes(static_cast<int>(rng() % Time::MINUTES_PER_DAY)),
+                                static_cast<TrainClass>(rng() % 4 == 0)});
+        }
+        plan = busy.assignTrains(requests);
+        assert(plan.assigned.size() > 1500 && !plan.unplaced.empty());
+        for (size_t index : plan.unplaced) {
+            for (const auto& platform : busy.getPlatforms()) {
+                assert(!platform->findFreeLine(requests[index].time, requests[index].trainClass));
+            }
+        }
+    }
+
+    void testTimetableQueries() {
+        std::cout << "Testing time-range queries...\n";
+
+        RailwayStation<int> station(1, "Central");
+        station.addPlatform(1)->addLines({1, 2});
+        station.addPlatform(2)->addLine(1);
+        station.addTrainSchedule(1, 1, Time(7, 30), true);
+        station.addTrainSchedule(1, 2, Time(7, 0), false);
+        station.addTrainSchedule(2, 1, Time(7, 0), false, DayMask::weekdays());
+        station.addTrainSchedule(1, 1, Time(23, 50), false);
+        station.addTrainSchedule(2, 1, Time(0, 5), false);
+
+        auto collect = [](TimetableCursor<StandardHeadways> cursor) {
+            vector<string> seen;
+            ScheduledTrain train;
+            while (cursor.next(train)) {
+                seen.push_back(train.schedule->time.toString() + "@" + to_string(train.platformNumber) + "." +
+                               to_string(train.lineNumber) + (train.nextDay ? "+" : ""));
+            }
+            return seen;
+        };
+        assert((collect(station.trainsBetween(Time(7, 0), Time(9, 0))) ==
+                vector<string>{"07:00@1.2", "07:00@2.1", "07:30@1.1"}));
+        assert((collect(station.trainsBetween(Time(7, 0), Time(9, 0), DayMask::weekends())) ==
+                vector<string>{"07:00@1.2", "07:30@1.1"}));
+        assert((collect(station.trainsBetween(Time(23, 0), Time(1, 0))) ==
+                vector<string>{"23:50@1.1", "00:05@2.1+"}));
+        assert(collect(station.trainsBetween(Time(8, 0), Time(9, 0))).empty());
+
+        auto board = station.nextTrains(Time(7, 15), 3);
+        assert(board.size() == 3);
+        assert(board[0].schedule->time == Time(7, 30) && !board[0].nextDay);
+        assert(board[1].schedule->time == Time(23, 50));
+        assert(board[2].schedule->time == Time(0, 5) && board[2].nextDay);
+        assert(station.nextTrains(Time(0, 0), 10).size() == 5);
+
+        // Against a full sort of every train, for random ranges and days
+        mt19937 rng(29);
+        RailwayStation<int> busy(2, "Busy");
+        for (int p = 1; p <= 5; ++p) busy.addPlatform(p)->addLines({1, 2, 3});
+        for (int i = 0; i < 2000; ++i) {
+            DayMask days = rng() % 3 ? DayMask::daily() : DayMask(static_cast<uint8_t>(1 + rng() % DayMask::ALL));
+            busy.findPlatform(1 + rng() % 5)->findLine(1 + rng() % 3)
+                ->tryAddTrain(Time::fromMinutes(static_cast<int>(rng() % Time::MINUTES_PER_DAY)), rng() & 1, days);
+        }
+        struct Entry { int minute; int position; const TrainSchedule* schedule; };
+        vector<Entry> all;
+        int position = 0;
+        for (const auto& platform : busy.getPlatforms()) {
+            for (const auto& line : platform->getLines()) {
+                for (const auto& schedule : line->getTimeline()) {
+                    all.push_back({schedule.time.toMinutes(), position, &schedule});
+                }
+                ++position;
+            }
+        }
+        // Trains on disjoint days can share a minute on one line
+        stable_sort(all.begin(), all.end(), [](const Entry& a, const Entry& b) {
+            return a.minute != b.minute ? a.minute < b.minute : a.position < b.position;
+        });
+        auto expected = [&](int first, int last, DayMask days) {
+            vector<const TrainSchedule*> trains;
+            for (const auto& entry : all) {
+                if (entry.minute >= first && entry.minute <= last && entry.schedule->days.overlaps(days)) {
+                    trains.push_back(entry.schedule);
+                }
+            }
+            return trains;
+        };
+        // A whole-day range sizes the heap for every line; restarts reuse it
+        auto cursor = busy.trainsBetween(Time(0, 0), Time(23, 59));
+        for (int round = 0; round < 300; ++round) {
+            Time from = Time::fromMinutes(static_cast<int>(rng() % Time::MINUTES_PER_DAY));
+            Time to = Time::fromMinutes(static_cast<int>(rng() % Time::MINUTES_PER_DAY));
+            DayMask days = DayMask::only(static_cast<int>(rng() % DayMask::DAYS));
+            vector<const TrainSchedule*> want = to < from
+                ? expected(from.toMinutes(), Time::MINUTES_PER_DAY - 1, days)
+                : expected(from.toMinutes(), to.toMinutes(), days);
+            if (to < from) {
+                auto after = expected(0, to.toMinutes(), days.following());
+                want.insert(want.end(), after.begin(), after.end());
+            }
+            size_t before = allocationCount.load();
+            cursor.restart(from, to, days);
+            vector<const TrainSchedule*> got;
+            got.reserve(want.size());
+            ScheduledTrain train;
+            while (cursor.next(train)) got.push_back(train.schedule);
+            assert(allocationCount.load() - before <= 1);  // the reserve above
+            assert(got == want);
+        }
+    }
+
+    void testTrainRemoval() {
+        std::cout << "Testing train removal and rescheduling...\n";
+
+        Line line(1);
+        TrainId early = line.tryAddTrain(Time(8, 0), true).handle.train;
+        TrainId middle = line.tryAddTrain(Time(8, 30), true).handle.train;
+        TrainId late = line.tryAddTrain(Time(9, 0), false).handle.train;
+        assert(early != middle && middle != late && late != NO_TRAIN);
+        assert(!line.canAddTrain(Time(8, 45), false));
+
+        assert(line.removeTrain(middle));
+        assert(!line.removeTrain(middle) && !line.findTrain(middle));
+        assert(line.findTrain(early)->time == Time(8, 0) && line.findTrain(late)->time == Time(9, 0));
+        assert(line.canAddTrain(Time(8, 45), false) && !line.canAddTrain(Time(8, 29), false));
+        assert((line.getSchedules() == vector<TrainSchedule>{TrainSchedule(Time(8, 0), true),
+                                                           TrainSchedule(Time(9, 0), false)}));
+
+        // A failed move leaves the train alone; a successful one keeps its
+        // handle and its place in insertion order
+        AddResult blocked = line.rescheduleTrain(early, Time(8, 55), true);
+        assert(blocked.status == AddStatus::Conflict && blocked.conflict.time == Time(9, 0));
+        assert(line.findTrain(early)->time == Time(8, 0));
+        AddResult moved = line.rescheduleTrain(early, Time(8, 10), true);  // only near itself
+        assert(moved && moved.handle.train == early);
+        assert(line.getSchedules().front().time == Time(8, 10) && line.getTimeline().front().time == Time(8, 10));
+        assert(line.rescheduleTrain(middle, Time(12, 0), true).status == AddStatus::TrainNotFound);
+        assert(line.rescheduleTrain(early, Time(12, 0), 5).status == AddStatus::InvalidTrainClass);
+        assert(line.findTrain(TrainSchedule(Time(9, 0), false)) == late);
+        assert(line.findTrain(TrainSchedule(Time(9, 0), true)) == NO_TRAIN);
+
+        // Moving a train to its own stored time, passed by reference
+        const TrainSchedule& stored = *line.findTrain(early);
+        assert(line.rescheduleTrain(early, stored.time, stored.trainClass, stored.days));
+        assert(line.findTrain(early)->time == Time(8, 10) && line.findTrain(late)->time == Time(9, 0));
+
+        // Removal near midnight repairs both ends of the day
+        Line night(2);
+        TrainId lastTrain = night.tryAddTrain(Time(23, 50), true).handle.train;
+        night.addTrain(Time(0, 30), true);
+        assert(!night.canAddTrain(Time(0, 5), true));
+        night.removeTrain(lastTrain);
+        assert(night.canAddTrain(Time(0, 0), true) && !night.canAddTrain(Time(0, 1), true));
+
+        // Station handles carry the platform
+        RailwayStation<int> station(1, "Central");
+        station.addPlatform(2)->addLine(3);
+        TrainHandle handle = station.tryAddTrainSchedule(2, 3, Time(10, 0), false).handle;
+        assert(handle.platformNumber == 2 && handle.lineNumber == 3);
+        assert(station.rescheduleTrain(handle, Time(11, 0), true).handle == handle);
+        assert(station.findTrain(handle)->time == Time(11, 0));
+        assert(station.rescheduleTrain({1, 3, handle.train}, Time(12, 0), true).status == AddStatus::PlatformNotFound);
+        assert(station.removeTrain(handle) && !station.removeTrain(handle));
+
+        // Random cancellations and moves leave exactly the masks a rebuild
+        // would produce
+        mt19937 rng(41);
+        Line busy(3);
+        for (int round = 0; round < 5000; ++round) {
+            DayMask days = rng() % 3 ? DayMask::daily() : DayMask(static_cast<uint8_t>(1 + rng() % DayMask::ALL));
+            busy.tryAddTrain(Time::fromMinutes(static_cast<int>(rng() % Time::MINUTES_PER_DAY)), rng() & 1, days);
+            if (busy.getSchedules().empty() || rng() % 3) continue;
+            TrainId train = busy.getTrainIds()[rng() % busy.getTrainIds().size()];
+            if (rng() & 1) {
+                busy.removeTrain(train);
+            } else {
+                const TrainSchedule& current = *busy.findTrain(train);
+                busy.rescheduleTrain(train, Time::fromMinutes((current.time.toMinutes() + 1440 - 20 +
+                                     static_cast<int>(rng() % 41)) % 1440), current.trainClass, current.days);
+            }
+            if (round % 50 == 0) {
+                Line rebuilt(3);
+                rebuilt.restoreSchedules(busy.getSchedules());
+                assert(rebuilt.getTimeline() == busy.getTimeline());
+                for (TrainClass c : {THROUGH_TRAIN, STOPPING_TRAIN}) {
+                    assert(rebuilt.getBlockedMask(c).getWords() == busy.getBlockedMask(c).getWords());
+                }
+            }
+        }
+        assert(std::is_sorted(busy.getTrainIds().begin(), busy.getTrainIds().end()));
+        DifferentialResult differential = runDifferential(30000, 5);
+        assert(differential.mismatches == 0 && differential.removals > 0 && differential.reschedules > 0);
+
+        // Cancellations and moves survive a journal replay
+        const std::string path = "/tmp/railway_tests_removal_journal.bin";
+        std::remove(path.c_str());
+        RailwaySystem<std::string> railway;
+        {
+            RailwayJournal<std::string> journal(railway, path);
+            auto* central = journal.addStation("S1", "Central");
+            journal.addPlatforms(*central, {1});
+            journal.addLines(*central, *central->findPlatform(1), {1});
+            TrainHandle first = journal.tryAddTrainSchedule(*central, 1, 1, Time(7, 0), true).handle;
+            TrainHandle second = journal.tryAddTrainSchedule(*central, 1, 1, Time(8, 0), false).handle;
+            journal.tryAddTrainSchedule(*central, 1, 1, Time(9, 0), false);
+            assert(journal.removeTrain(*central, second) && !journal.removeTrain(*central, second));
+            assert(journal.rescheduleTrain(*central, first, Time(7, 45), true));
+            assert(!journal.rescheduleTrain(*central, first, Time(8, 50), true));
+        }
+        RailwaySystem<std::string> recovered;
+        {
+            RailwayJournal<std::string> journal(recovered, path);
+            assert(journal.getReplay().records == 8);
+        }
+        assert(recovered.findStation("S1")->findPlatform(1)->findLine(1)->getSchedules() ==
+               railway.findStation("S1")->findPlatform(1)->findLine(1)->getSchedules());
+        std::remove(path.c_str());
+    }
+
+    void testVersionedSnapshots() {
+        std::cout << "Testing versioned snapshots...\n";
+
+        using Versioned = VersionedRailwaySystem<std::string>;
+        Versioned versioned;
+        {
+            auto writer = versioned.write();
+            writer.addStation("S1", "Central");
+            writer.addStation("S2", "North");
+            writer.addPlatforms("S1", {1, 2});
+            writer.addLines("S1", 1, {1, 2});
+            writer.addLines("S1", 2, {1});
+            try {
+                writer.addStation("S1", "Again");
+                assert(false && "Should throw exception for duplicate station");
+            } catch (const RailwayException&) {}
+        }
+        assert(versioned.getPublishedVersion() == 2);
+
+        auto before = versioned.snapshot();
+        TrainHandle handle = versioned.tryAddTrainSchedule("S1", 1, 1, Time(8, 0), STOPPING_TRAIN).handle;
+        assert(handle.platformNumber == 1 && handle.lineNumber == 1);
+        assert(versioned.tryAddTrainSchedule("S1", 1, 1, Time(8, 10), THROUGH_TRAIN).status == AddStatus::Conflict);
+        assert(versioned.tryAddTrainSchedule("S1", 1, 3, Time(8, 10), THROUGH_TRAIN).status == AddStatus::LineNotFound);
+        assert(versioned.tryAddTrainSchedule("S9", 1, 1, Time(8, 10), THROUGH_TRAIN).status ==
+               AddStatus::StationNotFound);
+        assert(versioned.getPublishedVersion() == 3);  // rejected inserts publish nothing
+        {
+            auto writer = versioned.write();
+            writer.tryAddTrainSchedule("S1", 1, 2, Time(9, 0), THROUGH_TRAIN);
+            writer.tryAddTrainSchedule("S1", 2, 1, Time(10, 0), THROUGH_TRAIN, DayMask::weekends());
+            assert(writer.rescheduleTrain("S1", handle, Time(7, 30), STOPPING_TRAIN));
+            assert(writer.rescheduleTrain("S1", {1, 1, 99}, Time(7, 30), STOPPING_TRAIN).status ==
+                   AddStatus::TrainNotFound);
+        }
+        {
+            auto after = versioned.snapshot();
+            assert(after.getVersion() == 4);
+
+            // The older snapshot still shows the state it pinned
+            const auto* oldLine = before.findStation("S1")->findPlatform(1)->findLine(1);
+            const auto* newLine = after.findStation("S1")->findPlatform(1)->findLine(1);
+            assert(oldLine->getSchedules().empty());
+            assert(newLine->getSchedules().size() == 1 && newLine->getSchedules()[0].time == Time(7, 30));
+            assert(before.findStation("S2") == &before.station(1) && !after.findStation("S3"));
+
+            // Snapshots render exactly like the live tree with the same content
+            RailwaySystem<std::string> live;
+            live.addStation("S1", "Central");
+            live.addStation("S2", "North");
+            live.findStation("S1")->addPlatforms({1, 2});
+            live.findStation("S1")->findPlatform(1)->addLines({1, 2});
+            live.findStation("S1")->findPlatform(2)->addLine(1);
+            live.findStation("S1")->addTrainSchedule(1, 1, Time(7, 30), true);
+            live.findStation("S1")->addTrainSchedule(1, 2, Time(9, 0), false);
+            live.findStation("S1")->addTrainSchedule(2, 1, Time(10, 0), false, DayMask::weekends());
+            for (ReportFormat format : {ReportFormat::Table, ReportFormat::Csv, ReportFormat::JsonLines}) {
+                std::string expected = renderView([&](OutputBuffer& out) { ReportWriter<std::string>(out, format).write(live); });
+                std::string rendered = renderView([&](OutputBuffer& out) {
+                    ReportWriter<std::string> writer(out, format);
+                    after.writeReport(writer);
+                });
+                assert(rendered == expected);
+                Versioned copied(live);
+                std::string fromCopy = renderView([&](OutputBuffer& out) {
+                    ReportWriter<std::string> writer(out, format);
+                    copied.snapshot().writeReport(writer);
+                });
+                assert(fromCopy == expected);
+            }
+        }
+
+        // Replaced nodes wait for the readers that can still reach them
+        for (int minute = 0; minute < 200 * 10; minute += 10) {
+            versioned.tryAddTrainSchedule("S1", 1, 2, Time::fromMinutes(minute % Time::MINUTES_PER_DAY), THROUGH_TRAIN);
+        }
+        assert(versioned.retiredCount() > 100);
+        assert(before.findStation("S1")->findPlatform(1)->findLine(2)->getSchedules().empty());
+        {
+            Versioned::Snapshot released = std::move(before);
+        }
+        versioned.reclaim();
+        assert(versioned.retiredCount() == 0);
+
+        // Readers running alongside a writer always see a whole version:
+        // every publish adds exactly one train
+        Versioned busy;
+        {
+            auto writer = busy.write();
+            for (int s = 0; s < 200; ++s) {
+                writer.addStation("S" + std::to_string(s), "Station");
+                writer.addPlatforms("S" + std::to_string(s), {1});
+                writer.addLines("S" + std::to_string(s), 1, {1, 2});
+            }
+        }
+        const uint64_t base = busy.getPublishedVersion();
+        std::atomic<bool> done{false};
+        std::atomic<size_t> checks{0};
+        auto reader = [&] {
+            while (!done.load()) {
+                auto snapshot = busy.snapshot();
+                size_t trains = 0;
+                for (size_t s = 0; s < snapshot.stationCount(); ++s) {
+                    for (const auto* platform : snapshot.station(s).getPlatforms()) {
+                        for (const auto* line : platform->getLines()) {
+                            const auto& timeline = line->getTimeline();
+                            assert(std::is_sorted(timeline.begin(), timeline.end(),
+                                [](const TrainSchedule& a, const TrainSchedule& b) { return a.time < b.time; }));
+                            trains += timeline.size();
+                        }
+                    }
+                }
+                assert(trains == snapshot.getVersion() - base);
+                checks.fetch_add(1);
+            }
+        };
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r) readers.emplace_back(reader);
+        size_t accepted = 0;
+        for (int i = 0; i < 20000; ++i) {
+            accepted += static_cast<bool>(busy.tryAddTrainSchedule("S" + std::to_string(i % 200), 1, 1 + (i / 200) % 2,
+                                                                   Time::fromMinutes((i / 400) * 10), THROUGH_TRAIN));
+        }
+        while (checks.load() < 10) std::this_thread::yield();
+        done.store(true);
+        for (auto& thread : readers) thread.join();
+        assert(accepted == 20000 && busy.getPublishedVersion() == base + accepted);
+    }
+
+    void testConflictAudit() {
+        std::cout << "Testing conflict audit...\n";
+
+        // Random dense lines (many trains near midnight, some on weekly
+        // patterns) loaded in two unchecked batches
+        std::mt19937 rng(17);
+        for (int round = 0; round < 300; ++round) {
+            std::vector<TrainSchedule> batch;
+            int trains = 1 + static_cast<int>(rng() % 80);
+            for (int i = 0; i < trains; ++i) {
+                int minute = rng() % 4 == 0 ? static_cast<int>(1410 + rng() % 60) % Time::MINUTES_PER_DAY
+                                            : static_cast<int>(rng() % Time::MINUTES_PER_DAY);
+                DayMask days = rng() % 4 == 0 ? DayMask(static_cast<uint8_t>(1 + rng() % 127)) : DayMask::daily();
+                batch.emplace_back(Time::fromMinutes(minute), static_cast<TrainClass>(rng() % 2), days);
+            }
+            Line line(1);
+            size_t half = batch.size() / 2;
+            line.appendUnchecked(std::vector<TrainSchedule>(batch.begin(), batch.begin() + half));
+            line.appendUnchecked(std::vector<TrainSchedule>(batch.begin() + half, batch.end()));
+            Line restored(1);
+            restored.restoreSchedules(batch);
+            assert(line.getSchedules() == batch && line.getTimeline() == restored.getTimeline());
+            assert(line.getTrainIds() == restored.getTrainIds());
+            for (TrainClass trainClass : {THROUGH_TRAIN, STOPPING_TRAIN}) {
+                assert(line.getBlockedMask(trainClass).getWords() == restored.getBlockedMask(trainClass).getWords());
+            }
+
+            // The sweep finds exactly the pairs the reference rule flags
+            std::vector<TrainConflict> pairs;
+            line.findConflictPairs(pairs);
+            std::set<std::pair<TrainId, TrainId>> found;
+            for (const auto& pair : pairs) {
+                assert(*line.findTrain(pair.first.train) == pair.firstSchedule);
+                assert(*line.findTrain(pair.second.train) == pair.secondSchedule);
+                assert(pair.first.lineNumber == 1 && pair.second.lineNumber == 1);
+                found.insert(std::minmax(pair.first.train, pair.second.train));
+            }
+            assert(found.size() == pairs.size());
+            std::set<std::pair<TrainId, TrainId>> expected;
+            const auto& ids = line.getTrainIds();
+            for (size_t a = 0; a < batch.size(); ++a) {
+                for (size_t b = a + 1; b < batch.size(); ++b) {
+                    if (referenceConflicts(batch[a], batch[b].time, batch[b].trainClass, batch[b].days)) {
+                        expected.insert(std::minmax(ids[a], ids[b]));
+                    }
+                }
+            }
+            assert(found == expected);
+
+            // Every train the per-insert check turns away is in a pair
+            // with one it accepted earlier
+            Line checked(1);
+            std::vector<size_t> kept;
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (checked.tryAddTrain(batch[i].time, batch[i].trainClass, batch[i].days)) {
+                    kept.push_back(i);
+                    continue;
+                }
+                bool paired = false;
+                for (size_t k : kept) paired = paired || found.count(std::minmax(ids[k], ids[i]));
+                assert(paired);
+            }
+        }
+
+        // Deferred import of a generated network with a quarter of its rows
+        // aimed at conflicts
+        WorkloadShape shape;
+        shape.stations = 30;
+        shape.platforms = 2;
+        shape.lines = 3;
+        shape.trains = 40;
+        shape.conflictPercent = 25;
+        shape.seed = 4;
+        std::string text;
+        {
+            OutputBuffer out(text);
+            WorkloadGenerator(shape).writeImport(out);
+        }
+        RailwaySystem<std::string> checked;
+        std::ostringstream checkErrors;
+        ImportStats checkedStats = TimetableImporter<std::string>(checked, checkErrors).importBuffer(text);
+        RailwaySystem<std::string> deferred;
+        std::ostringstream errors;
+        TimetableImporter<std::string> importer(deferred, errors);
+        importer.deferChecks(3);
+        ImportStats stats = importer.importBuffer(text);
+        assert(stats.rows == checkedStats.rows && stats.rejected == 0 && stats.accepted == stats.rows);
+        assert(checkedStats.rejected > 0 && stats.conflicts >= checkedStats.rejected);
+        assert(errors.str().find("conflict at station S") != std::string::npos);
+
+        auto audit = auditConflicts(deferred, 1);
+        assert(audit.conflicts.size() == stats.conflicts && audit.lines == shape.lineCount());
+        assert(audit.trains == shape.trainRows() && audit.threads == 1);
+        auto parallel = auditConflicts(deferred, 4);
+        assert(parallel.threads == 3);  // 180 lines are three blocks
+        assert(parallel.conflicts.size() == audit.conflicts.size());
+        for (size_t i = 0; i < audit.conflicts.size(); ++i) {
+            assert(parallel.conflicts[i].station == audit.conflicts[i].station);
+            assert(parallel.conflicts[i].pair.first == audit.conflicts[i].pair.first);
+            assert(parallel.conflicts[i].pair.second == audit.conflicts[i].pair.second);
+        }
+
+        // Rows the checked import rejected are all part of a reported pair
+        std::set<std::tuple<const void*, int, int, TrainId>> inPairs;
+        for (const auto& conflict : audit.conflicts) {
+            for (const TrainHandle& handle : {conflict.pair.first, conflict.pair.second}) {
+                inPairs.insert({conflict.station, handle.platformNumber, handle.lineNumber, handle.train});
+            }
+        }
+        size_t rejectedRows = 0;
+        for (size_t s = 0; s < deferred.getStations().size(); ++s) {
+            const auto& station = *deferred.getStations()[s];
+            const auto& kept = *checked.getStations()[s];
+            for (const auto& platform : station.getPlatforms()) {
+                for (const auto& line : platform->getLines()) {
+                    const auto& accepted = kept.findPlatform(platform->getPlatformNumber())
+                                               ->findLine(line->getLineNumber())->getSchedules();
+                    size_t next = 0;
+                    for (size_t i = 0; i < line->getSchedules().size(); ++i) {
+                        if (next < accepted.size() && line->getSchedules()[i] == accepted[next]) {
+                            ++next;
+                            continue;
+                        }
+                        ++rejectedRows;
+                        assert(inPairs.count({&station, platform->getPlatformNumber(), line->getLineNumber(),
+                                              line->getTrainIds()[i]}));
+                    }
+                    assert(next == accepted.size());
+                }
+            }
+        }
+        assert(rejectedRows == checkedStats.rejected);
+
+        // Cancelling the later train of every pair leaves a clean network
+        for (const auto& conflict : audit.conflicts) {
+            deferred.findStation(conflict.station->getId())->removeTrain(conflict.pair.second);
+        }
+        assert(auditConflicts(deferred).conflicts.empty());
+
+        // Unknown lines are still rejected row by row
+        RailwaySystem<std::string> small;
+        std::ostringstream smallErrors;
+        TimetableImporter<std::string> smallImporter(small, smallErrors);
+        smallImporter.deferChecks();
+        ImportStats smallStats = smallImporter.importBuffer(
+            "STATION,A,Alpha\nPLATFORMS,A,1\nLINES,A,1,1\n"
+            "TRAIN,A,1,2,08:00,S\nTRAIN,A,2,1,08:00,S\nTRAIN,A,1,1,08:00,S\nTRAIN,A,1,1,08:10,T\nTRAIN,A,1,1,23:55,T,Mon\nTRAIN,A,1,1,00:02,T,Tue\n");
+        assert(smallStats.rejected == 2 && smallStats.accepted == 7 && smallStats.conflicts == 2);
+        assert(smallErrors.str().find("line 4: Line not found") != std::string::npos);
+        assert(smallErrors.str().find("line 5: Platform not found") != std::string::npos);
+    }
+
+    // Runs display code that writes straight to the stdout descriptor
+    template<typename Display>
+    static std::string captureStdout(Display display) {
+        std::cout.flush();
+        char path[] = "/tmp/railway_stdout_XXXXXX";
+        int fd = mkstemp(path);
+        assert(fd >= 0);
+        int saved = dup(STDOUT_FILENO);
+        dup2(fd, STDOUT_FILENO);
+        display();
+        std::cout.flush();
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        close(fd);
+        std::ifstream in(path);
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        unlink(path);
+        return text;
+    }
+
+    template<typename Write>
+    static std::string renderView(Write write) {
+        std::string text;
+        {
+            OutputBuffer out(text);
+            write(out);
+        }
+        return text;
+    }
+
+    void testIncrementalView() {
+        std::cout << "Testing incremental view...\n";
+
+        RailwaySystem<std::string> railway;
+        IncrementalTableView<std::string> view;
+        auto full = [&] { return renderView([&](OutputBuffer& out) { view.writeAll(railway, out); }); };
+        auto changes = [&] { return renderView([&](OutputBuffer& out) { view.writeChanges(railway, out); }); };
+
+        assert(full() == renderReport(railway, ReportFormat::Table));
+
+        for (int s = 1; s <= 3; ++s) {
+            auto* station = railway.addStation("S" + std::to_string(s), "Station " + std::to_string(s));
+            station->addPlatforms({1, 2});
+            for (const auto& platform : station->getPlatforms()) {
+                platform->addLines({1, 2});
+            }
+            station->addTrainSchedule(1, 1, Time(8, 0), true);
+        }
+        assert(full() == renderReport(railway, ReportFormat::Table));
+        assert(view.getRenderedFragments() == 3 + 6 + 12);
+
+        // Nothing changed: everything comes from the cache
+        assert(full() == renderReport(railway, ReportFormat::Table));
+        assert(view.getRenderedFragments() == 0);
+        assert(changes() == "\n=== Changes Since Last View ===\nNo changes since last view.\n");
+
+        // One insert re-renders one line plus its platform and station headers
+        auto* station = railway.findStation("S2");
+        uint64_t stationRevision = station->getRevision();
+        uint64_t otherRevision = station->findPlatform(1)->getRevision();
+        station->addTrainSchedule(2, 2, Time(9, 0), false);
+        assert(station->getRevision() != stationRevision);
+        assert(station->findPlatform(1)->getRevision() == otherRevision);
+        assert(full() == renderReport(railway, ReportFormat::Table));
+        assert(view.getRenderedFragments() == 3);
+
+        // The change view lists only the touched subtree
+        station->addTrainSchedule(2, 2, Time(10, 0), true);
+        std::string delta = changes();
+        assert(view.getRenderedFragments() == 3);
+        assert(delta.find("Station ID: S2") != std::string::npos);
+        assert(delta.find("Station ID: S1") == std::string::npos);
+        assert(delta.find("Platform 1:") == std::string::npos);
+        assert(delta.find("Platform 2:") != std::string::npos);
+        assert(delta.find("10:00") != std::string::npos);
+        assert(changes().find("No changes since last view.") != std::string::npos);
+
+        // Structural changes are tracked as well
+        railway.findStation("S3")->findPlatform(2)->addLine(3);
+        railway.addStation("S4", "Station 4");
+        assert(full() == renderReport(railway, ReportFormat::Table));
+        assert(view.getRenderedFragments() == 2 + 1 + 1);
+    }
+
+    void testMetrics() {
+        std::cout << "Testing metrics...\n";
+
+        std::ostringstream json;
+        writeMetrics(json, MetricsFormat::Json, MetricsSnapshot());
+        assert(json.str().find("\"conflict_checks\":0") != std::string::npos);
+        if (!METRICS_ENABLED) return;
+
+        resetMetrics();
+        RailwaySystem<std::string> railway;
+        railway.addStation("S1", "Central");
+        auto* station = railway.findStation("S1");
+        station->addPlatform(1);
+        station->findPlatform(1)->addLines({1, 2});
+        station->addTrainSchedule(1, 1, Time(10, 0), true);
+        assert(!station->tryAddTrainSchedule(1, 1, Time(10, 15), false));
+        assert(!station->tryAddTrainSchedule(1, 5, Time(12, 0), false));
+        assert(station->findPlatform(1)->findLine(2)->canAddTrain(Time(10, 0), true));
+
+        MetricsSnapshot metrics = collectMetrics();
+        assert(metrics.get(MetricCounter::ConflictChecks) == 3);
+        assert(metrics.get(MetricCounter::ConflictRejections) == 1);
+        assert(metrics.get(MetricCounter::StationLookups) == 2);
+        assert(metrics.get(MetricCounter::StationProbes) == 1);
+        assert(metrics.get(MetricCounter::LineLookups) == 6);
+        assert(metrics.get(MetricCounter::LineProbes) >= 3);
+        assert(metrics.get(MetricHistogram::AddTrainSchedule).count == 3);
+        assert(metrics.get(MetricHistogram::Display).count == 0);
+
+        // Counts from other threads are aggregated, also after they exit
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t) {
+            workers.emplace_back([&railway] {
+                for (int i = 0; i < 1000; ++i) {
+                    railway.findStation("S1");
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        assert(collectMetrics().get(MetricCounter::StationLookups) == 4002);
+
+        LatencyHistogram histogram;
+        histogram.buckets[latencyBucket(100)] = 99;
+        histogram.buckets[latencyBucket(5000)] = 1;
+        histogram.count = 100;
+        assert(latencyBucket(0) == 0 && latencyBucket(1) == 1 && latencyBucket(128) == 8);
+        assert(histogram.percentile(0.5) == 128);
+        assert(histogram.percentile(0.995) == 8192);
+
+        // The caller's stream formatting survives the table
+        std::ostringstream text;
+        text << std::scientific << std::setprecision(4);
+        std::ios::fmtflags flags = text.flags();
+        writeMetrics(text, MetricsFormat::Text);
+        assert(text.str().find("station_lookups") != std::string::npos);
+        assert(text.flags() == flags && text.precision() == 4);
+        std::ostringstream after;
+        after.flags(text.flags());
+        after.precision(text.precision());
+        after << 1.5;
+        assert(after.str() == "1.5000e+00");
+        resetMetrics();
+        assert(collectMetrics().get(MetricCounter::StationLookups) == 0);
+    }
+
 public:
     void runAllTests() {
         std::cout << "Running railway system tests...\n\n";
@@ -248,6 +2271,30 @@ public:
         testRailwayStation();
         testRailwaySystem();
         testEdgeCases();
+        testScheduleIndex();
+        testLookupIndexes();
+        testTimetableImport();
+        testSnapshot();
+        testFlatNetwork();
+        testCompactTime();
+        testReportWriter();
+        testConcurrentInserts();
+        testFreeSlotQueries();
+        testTryAddTrain();
+        testScriptMode();
+        testJournal();
+        testPeriodicSchedules();
+        testJourneyPlanner();
+        testAllocationFreePaths();
+        testHeadwayPolicies();
+        testWorkloadGenerator();
+        testTrainAssignment();
+        testTimetableQueries();
+        testTrainRemoval();
+        testVersionedSnapshots();
+        testConflictAudit();
+        testIncrementalView();
+        testMetrics();
         
         std::cout << "\nAll tests passed successfully!\n";
     }
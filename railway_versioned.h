@@ -0,0 +1,490 @@
+// railway_versioned.h
+#pragma once
+#include "railway.h"
+#include "railway_report.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Snapshot-isolated readers over a copy-on-write railway
+//
+// Every published version is immutable. A writer copies only the path it
+// changes (the line, its platform and station nodes, one chunk of station
+// slots and the small root) and publishes the new root with one atomic
+// store. A reader holding an older version keeps a consistent
+// point-in-time view: readers never wait for writers and writers never
+// wait for readers. Nodes created for the version being built are changed
+// in place, so a batch of changes under one Writer copies each path once.
+//
+// Reclamation is epoch based. A reader pins the published version number
+// in one of MAX_READERS slots before it loads the root. Replaced nodes are
+// tagged with the first version that no longer holds them and are freed
+// once every pinned slot has reached that version. Writers serialize on
+// one mutex. Adding stations copies the ID index once per batch, so large
+// networks are best built in one batch or from an existing RailwaySystem.
+template<typename T>
+class VersionedRailwaySystem {
+public:
+    static constexpr size_t MAX_READERS = 128;
+    static constexpr size_t CHUNK_SIZE = 64;  // station slots per copy-on-write chunk
+
+    // A line as readers see it, tagged with the version it was built for
+    struct LineNode : Line {
+        uint64_t version;
+
+        LineNode(int lineNumber, uint64_t builtFor) : Line(lineNumber), version(builtFor) {}
+    };
+
+    class PlatformNode {
+    private:
+        friend class VersionedRailwaySystem;
+
+        int platformNumber;
+        vector<const LineNode*> lines;
+        uint64_t version;
+
+    public:
+        PlatformNode(int number, uint64_t builtFor) : platformNumber(number), version(builtFor) {}
+
+        int getPlatformNumber() const { return platformNumber; }
+        const vector<const LineNode*>& getLines() const { return lines; }
+
+        const LineNode* findLine(int lineNumber) const {
+            for (const auto* line : lines) {
+                if (line->getLineNumber() == lineNumber) return line;
+            }
+            return nullptr;
+        }
+    };
+
+    // Shared by every version of a station, so the index can view the ID
+    struct StationInfo {
+        T id;
+        string name;
+        size_t position;
+    };
+
+    class StationNode {
+    private:
+        friend class VersionedRailwaySystem;
+
+        const StationInfo* info;
+        vector<const PlatformNode*> platforms;
+        uint64_t version;
+
+    public:
+        StationNode(const StationInfo* shared, uint64_t builtFor) : info(shared), version(builtFor) {}
+
+        const T& getId() const { return info->id; }
+        const string& getName() const { return info->name; }
+        const vector<const PlatformNode*>& getPlatforms() const { return platforms; }
+
+        const PlatformNode* findPlatform(int platformNumber) const {
+            for (const auto* platform : platforms) {
+                if (platform->getPlatformNumber() == platformNumber) return platform;
+            }
+            return nullptr;
+        }
+    };
+
+private:
+    struct Chunk {
+        array<const StationNode*, CHUNK_SIZE> stations{};
+        uint64_t version;
+    };
+
+    struct IndexNode {
+        IdIndex<T, const StationInfo> index;
+        uint64_t version;
+    };
+
+    struct Root {
+        uint64_t version;
+        size_t stationCount = 0;
+        vector<const Chunk*> chunks;
+        const IndexNode* index;
+
+        const StationNode& station(size_t position) const {
+            return *chunks[position / CHUNK_SIZE]->stations[position % CHUNK_SIZE];
+        }
+
+        const StationNode* findStation(LookupKey<T> id) const {
+            const StationInfo* info = index->index.find(id);
+            return info ? &station(info->position) : nullptr;
+        }
+    };
+
+    struct Retired {
+        uint64_t version;  // first version without the node
+        const void* node;
+        void (*destroy)(const void*);
+    };
+
+    struct alignas(64) ReaderSlot {
+        atomic<uint64_t> pinned{0};  // 0 when free
+    };
+
+    static constexpr size_t RECLAIM_BATCH = 64;
+
+    atomic<const Root*> current;
+    atomic<uint64_t> published{1};
+    mutable array<ReaderSlot, MAX_READERS> readers;
+    mutex writerLock;
+    vector<unique_ptr<StationInfo>> infos;
+    vector<Retired> retired;  // in version order
+
+    template<typename Node>
+    static void destroyNode(const void* node) {
+        delete static_cast<const Node*>(node);
+    }
+
+    template<typename Node>
+    void retire(const Node* node, uint64_t version) {
+        retired.push_back({version, node, &destroyNode<Node>});
+    }
+
+    // Frees replaced nodes no pinned reader can still reach; called with
+    // the writer lock held
+    void reclaimRetired() {
+        uint64_t oldest = UINT64_MAX;
+        for (const auto& slot : readers) {
+            uint64_t pinned = slot.pinned.load();
+            if (pinned != 0) oldest = min(oldest, pinned);
+        }
+        size_t freed = 0;
+        while (freed < retired.size() && retired[freed].version <= oldest) {
+            retired[freed].destroy(retired[freed].node);
+            ++freed;
+        }
+        retired.erase(retired.begin(), retired.begin() + static_cast<ptrdiff_t>(freed));
+    }
+
+    void destroyAll(const Root* root) {
+        for (size_t position = 0; position < root->stationCount; ++position) {
+            const StationNode& station = root->station(position);
+            for (const auto* platform : station.platforms) {
+                for (const auto* line : platform->lines) delete line;
+                delete platform;
+            }
+            delete &station;
+        }
+        for (const auto* chunk : root->chunks) delete chunk;
+        delete root->index;
+        delete root;
+    }
+
+public:
+    // A pinned, immutable version. Reading it never blocks and is never
+    // blocked; release it (destroy it) promptly so old nodes can be freed.
+    class Snapshot {
+    private:
+        friend class VersionedRailwaySystem;
+
+        const Root* root;
+        atomic<uint64_t>* slot;
+
+        Snapshot(const Root* pinnedRoot, atomic<uint64_t>* readerSlot) : root(pinnedRoot), slot(readerSlot) {}
+
+    public:
+        Snapshot(Snapshot&& other) noexcept : root(other.root), slot(other.slot) { other.slot = nullptr; }
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        ~Snapshot() {
+            if (slot) slot->store(0);
+        }
+
+        uint64_t getVersion() const { return root->version; }
+        size_t stationCount() const { return root->stationCount; }
+        const StationNode& station(size_t position) const { return root->station(position); }
+        const StationNode* findStation(LookupKey<T> id) const { return root->findStation(id); }
+
+        void writeReport(ReportWriter<T>& writer) const {
+            writer.writeHeader(root->stationCount == 0);
+            for (size_t position = 0; position < root->stationCount; ++position) {
+                const StationNode& node = root->station(position);
+                if (writer.includesStation(node)) {
+                    writer.writeStation(node);
+                }
+            }
+        }
+    };
+
+    // Batch of changes, published together when the writer is destroyed
+    // (or at each publish()). Holds the writer lock throughout.
+    class Writer {
+    private:
+        friend class VersionedRailwaySystem;
+
+        VersionedRailwaySystem& system;
+        unique_lock<mutex> lock;
+        Root* draft = nullptr;
+
+        uint64_t building() const { return system.published.load() + 1; }
+
+        const Root& view() const { return draft ? *draft : *system.current.load(); }
+
+        Root& editRoot() {
+            if (!draft) {
+                const Root* base = system.current.load();
+                draft = new Root(*base);
+                draft->version = building();
+                system.retire(base, draft->version);
+            }
+            return *draft;
+        }
+
+        // Copy-on-write of one child pointer inside an already owned node
+        template<typename Node>
+        Node* own(const Node*& slot) {
+            if (slot->version == draft->version) return const_cast<Node*>(slot);
+            Node* copy = new Node(*slot);
+            copy->version = draft->version;
+            system.retire(slot, draft->version);
+            slot = copy;
+            return copy;
+        }
+
+        StationNode* editStation(size_t position) {
+            Root& root = editRoot();
+            Chunk* chunk = own(root.chunks[position / CHUNK_SIZE]);
+            return own(chunk->stations[position % CHUNK_SIZE]);
+        }
+
+        static size_t indexOf(const StationNode& station, const PlatformNode* platform) {
+            return static_cast<size_t>(find(station.platforms.begin(), station.platforms.end(), platform) -
+                                       station.platforms.begin());
+        }
+
+        LineNode* editLine(const StationNode& station, const PlatformNode* platform, const LineNode* line) {
+            size_t platformIndex = indexOf(station, platform);
+            size_t lineIndex = static_cast<size_t>(find(platform->lines.begin(), platform->lines.end(), line) -
+                                                   platform->lines.begin());
+            StationNode* ownedStation = editStation(station.info->position);
+            PlatformNode* ownedPlatform = own(ownedStation->platforms[platformIndex]);
+            return own(ownedPlatform->lines[lineIndex]);
+        }
+
+        const StationNode& requireStation(LookupKey<T> id) const {
+            const StationNode* station = view().findStation(id);
+            if (!station) {
+                throw RailwayException("Station not found");
+            }
+            return *station;
+        }
+
+        // Resolves a train's line, or reports which part is missing
+        AddStatus locate(LookupKey<T> id, int platformNumber, int lineNumber, const StationNode*& station,
+                         const PlatformNode*& platform, const LineNode*& line) const {
+            station = view().findStation(id);
+            if (!station) return AddStatus::StationNotFound;
+            platform = station->findPlatform(platformNumber);
+            if (!platform) return AddStatus::PlatformNotFound;
+            line = platform->findLine(lineNumber);
+            return line ? AddStatus::Added : AddStatus::LineNotFound;
+        }
+
+    public:
+        explicit Writer(VersionedRailwaySystem& owner) : system(owner), lock(owner.writerLock) {}
+
+        ~Writer() { publish(); }
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        // Makes the changes so far visible to new snapshots
+        void publish() {
+            if (!draft) return;
+            system.current.store(draft);
+            system.published.store(draft->version);
+            draft = nullptr;
+            if (system.retired.size() >= RECLAIM_BATCH) {
+                system.reclaimRetired();
+            }
+        }
+
+        void addStation(T id, string name) {
+            if (view().findStation(id)) {
+                throw RailwayException("Station ID already exists");
+            }
+            Root& root = editRoot();
+            size_t position = root.stationCount;
+            system.infos.push_back(make_unique<StationInfo>(StationInfo{move(id), move(name), position}));
+            const StationInfo* info = system.infos.back().get();
+            own(root.index)->index.insert(info->id, info);
+            if (position % CHUNK_SIZE == 0) {
+                root.chunks.push_back(new Chunk{{}, root.version});
+            }
+            Chunk* chunk = own(root.chunks.back());
+            chunk->stations[position % CHUNK_SIZE] = new StationNode(info, root.version);
+            ++root.stationCount;
+        }
+
+        void addPlatforms(LookupKey<T> id, const vector<int>& platformNumbers) {
+            if (platformNumbers.empty()) {
+                throw RailwayException("No platform numbers provided");
+            }
+            size_t position = requireStation(id).info->position;
+            for (int platformNumber : platformNumbers) {
+                if (platformNumber <= 0) {
+                    throw RailwayException("Platform number must be positive");
+                }
+                StationNode* station = editStation(position);
+                if (station->findPlatform(platformNumber)) {
+                    throw RailwayException("Platform already exists");
+                }
+                station->platforms.push_back(new PlatformNode(platformNumber, draft->version));
+            }
+        }
+
+        void addLines(LookupKey<T> id, int platformNumber, const vector<int>& lineNumbers) {
+            if (lineNumbers.empty()) {
+                throw RailwayException("No line numbers provided");
+            }
+            const StationNode& station = requireStation(id);
+            const PlatformNode* platform = station.findPlatform(platformNumber);
+            if (!platform) {
+                throw RailwayException("Platform not found");
+            }
+            size_t platformIndex = indexOf(station, platform);
+            for (int lineNumber : lineNumbers) {
+                if (lineNumber <= 0) {
+                    throw RailwayException("Line number must be positive");
+                }
+                PlatformNode* owned = own(editStation(station.info->position)->platforms[platformIndex]);
+                if (owned->findLine(lineNumber)) {
+                    throw RailwayException("Line already exists on this platform");
+                }
+                owned->lines.push_back(new LineNode(lineNumber, draft->version));
+            }
+        }
+
+        // Rejected inserts copy nothing
+        AddResult tryAddTrainSchedule(LookupKey<T> id, int platformNumber, int lineNumber, const Time& time,
+                                      TrainClass trainClass, DayMask days = DayMask()) {
+            const StationNode* station;
+            const PlatformNode* platform;
+            const LineNode* line;
+            AddStatus found = locate(id, platformNumber, lineNumber, station, platform, line);
+            if (found != AddStatus::Added) {
+                return AddResult(found);
+            }
+            if (trainClass >= line->getPolicy().classCount()) {
+                return AddResult(AddStatus::InvalidTrainClass);
+            }
+            if (const TrainSchedule* conflict = line->findConflict(time, trainClass, days)) {
+                return AddResult(AddStatus::Conflict, *conflict);
+            }
+            AddResult result = editLine(*station, platform, line)->tryAddTrain(time, trainClass, days);
+            result.handle.platformNumber = platformNumber;
+            return result;
+        }
+
+        bool removeTrain(LookupKey<T> id, const TrainHandle& handle) {
+            const StationNode* station;
+            const PlatformNode* platform;
+            const LineNode* line;
+            if (locate(id, handle.platformNumber, handle.lineNumber, station, platform, line) != AddStatus::Added ||
+                !line->findTrain(handle.train)) {
+                return false;
+            }
+            return editLine(*station, platform, line)->removeTrain(handle.train);
+        }
+
+        AddResult rescheduleTrain(LookupKey<T> id, const TrainHandle& handle, const Time& time,
+                                  TrainClass trainClass, DayMask days = DayMask()) {
+            const StationNode* station;
+            const PlatformNode* platform;
+            const LineNode* line;
+            AddStatus found = locate(id, handle.platformNumber, handle.lineNumber, station, platform, line);
+            if (found != AddStatus::Added) {
+                return AddResult(found);
+            }
+            if (!line->findTrain(handle.train)) {
+                return AddResult(AddStatus::TrainNotFound);
+            }
+            // A refused move leaves an unchanged copy behind in this version
+            AddResult result = editLine(*station, platform, line)->rescheduleTrain(handle.train, time, trainClass, days);
+            if (result) result.handle.platformNumber = handle.platformNumber;
+            return result;
+        }
+    };
+
+    VersionedRailwaySystem() {
+        current.store(new Root{1, 0, {}, new IndexNode{{}, 1}});
+    }
+
+    // Starts from a copy of an existing system, published as version 2
+    explicit VersionedRailwaySystem(const RailwaySystem<T>& source) : VersionedRailwaySystem() {
+        Writer writer(*this);
+        for (const auto& station : source.getStations()) {
+            writer.addStation(station->getId(), station->getName());
+            StationNode* owned = writer.editStation(writer.view().stationCount - 1);
+            for (const auto& platform : station->getPlatforms()) {
+                auto* platformNode = new PlatformNode(platform->getPlatformNumber(), owned->version);
+                for (const auto& line : platform->getLines()) {
+                    auto* lineNode = new LineNode(line->getLineNumber(), owned->version);
+                    lineNode->restoreSchedules(line->getSchedules());
+                    platformNode->lines.push_back(lineNode);
+                }
+                owned->platforms.push_back(platformNode);
+            }
+        }
+    }
+
+    // Snapshots must all be released before the system is destroyed
+    ~VersionedRailwaySystem() {
+        for (const auto& entry : retired) entry.destroy(entry.node);
+        destroyAll(current.load());
+    }
+
+    VersionedRailwaySystem(const VersionedRailwaySystem&) = delete;
+    VersionedRailwaySystem& operator=(const VersionedRailwaySystem&) = delete;
+
+    // Pins the latest published version: two atomic loads and one
+    // compare-and-swap on a reader slot, no locks
+    Snapshot snapshot() const {
+        static thread_local size_t hint = hash<thread::id>{}(this_thread::get_id()) % MAX_READERS;
+        uint64_t version = published.load();
+        for (size_t i = 0; i < MAX_READERS; ++i) {
+            size_t index = (hint + i) % MAX_READERS;
+            uint64_t expected = 0;
+            if (readers[index].pinned.compare_exchange_strong(expected, version)) {
+                hint = index;
+                return Snapshot(current.load(), &readers[index].pinned);
+            }
+        }
+        throw RailwayException("Too many snapshot readers");
+    }
+
+    Writer write() { return Writer(*this); }
+
+    // Single changes, each published on its own
+    void addStation(T id, string name) { write().addStation(move(id), move(name)); }
+    void addPlatforms(LookupKey<T> id, const vector<int>& platformNumbers) { write().addPlatforms(id, platformNumbers); }
+    void addLines(LookupKey<T> id, int platformNumber, const vector<int>& lineNumbers) {
+        write().addLines(id, platformNumber, lineNumbers);
+    }
+    AddResult tryAddTrainSchedule(LookupKey<T> id, int platformNumber, int lineNumber, const Time& time,
+                                  TrainClass trainClass, DayMask days = DayMask()) {
+        return write().tryAddTrainSchedule(id, platformNumber, lineNumber, time, trainClass, days);
+    }
+
+    // Reclamation runs by itself after a publish once RECLAIM_BATCH nodes
+    // are waiting; this frees what it can right away
+    void reclaim() {
+        lock_guard<mutex> lock(writerLock);
+        reclaimRetired();
+    }
+
+    uint64_t getPublishedVersion() const { return published.load(); }
+
+    // Replaced nodes still waiting for readers to move on
+    size_t retiredCount() {
+        lock_guard<mutex> lock(writerLock);
+        return retired.size();
+    }
+};
@@ -0,0 +1,361 @@
+// railway_workload.h
+#pragma once
+#include "railway.h"
+#include "railway_import.h"
+#include <chrono>
+#include <fcntl.h>
+#include <random>
+#include <unistd.h>
+
+// Synthetic networks for scale testing
+//
+// A WorkloadShape fixes the network size (stations x platforms x lines)
+// and the number of train rows per line. After a line's first train, each
+// row is aimed at a minute its line already blocks with probability
+// conflictPercent, and at a free slot otherwise, so exactly the aimed
+// rows are rejected. Free slots lie on a 30-minute grid (mixed stopping
+// and through trains) or, past 48 trains a line, a 10-minute grid of
+// through trains. The same shape and seed always give the same rows.
+//
+// Rows are produced in import-file order and can be written as an import
+// file or applied straight to a RailwaySystem.
+
+struct WorkloadShape {
+    int stations = 100;
+    int platforms = 4;
+    int lines = 4;
+    int trains = 24;  // train rows per line
+    int conflictPercent = 0;
+    uint32_t seed = 1;
+
+    size_t lineCount() const { return size_t(stations) * platforms * lines; }
+    size_t trainRows() const { return lineCount() * trains; }
+};
+
+// "<stations>x<platforms>x<lines>x<trains>", e.g. "1000x4x4x24"
+inline WorkloadShape parseWorkloadShape(string_view text) {
+    int values[4];
+    for (int i = 0; i < 4; ++i) {
+        size_t end = i < 3 ? text.find('x') : text.size();
+        if (end == string_view::npos) {
+            throw RailwayException("Workload shape must look like 1000x4x4x24");
+        }
+        values[i] = parseNumber(text.substr(0, end), "workload size");
+        text.remove_prefix(i < 3 ? end + 1 : end);
+    }
+    WorkloadShape shape;
+    shape.stations = values[0];
+    shape.platforms = values[1];
+    shape.lines = values[2];
+    shape.trains = values[3];
+    return shape;
+}
+
+struct WorkloadTrain {
+    int station;  // index, see workloadStationId
+    int platform;
+    int line;
+    Time time;
+    bool isStoppingTrain;
+    bool aimedAtConflict;
+};
+
+template<typename T>
+T workloadStationId(int index) {
+    if constexpr (is_same<T, string>::value) {
+        return "S" + to_string(index);
+    } else {
+        return static_cast<T>(index);
+    }
+}
+
+class WorkloadGenerator {
+private:
+    WorkloadShape shape;
+    size_t conflictRows = 0;
+
+public:
+    explicit WorkloadGenerator(const WorkloadShape& workload) : shape(workload) {
+        if (shape.stations <= 0 || shape.platforms <= 0 || shape.lines <= 0 || shape.trains < 0) {
+            throw RailwayException("Workload sizes must be positive");
+        }
+        if (shape.trains > Time::MINUTES_PER_DAY / THROUGH_HEADWAY) {
+            throw RailwayException("A line holds at most 144 trains a day");
+        }
+        if (shape.conflictPercent < 0 || shape.conflictPercent > 100) {
+            throw RailwayException("Conflict rate must be between 0 and 100 percent");
+        }
+    }
+
+    // Calls visitLine(station, platform, line) for every line, each
+    // followed by visitTrain(train) for that line's trains
+    template<typename VisitLine, typename VisitTrain>
+    void generate(VisitLine visitLine, VisitTrain visitTrain) {
+        mt19937 rng(shape.seed);
+        const int spacing = shape.trains <= Time::MINUTES_PER_DAY / STOPPING_HEADWAY ? STOPPING_HEADWAY
+                                                                                  : THROUGH_HEADWAY;
+        vector<int> slots(Time::MINUTES_PER_DAY / spacing);
+        vector<int> placed;
+        placed.reserve(shape.trains);
+        conflictRows = 0;
+        for (int s = 0; s < shape.stations; ++s) {
+            for (int p = 1; p <= shape.platforms; ++p) {
+                for (int l = 1; l <= shape.lines; ++l) {
+                    visitLine(s, p, l);
+                    int offset = static_cast<int>(rng() % spacing);
+                    for (size_t i = 0; i < slots.size(); ++i) slots[i] = static_cast<int>(i) * spacing + offset;
+                    shuffle(slots.begin(), slots.end(), rng);
+                    placed.clear();
+                    size_t nextSlot = 0;
+                    for (int t = 0; t < shape.trains; ++t) {
+                        bool aimed = !placed.empty() && static_cast<int>(rng() % 100) < shape.conflictPercent;
+                        int minute;
+                        bool stopping;
+                        if (aimed) {
+                            // Within 9 minutes of a placed train conflicts whatever the classes
+                            int near = placed[rng() % placed.size()] + static_cast<int>(rng() % 19) - 9;
+                            minute = (near + Time::MINUTES_PER_DAY) % Time::MINUTES_PER_DAY;
+                            stopping = (rng() & 1) != 0;
+                            ++conflictRows;
+                        } else {
+                            minute = slots[nextSlot++];
+                            stopping = spacing == STOPPING_HEADWAY && (rng() & 1) != 0;
+                            placed.push_back(minute);
+                        }
+                        visitTrain(WorkloadTrain{s, p, l, Time::fromMinutes(minute), stopping, aimed});
+                    }
+                }
+            }
+        }
+    }
+
+    // Writes the network as an import file
+    template<typename T = string>
+    void writeImport(OutputBuffer& out) {
+        int currentStation = -1;
+        int currentPlatform = 0;
+        auto appendId = [&](int station) {
+            out.append(',');
+            if constexpr (is_same<T, string>::value) {
+                out.append('S');
+            }
+            out.appendInt(station);
+        };
+        generate(
+            [&](int station, int platform, int) {
+                if (station != currentStation) {
+                    out.append("STATION");
+                    appendId(station);
+                    out.append(",Station ");
+                    out.appendInt(station);
+                    out.append("\nPLATFORMS");
+                    appendId(station);
+                    for (int p = 1; p <= shape.platforms; ++p) {
+                        out.append(',');
+                        out.appendInt(p);
+                    }
+                    out.append('\n');
+                    currentStation = station;
+                    currentPlatform = 0;
+                }
+                if (platform != currentPlatform) {
+                    out.append("LINES");
+                    appendId(station);
+                    out.append(',');
+                    out.appendInt(platform);
+                    for (int l = 1; l <= shape.lines; ++l) {
+                        out.append(',');
+                        out.appendInt(l);
+                    }
+                    out.append('\n');
+                    currentPlatform = platform;
+                }
+            },
+            [&](const WorkloadTrain& train) {
+                out.append("TRAIN");
+                appendId(train.station);
+                out.append(',');
+                out.appendInt(train.platform);
+                out.append(',');
+                out.appendInt(train.line);
+                out.append(',');
+                out.appendTime(train.time);
+                out.append(train.isStoppingTrain ? ",S\n" : ",T\n");
+            });
+    }
+
+    template<typename T = string>
+    void writeImportFile(const string& path) {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw RailwayException("Cannot write workload to '" + path + "'");
+        }
+        {
+            OutputBuffer out(fd);
+            writeImport<T>(out);
+        }
+        close(fd);
+    }
+
+    // Builds the network straight through the API; train rows count as
+    // accepted or rejected as an import would count them
+    template<typename T>
+    ImportStats load(RailwaySystem<T>& railway) {
+        auto begin = chrono::steady_clock::now();
+        ImportStats stats;
+        vector<int> lineNumbers(shape.lines);
+        for (int l = 0; l < shape.lines; ++l) lineNumbers[l] = l + 1;
+        RailwayStation<T>* station = nullptr;
+        Platform* platform = nullptr;
+        generate(
+            [&](int s, int p, int l) {
+                if (l != 1) return;
+                if (p == 1) {
+                    station = railway.addStation(workloadStationId<T>(s), "Station " + to_string(s));
+                    stats.rows += 2;  // STATION and PLATFORMS
+                    stats.accepted += 2;
+                }
+                platform = station->addPlatform(p);
+                platform->addLines(lineNumbers);
+                ++stats.rows;
+                ++stats.accepted;
+            },
+            [&](const WorkloadTrain& train) {
+                ++stats.rows;
+                auto* line = platform->findLine(train.line);
+                if (line->tryAddTrain(train.time, train.isStoppingTrain)) {
+                    ++stats.accepted;
+                } else {
+                    ++stats.rejected;
+                }
+            });
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        return stats;
+    }
+
+    // Train rows aimed at a conflict by the last generate()
+    size_t getConflictRows() const { return conflictRows; }
+    const WorkloadShape& getShape() const { return shape; }
+};
+
+// Differential check of the optimized conflict paths
+//
+// referenceCanAddTrain is the rule written out directly: a linear pass
+// over every schedule, measuring the gap on the same day, to a train of
+// the previous day and to a train of the next day. runDifferential feeds
+// random inserts (many aimed near existing trains and across midnight,
+// some on weekly patterns) to fresh lines and compares canAddTrain,
+// findConflict, the blocked-minute masks and tryAddTrain against it.
+// Between inserts it cancels and moves random trains, so the mask repair
+// after a removal is checked by the probes that follow.
+
+inline bool referenceConflicts(const TrainSchedule& existing, const Time& time, TrainClass trainClass,
+                               DayMask days) {
+    int gap = StandardHeadways::headway(existing.trainClass, trainClass);
+    int minute = time.toMinutes();
+    int other = existing.time.toMinutes();
+    if (days.overlaps(existing.days) && abs(minute - other) < gap) return true;
+    if (days.overlaps(existing.days.following()) && minute + Time::MINUTES_PER_DAY - other < gap) return true;
+    if (days.following().overlaps(existing.days) && other + Time::MINUTES_PER_DAY - minute < gap) return true;
+    return false;
+}
+
+inline bool referenceCanAddTrain(const vector<TrainSchedule>& schedules, const Time& time, TrainClass trainClass,
+                                 DayMask days = DayMask()) {
+    for (const auto& existing : schedules) {
+        if (referenceConflicts(existing, time, trainClass, days)) return false;
+    }
+    return true;
+}
+
+struct DifferentialResult {
+    size_t inserts = 0;
+    size_t accepted = 0;
+    size_t removals = 0;
+    size_t reschedules = 0;
+    size_t mismatches = 0;
+    string firstMismatch;
+    double seconds = 0.0;
+};
+
+inline DifferentialResult runDifferential(size_t inserts, uint32_t seed) {
+    auto begin = chrono::steady_clock::now();
+    DifferentialResult result;
+    mt19937 rng(seed);
+    auto line = make_unique<Line>(1);
+    size_t attemptsOnLine = 0;
+
+    auto mismatch = [&](const char* path, const Time& time, TrainClass trainClass, DayMask days) {
+        if (result.mismatches++ == 0) {
+            result.firstMismatch = string(path) + " disagrees at insert " + to_string(result.inserts) + ": " +
+                                   time.toString() + (trainClass == STOPPING_TRAIN ? " stopping " : " through ") +
+                                   days.toString() + " on a line of " + to_string(line->getSchedules().size()) +
+                                   " trains";
+        }
+    };
+
+    for (; result.inserts < inserts; ++result.inserts) {
+        if (++attemptsOnLine > 400) {
+            line = make_unique<Line>(1);
+            attemptsOnLine = 1;
+        }
+        const auto& schedules = line->getSchedules();
+        int minute;
+        if (!schedules.empty() && (rng() & 1)) {
+            int near = schedules[rng() % schedules.size()].time.toMinutes() + static_cast<int>(rng() % 71) - 35;
+            minute = (near + Time::MINUTES_PER_DAY) % Time::MINUTES_PER_DAY;
+        } else {
+            minute = static_cast<int>(rng() % Time::MINUTES_PER_DAY);
+        }
+        Time time = Time::fromMinutes(minute);
+        TrainClass trainClass = static_cast<TrainClass>(rng() & 1);
+        DayMask days = rng() % 4 ? DayMask::daily() : DayMask(static_cast<uint8_t>(1 + rng() % DayMask::ALL));
+
+        bool expected = referenceCanAddTrain(schedules, time, trainClass, days);
+        if (line->canAddTrain(time, trainClass, days) != expected) {
+            mismatch("canAddTrain", time, trainClass, days);
+        }
+        const TrainSchedule* hit = line->findConflict(time, trainClass, days);
+        if ((hit == nullptr) != expected || (hit && !referenceConflicts(*hit, time, trainClass, days))) {
+            mismatch("findConflict", time, trainClass, days);
+        }
+        if (line->getBlockedMask(trainClass, days).test(minute) == expected) {
+            mismatch("getBlockedMask", time, trainClass, days);
+        }
+        if (days.isDaily() && line->getBlockedMask(trainClass).test(minute) == expected) {
+            mismatch("daily blocked mask", time, trainClass, days);
+        }
+        AddResult added = line->tryAddTrain(time, trainClass, days);
+        if (static_cast<bool>(added) != expected) {
+            mismatch("tryAddTrain", time, trainClass, days);
+        }
+        result.accepted += static_cast<bool>(added);
+
+        if (line->getSchedules().empty()) continue;
+        size_t pick = rng() % line->getSchedules().size();
+        TrainId train = line->getTrainIds()[pick];
+        switch (rng() % 8) {
+            case 0:
+                line->removeTrain(train);
+                ++result.removals;
+                break;
+            case 1: {
+                vector<TrainSchedule> others = line->getSchedules();
+                TrainSchedule moving = others[pick];
+                others.erase(others.begin() + static_cast<ptrdiff_t>(pick));
+                Time target = Time::fromMinutes((moving.time.toMinutes() + static_cast<int>(rng() % 61) + 1410) %
+                                                Time::MINUTES_PER_DAY);
+                bool free = referenceCanAddTrain(others, target, moving.trainClass, moving.days);
+                AddResult moved = line->rescheduleTrain(train, target, moving.trainClass, moving.days);
+                const TrainSchedule* now = line->findTrain(train);
+                if (static_cast<bool>(moved) != free || !now || now->time != (free ? target : moving.time)) {
+                    mismatch("rescheduleTrain", target, moving.trainClass, moving.days);
+                }
+                ++result.reschedules;
+                break;
+            }
+        }
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    return result;
+}